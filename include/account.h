@@ -22,6 +22,23 @@ typedef struct qline_ qline_t;
 typedef struct mymemo_ mymemo_t;
 typedef struct svsignore_ svsignore_t;
 
+/* kline/zline host index linkage, managed by node.c */
+typedef struct hostmask_index_node_ {
+  void *owner;
+  const char *mask;
+  unsigned long seq; /* insertion order, lookups return the oldest match */
+
+  mowgli_node_t hnode; /* exact mask bucket or wildcard list */
+  mowgli_node_t cnode; /* cidr prefix bucket */
+} hostmask_index_node_t;
+
+/* expiry queue linkage for timed bans, managed by node.c */
+typedef struct expiry_node_ {
+  void *owner;
+  time_t expires;
+  unsigned int slot; /* 1-based heap position, 0 if not queued */
+} expiry_node_t;
+
 /* kline list struct */
 struct kline_ {
   char *user;
@@ -33,6 +50,11 @@ struct kline_ {
   long duration;
   time_t settime;
   time_t expires;
+
+  mowgli_node_t node;
+  mowgli_node_t idnode; /* chain of entries sharing this number */
+  hostmask_index_node_t idx;
+  expiry_node_t expiry;
 };
 
 /* zline list struct */
@@ -45,6 +67,11 @@ struct zline_ {
   long duration;
   time_t settime;
   time_t expires;
+
+  mowgli_node_t node;
+  mowgli_node_t idnode; /* chain of entries sharing this number */
+  hostmask_index_node_t idx;
+  expiry_node_t expiry;
 };
 
 /* xline list struct */
@@ -57,6 +84,9 @@ struct xline_ {
   long duration;
   time_t settime;
   time_t expires;
+
+  mowgli_node_t node;
+  expiry_node_t expiry;
 };
 
 /* qline list struct */
@@ -69,6 +99,9 @@ struct qline_ {
   long duration;
   time_t settime;
   time_t expires;
+
+  mowgli_node_t node;
+  expiry_node_t expiry;
 };
 
 /* services ignore struct */
@@ -89,6 +122,7 @@ struct myuser_
 
   stringref email;
   stringref email_canonical;
+  mowgli_node_t email_node; /* in the list for email_canonical */
 
   mowgli_list_t logins; /* user_t's currently logged in to this */
   time_t registered;
@@ -110,6 +144,8 @@ struct myuser_
   language_t *language;
 
   mowgli_list_t cert_fingerprints;
+
+  mowgli_list_t authcookies; /* authcookie_t, oldest first */
 };
 
 /* Keep this synchronized with mu_flags in libathemecore/flags.c */
@@ -185,6 +221,14 @@ struct mychan_
   char *mlock_key;
 
   unsigned int flags;
+
+  /* chanacs lookup index, maintained by chanacs_add() and chanacs_delete() */
+  chanacs_t **chanacs_idx;        /* entity entries, hashed by entity pointer */
+  unsigned int chanacs_idx_size;
+  unsigned int chanacs_idx_count;
+  mowgli_list_t chanacs_hosts;    /* hostmask entries */
+  mowgli_list_t chanacs_indirect; /* group and exttarget entries */
+  unsigned int chanacs_gen;       /* changes whenever the access list does */
 };
 
 /* Keep this synchronized with mc_flags in libathemecore/flags.c */
@@ -224,6 +268,8 @@ struct chanacs_
 
 	mowgli_node_t    cnode;
 	mowgli_node_t    unode;
+	mowgli_node_t    inode; /* mychan->chanacs_hosts or chanacs_indirect */
+	chanacs_t       *inext; /* next entry in the same chanacs_idx bucket */
 
 	char setter_uid[IDLEN];
 };
@@ -404,6 +450,7 @@ E kline_t *kline_add_with_id(const char *user, const char *host, const char *rea
 E kline_t *kline_add(const char *user, const char *host, const char *reason, long duration, const char *setby);
 E kline_t *kline_add_user(user_t *user, const char *reason, long duration, const char *setby);
 E void kline_delete(kline_t *k);
+E void kline_set_settime(kline_t *k, time_t settime);
 E kline_t *kline_find(const char *user, const char *host);
 E kline_t *kline_find_num(unsigned long number);
 E kline_t *kline_find_user(user_t *u);
@@ -415,6 +462,7 @@ E zline_t *zline_add_with_id(const char *host, const char *reason, long duration
 E zline_t *zline_add(const char *host, const char *reason, long duration, const char *setby);
 E zline_t *zline_add_user(user_t *user, const char *reason, long duration, const char *setby);
 E void zline_delete(zline_t *z);
+E void zline_set_settime(zline_t *z, time_t settime);
 E zline_t *zline_find(const char *host);
 E zline_t *zline_find_num(unsigned long number);
 E zline_t *zline_find_user(user_t *u);
@@ -424,6 +472,7 @@ E mowgli_list_t xlnlist;
 
 E xline_t *xline_add(const char *realname, const char *reason, long duration, const char *setby);
 E void xline_delete(const char *realname);
+E void xline_set_settime(xline_t *x, time_t settime);
 E xline_t *xline_find(const char *realname);
 E xline_t *xline_find_num(unsigned int number);
 E xline_t *xline_find_user(user_t *u);
@@ -433,6 +482,7 @@ E mowgli_list_t qlnlist;
 
 E qline_t *qline_add(const char *mask, const char *reason, long duration, const char *setby);
 E void qline_delete(const char *mask);
+E void qline_set_settime(qline_t *q, time_t settime);
 E qline_t *qline_find(const char *mask);
 E qline_t *qline_find_match(const char *mask);
 E qline_t *qline_find_num(unsigned int number);
@@ -453,6 +503,9 @@ E void myuser_delete(myuser_t *mu);
 //inline myuser_t *myuser_find(const char *name);
 E void myuser_rename(myuser_t *mu, const char *name);
 E void myuser_set_email(myuser_t *mu, const char *newemail);
+E mowgli_list_t *myuser_find_by_email(stringref email_canonical);
+E void myuser_email_index_add(myuser_t *mu);
+E void myuser_email_index_delete(myuser_t *mu);
 E myuser_t *myuser_find_ext(const char *name);
 E void myuser_notice(const char *from, myuser_t *target, const char *fmt, ...) PRINTFLIKE(3, 4);
 
@@ -486,6 +539,7 @@ E const char *mychan_get_sts_mlock(mychan_t *mc);
 
 E chanacs_t *chanacs_add(mychan_t *mychan, myentity_t *myuser, unsigned int level, time_t ts, myentity_t *setter);
 E chanacs_t *chanacs_add_host(mychan_t *mychan, const char *host, unsigned int level, time_t ts, myentity_t *setter);
+E void chanacs_invalidate(mychan_t *mychan);
 
 E chanacs_t *chanacs_find(mychan_t *mychan, myentity_t *myuser, unsigned int level);
 E unsigned int chanacs_entity_flags(mychan_t *mychan, myentity_t *myuser);
@@ -9,8 +9,13 @@
 #ifndef AUTH_H
 #define AUTH_H
 
+typedef struct verify_password_req_ verify_password_req_t;
+typedef void (*verify_password_cb_t)(myuser_t *mu, bool verified, void *priv);
+
 E void set_password(myuser_t *mu, const char *newpassword);
 E bool verify_password(myuser_t *mu, const char *password);
+E verify_password_req_t *verify_password_async(myuser_t *mu, const char *password, verify_password_cb_t cb, void *priv);
+E void verify_password_cancel(verify_password_req_t *req);
 
 E bool auth_module_loaded;
 E bool (*auth_user_custom)(myuser_t *mu, const char *password);
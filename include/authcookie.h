@@ -15,7 +15,8 @@ struct authcookie_ {
 	char *ticket;
 	myuser_t *myuser;
 	time_t expire;
-	mowgli_node_t node;
+	mowgli_node_t node;	/* in authcookie_list */
+	mowgli_node_t unode;	/* in myuser->authcookies */
 };
 
 E void authcookie_init(void);
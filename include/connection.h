@@ -37,7 +37,9 @@ struct connection_
 	char name[HOSTLEN];
 	char hbuf[BUFSIZE + 1];
 
-	mowgli_list_t recvq;
+	char *recvq;		/* contiguous receive buffer, see recvq_put() */
+	size_t recvq_start;	/* first unconsumed byte */
+	size_t recvq_end;	/* one past the last received byte */
 	mowgli_list_t sendq;
 
 	int fd;
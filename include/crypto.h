@@ -17,9 +17,15 @@ typedef struct {
 	bool (*verify)(const char *password, const char *parameters);
 	bool (*recrypt)(const char *parameters);
 
+	/* verify may run on a worker thread; see crypt_verify_password_async() */
+	bool threadsafe;
+
 	mowgli_node_t node;
 } crypt_impl_t;
 
+typedef struct crypt_verify_req_ crypt_verify_req_t;
+typedef void (*crypt_verify_cb_t)(const crypt_impl_t *ci, void *priv);
+
 E const crypt_impl_t *crypt_get_default_provider(void);
 E void crypt_register(crypt_impl_t *impl);
 E void crypt_unregister(crypt_impl_t *impl);
@@ -28,6 +34,10 @@ E const char *gen_salt(void);
 E const char *crypt_string(const char *password, const char *parameters);
 
 E const crypt_impl_t *crypt_verify_password(const char *password, const char *parameters);
+E crypt_verify_req_t *crypt_verify_password_async(const char *password, const char *parameters, crypt_verify_cb_t cb, void *priv);
+E void crypt_verify_cancel(crypt_verify_req_t *req);
+E void crypt_workers_shutdown(void);
+E bool crypt_in_worker(void);
 
 #endif
 
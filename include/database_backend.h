@@ -53,13 +53,20 @@ struct database_handle_ {
 
 typedef struct {
 	database_handle_t *(*db_open)(const char *filename, database_transaction_t txn);
-	void (*db_close)(database_handle_t *db);
+	bool (*db_close)(database_handle_t *db);	/* false if a write was not committed */
 	void (*db_parse)(database_handle_t *db);
+
+	/* optional: handles whose rows are buffered and later appended to
+	 * a write handle in one go, so they can be filled on other threads */
+	database_handle_t *(*db_open_segment)(database_handle_t *parent);
+	void (*db_append_segment)(database_handle_t *parent, database_handle_t *segment);
 } database_module_t;
 
 E database_handle_t *db_open(const char *filename, database_transaction_t txn);
-E void db_close(database_handle_t *db);
+E bool db_close(database_handle_t *db);
 E void db_parse(database_handle_t *db);
+E database_handle_t *db_open_segment(database_handle_t *parent);
+E void db_append_segment(database_handle_t *parent, database_handle_t *segment);
 
 E bool db_read_next_row(database_handle_t *db);
 
@@ -86,6 +93,38 @@ E bool db_commit_row(database_handle_t *db);
 
 typedef void (*database_handler_f)(database_handle_t *db, const char *type);
 
+/* mutations reported to the journal, if one is loaded */
+typedef enum {
+	DB_JOURNAL_MYUSER,		/* account created or changed */
+	DB_JOURNAL_MYUSER_DROP,
+	DB_JOURNAL_MYUSER_RENAME,	/* arg is the old name */
+	DB_JOURNAL_MYNICK,
+	DB_JOURNAL_MYNICK_DROP,
+	DB_JOURNAL_MYCHAN,
+	DB_JOURNAL_MYCHAN_DROP,
+	DB_JOURNAL_CHANACS,
+	DB_JOURNAL_CHANACS_DROP,
+	DB_JOURNAL_METADATA,		/* arg is the key */
+	DB_JOURNAL_METADATA_DROP	/* arg is the key */
+} db_journal_op_t;
+
+/* persistent objects metadata can hang off */
+typedef enum {
+	DB_OBJECT_NONE,
+	DB_OBJECT_MYUSER,
+	DB_OBJECT_MYCHAN,
+	DB_OBJECT_CHANACS
+} db_object_type_t;
+
+E void (*db_journal)(db_journal_op_t op, void *object, const char *arg);
+E db_object_type_t db_object_type(void *object);
+
+static inline void db_journal_record(db_journal_op_t op, void *object, const char *arg)
+{
+	if (db_journal != NULL)
+		db_journal(op, object, arg);
+}
+
 E void db_register_type_handler(const char *type, database_handler_f fun);
 E void db_unregister_type_handler(const char *type);
 E void db_process(database_handle_t *db, const char *type);
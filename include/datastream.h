@@ -19,6 +19,7 @@ E int recvq_length(connection_t *cptr);
 E void recvq_put(connection_t *cptr);
 E int recvq_get(connection_t *cptr, char *buf, size_t len);
 E int recvq_getline(connection_t *cptr, char *buf, size_t len);
+E int recvq_getline_ref(connection_t *cptr, char **line, size_t len);
 
 E void sendqrecvq_free(connection_t *cptr);
 
@@ -26,7 +26,11 @@ E unsigned int flags_find_slot(void);
 
 E void flags_make_bitmasks(const char *string, unsigned int *addflags, unsigned int *removeflags);
 E unsigned int flags_to_bitmask(const char *, unsigned int flags);
+/* room for any flag string, for the _r variants below */
+#define FLAGS_BUFLEN 258
+
 E char *bitmask_to_flags(unsigned int);
+E char *bitmask_to_flags_r(unsigned int, char *);
 E char *bitmask_to_flags2(unsigned int, unsigned int);
 E unsigned int allow_flags(mychan_t *mc, unsigned int flags);
 E void update_chanacs_flags(void);
@@ -41,6 +45,7 @@ E gflags_t mc_flags[];
 E gflags_t soper_flags[];
 
 E char *gflags_tostr(gflags_t *gflags, unsigned int flags);
+E char *gflags_tostr_r(gflags_t *gflags, unsigned int flags, char *buf);
 E bool gflags_fromstr(gflags_t *gflags, const char *f, unsigned int *res);
 
 E unsigned int xflag_lookup(const char *name);
@@ -108,6 +108,8 @@ struct ConfOption
 
   unsigned int uplink_sendq_limit;
 
+  unsigned int crypt_workers;	/* password verification threads */
+
   char *language;		/* default language */
 
   mowgli_list_t exempts;		/* List of masks never to automatically kline */
@@ -23,6 +23,22 @@ E void hook_add_hook(const char *, hookfn_t);
 E void hook_add_hook_first(const char *, hookfn_t);
 E void hook_call_event(const char *, void *);
 
+/*
+ * Handle based interface.  hook_t objects are never freed once created,
+ * so a handle from hook_add_event() stays valid for the process lifetime.
+ * The hooks listed in hooktypes.in have handles resolved at startup.
+ */
+E void hook_del_hook_handle(hook_t *, hookfn_t);
+E void hook_add_hook_handle(hook_t *, hookfn_t);
+E void hook_add_hook_first_handle(hook_t *, hookfn_t);
+E void hook_dispatch(hook_t *, void *);
+
+static inline void hook_call_handle(hook_t *hook, void *dptr)
+{
+	if (hook->hooks.head != NULL)
+		hook_dispatch(hook, dptr);
+}
+
 E void hook_stop(void);
 E void hook_continue(void *newptr);
 
@@ -13,6 +13,8 @@
 /* cidr.c */
 E int match_ips(const char *mask, const char *address);
 E int match_cidr(const char *mask, const char *address);
+E int parse_cidr(const char *mask, unsigned char *addr, unsigned int *bits);
+E int parse_ip(const char *address, unsigned char *addr);
 
 /* match.c */
 #define MATCH_RFC1459   0
@@ -65,6 +67,7 @@ typedef struct atheme_regex_ atheme_regex_t;
 E atheme_regex_t *regex_create(char *pattern, int flags);
 E char *regex_extract(char *pattern, char **pend, int *pflags);
 E bool regex_match(atheme_regex_t *preg, char *string);
+E bool regex_match_len(atheme_regex_t *preg, const char *string, size_t len);
 E bool regex_destroy(atheme_regex_t *preg);
 
 #endif
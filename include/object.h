@@ -18,11 +18,43 @@ typedef struct metadata_ metadata_t;
 
 typedef void (*destructor_t)(void *);
 
+/*
+ * Metadata and privatedata are kept in an object_map_t: a sorted array
+ * while there are at most OBJECT_MAP_MAX entries, a patricia tree after.
+ * Use METADATA_FOREACH() to walk an object's metadata.
+ */
+#define OBJECT_MAP_MAX	16
+
+typedef struct {
+	const char *key;
+	void *data;
+} object_map_item_t;
+
+typedef struct {
+	unsigned int count;
+	unsigned int alloc;
+	bool casefold;
+	bool owns_keys;
+	mowgli_patricia_t *tree;	/* once the map outgrew the array */
+	object_map_item_t items[];
+} object_map_t;
+
+typedef struct {
+	unsigned int i;
+	void *cur;
+	mowgli_patricia_iteration_state_t tstate;
+} object_map_iteration_state_t;
+
+/* a metadata name resolved by metadata_key_intern(); 0 is never a key */
+typedef unsigned int metadata_key_t;
+
 typedef struct {
 	int refcount;
 	destructor_t destructor;
-	mowgli_patricia_t *metadata;
-	mowgli_patricia_t *privatedata;
+	object_map_t *metadata;
+	object_map_t *privatedata;
+	metadata_t **mdslots;	/* entries of metadata by interned key */
+	unsigned int nmdslots;
 #ifdef OBJECT_DEBUG
 	mowgli_node_t dnode;
 #endif
@@ -40,10 +72,23 @@ E metadata_t *metadata_add(void *target, const char *name, const char *value);
 E void metadata_delete(void *target, const char *name);
 E metadata_t *metadata_find(void *target, const char *name);
 E void metadata_delete_all(void *target);
+E metadata_key_t metadata_key_intern(const char *name);
+E metadata_t *metadata_find_key(void *target, metadata_key_t key);
 
 E void *privatedata_get(void *target, const char *key);
 E void privatedata_set(void *target, const char *key, void *data);
 
+E void object_map_foreach_start(object_map_t *map, object_map_iteration_state_t *state);
+E void *object_map_foreach_cur(object_map_t *map, object_map_iteration_state_t *state);
+E void object_map_foreach_next(object_map_t *map, object_map_iteration_state_t *state);
+E void object_map_report(void);
+
+/* entries may be deleted while iterating, but not added */
+#define METADATA_FOREACH(md, state, target) \
+	for (object_map_foreach_start(object(target)->metadata, (state)); \
+	     ((md) = object_map_foreach_cur(object(target)->metadata, (state))) != NULL; \
+	     object_map_foreach_next(object(target)->metadata, (state)))
+
 #ifdef OBJECT_DEBUG
 E mowgli_list_t object_list;
 #endif
@@ -32,6 +32,10 @@ struct sasl_session_ {
   char *host;
   char *ip;
   bool tls;
+
+  mowgli_node_t node;		/* in saslserv's sessions list */
+  time_t expires;		/* dropped if it makes no progress by then */
+  unsigned int expiry_index;	/* position in saslserv's expiry heap */
 };
 
 struct sasl_message_ {
@@ -59,14 +63,17 @@ typedef struct {
 typedef struct {
 	void (*mech_register) (struct sasl_mechanism_ *mech);
 	void (*mech_unregister) (struct sasl_mechanism_ *mech);
+	void (*mech_step_done) (struct sasl_session_ *sptr, int result);
 } sasl_mech_register_func_t;
 
 #define ASASL_FAIL 0 /* client supplied invalid credentials / screwed up their formatting */
 #define ASASL_MORE 1 /* everything looks good so far, but we're not done yet */
 #define ASASL_DONE 2 /* client successfully authenticated */
+#define ASASL_WAIT 3 /* result will be passed to mech_step_done() later */
 
-#define ASASL_MARKED_FOR_DELETION   1 /* see delete_stale() in saslserv/main.c */
+#define ASASL_MARKED_FOR_DELETION   1 /* unused; sessions now expire, see delete_stale() in saslserv/main.c */
 #define ASASL_NEED_LOG              2 /* user auth success needs to be logged still */
+#define ASASL_WAITING               4 /* mechanism is waiting on an asynchronous result */
 
 #endif
 
@@ -63,6 +63,8 @@ struct logfile_ {
 
 	log_write_func_t write_func;
 	log_type_t log_type;
+
+	struct logbuf_ *log_buf;	/* NULL unless buffered, see logfile_set_buffer() */
 };
 
 E char *log_path; /* contains path to default log. */
@@ -71,6 +73,9 @@ E int log_force;
 E logfile_t *logfile_new(const char *log_path_, unsigned int log_mask);
 E void logfile_register(logfile_t *lf);
 E void logfile_unregister(logfile_t *lf);
+E bool logfile_set_buffer(logfile_t *lf, size_t size, unsigned int flush_interval, bool threaded);
+E void log_flush(void);
+E void log_flush_crash(void);
 
 /* general */
 #define LG_NONE         0x00000001      /* don't log                */
@@ -115,6 +120,14 @@ E bool log_debug_enabled(void);
 E void log_master_set_mask(unsigned int mask);
 E logfile_t *logfile_find_mask(unsigned int log_mask);
 E void slog(unsigned int level, const char *fmt, ...) PRINTFLIKE(2, 3);
+
+/* levels some log stream currently wants, maintained by logger.c */
+E unsigned int log_enabled_mask;
+#define log_level_enabled(level) (((level) & log_enabled_mask) != 0 || log_force)
+
+/* skip evaluating the arguments of log lines nobody would see */
+#define slog(level, ...) (log_level_enabled(level) ? slog((level), __VA_ARGS__) : (void) 0)
+
 E void logcommand(sourceinfo_t *si, int level, const char *fmt, ...) PRINTFLIKE(3, 4);
 E void logcommand_user(service_t *svs, user_t *source, int level, const char *fmt, ...) PRINTFLIKE(4, 5);
 E void logcommand_external(service_t *svs, const char *type, connection_t *source, const char *sourcedesc, myuser_t *login, int level, const char *fmt, ...) PRINTFLIKE(7, 8);
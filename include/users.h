@@ -38,8 +38,29 @@ struct user_
 	mowgli_node_t snode; /* for server_t.userlist */
 
 	char *certfp; /* client certificate fingerprint */
+
+	unsigned int mask_gen; /* bumped by user_mask_changed() */
+	struct chanacs_cache_ *chanacs_cache;
+	struct user_masks_ *masks; /* see user_get_mask() */
 };
 
+#define USER_MASKLEN (NICKLEN+USERLEN+HOSTLEN)
+
+/* nick!user@host forms of a user, cached until the next user_mask_changed() */
+typedef enum {
+	USER_MASK_HOST = 0,	/* real host */
+	USER_MASK_VHOST,	/* visible host */
+	USER_MASK_CHOST,	/* cloaked host */
+	USER_MASK_IP,		/* ip, or nick!user@ if unknown */
+	USER_MASK_COUNT
+} user_mask_type_t;
+
+typedef struct user_masks_ {
+	unsigned int gen;
+	size_t nicklen;		/* user@host starts at mask + nicklen + 1 */
+	char mask[USER_MASK_COUNT][USER_MASKLEN];
+} user_masks_t;
+
 #define FLOOD_MSGS_FACTOR 256
 
 #define UF_AWAY        0x00000002
@@ -90,6 +111,9 @@ E void user_changeuid(user_t *u, const char *uid);
 E bool user_changenick(user_t *u, const char *nick, time_t ts);
 E void user_mode(user_t *user, const char *modes);
 E void user_sethost(user_t *source, user_t *target, const char *host);
+E void user_mask_changed(user_t *u);
+E const char *user_get_mask(user_t *u, user_mask_type_t type);
+E const char *user_get_userhost(user_t *u, user_mask_type_t type);
 E const char *user_get_umodestr(user_t *u);
 E bool user_is_channel_banned(user_t *u, char ban_type);
 
@@ -32,6 +32,7 @@ mowgli_patricia_t *nicklist;
 mowgli_patricia_t *oldnameslist;
 mowgli_patricia_t *mclist;
 mowgli_patricia_t *certfplist;
+static mowgli_patricia_t *mulist_by_email;	/* lists of accounts by canonical email */
 
 mowgli_heap_t *myuser_heap;   /* HEAP_USER */
 mowgli_heap_t *mynick_heap;   /* HEAP_USER */
@@ -129,6 +130,7 @@ myuser_t *myuser_add_id(const char *id, const char *name, const char *pass, cons
 	entity(mu)->name = strshare_get(name);
 	mu->email = strshare_get(email);
 	mu->email_canonical = canonicalize_email(email);
+	myuser_email_index_add(mu);
 	if (id)
 	{
 		if (myentity_find_uid(id) == NULL)
@@ -172,6 +174,8 @@ myuser_t *myuser_add_id(const char *id, const char *name, const char *pass, cons
 
 	cnt.myuser++;
 
+	db_journal_record(DB_JOURNAL_MYUSER, mu, NULL);
+
 	return mu;
 }
 
@@ -205,6 +209,8 @@ void myuser_delete(myuser_t *mu)
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "myuser_delete(): %s", entity(mu)->name);
 
+	db_journal_record(DB_JOURNAL_MYUSER_DROP, mu, NULL);
+
 	myuser_name_remember(entity(mu)->name, mu);
 
 	hook_call_myuser_delete(mu);
@@ -326,6 +332,7 @@ void myuser_delete(myuser_t *mu)
 	/* entity(mu)->name is the index for this dtree */
 	myentity_del(entity(mu));
 
+	myuser_email_index_delete(mu);
 	strshare_unref(mu->email);
 	strshare_unref(mu->email_canonical);
 	strshare_unref(entity(mu)->name);
@@ -390,6 +397,8 @@ void myuser_rename(myuser_t *mu, const char *name)
 		}
 	}
 
+	db_journal_record(DB_JOURNAL_MYUSER_RENAME, mu, nb);
+
 	data.mu = mu;
 	data.oldname = nb;
 	hook_call_user_rename(&data);
@@ -415,11 +424,81 @@ void myuser_set_email(myuser_t *mu, const char *newemail)
 	return_if_fail(mu != NULL);
 	return_if_fail(newemail != NULL);
 
+	myuser_email_index_delete(mu);
 	strshare_unref(mu->email);
 	strshare_unref(mu->email_canonical);
 
 	mu->email = strshare_get(newemail);
 	mu->email_canonical = canonicalize_email(newemail);
+	myuser_email_index_add(mu);
+
+	db_journal_record(DB_JOURNAL_MYUSER, mu, NULL);
+}
+
+/*
+ * myuser_find_by_email(stringref email_canonical)
+ *
+ * Looks up the accounts registered to a canonical email address.
+ *
+ * Inputs:
+ *      - canonical email address, as returned by canonicalize_email()
+ *
+ * Outputs:
+ *      - list of myuser_t registered to it, or NULL if there are none;
+ *        the list must not be modified
+ *
+ * Side Effects:
+ *      - none
+ */
+mowgli_list_t *myuser_find_by_email(stringref email_canonical)
+{
+	if (mulist_by_email == NULL || email_canonical == NULL || *email_canonical == '\0')
+		return NULL;
+
+	return mowgli_patricia_retrieve(mulist_by_email, email_canonical);
+}
+
+/*
+ * myuser_email_index_add(myuser_t *mu)
+ * myuser_email_index_delete(myuser_t *mu)
+ *
+ * Keep the index used by myuser_find_by_email() in step with
+ * mu->email_canonical; anything changing it must delete the account
+ * from the index first and add it back afterwards.
+ */
+void myuser_email_index_add(myuser_t *mu)
+{
+	mowgli_list_t *l;
+
+	if (mu->email_canonical == NULL || *mu->email_canonical == '\0')
+		return;
+
+	if (mulist_by_email == NULL)
+		mulist_by_email = mowgli_patricia_create(noopcanon);
+
+	if ((l = mowgli_patricia_retrieve(mulist_by_email, mu->email_canonical)) == NULL)
+	{
+		l = mowgli_list_create();
+		mowgli_patricia_add(mulist_by_email, mu->email_canonical, l);
+	}
+
+	mowgli_node_add(mu, &mu->email_node, l);
+}
+
+void myuser_email_index_delete(myuser_t *mu)
+{
+	mowgli_list_t *l;
+
+	if ((l = myuser_find_by_email(mu->email_canonical)) == NULL)
+		return;
+
+	mowgli_node_delete(&mu->email_node, l);
+
+	if (MOWGLI_LIST_LENGTH(l) == 0)
+	{
+		mowgli_patricia_delete(mulist_by_email, mu->email_canonical);
+		mowgli_list_free(l);
+	}
 }
 
 /*
@@ -521,10 +600,7 @@ bool
 myuser_access_verify(user_t *u, myuser_t *mu)
 {
 	mowgli_node_t *n;
-	char buf[USERLEN+HOSTLEN];
-	char buf2[USERLEN+HOSTLEN];
-	char buf3[USERLEN+HOSTLEN];
-	char buf4[USERLEN+HOSTLEN];
+	const char *buf, *buf2, *buf3, *buf4;
 
 	return_val_if_fail(u != NULL, false);
 	return_val_if_fail(mu != NULL, false);
@@ -535,10 +611,10 @@ myuser_access_verify(user_t *u, myuser_t *mu)
 	if (metadata_find(mu, "private:freeze:freezer"))
 		return false;
 
-	snprintf(buf, sizeof buf, "%s@%s", u->user, u->vhost);
-	snprintf(buf2, sizeof buf2, "%s@%s", u->user, u->host);
-	snprintf(buf3, sizeof buf3, "%s@%s", u->user, u->ip);
-	snprintf(buf4, sizeof buf4, "%s@%s", u->user, u->chost);
+	buf = user_get_userhost(u, USER_MASK_VHOST);
+	buf2 = user_get_userhost(u, USER_MASK_HOST);
+	buf3 = user_get_userhost(u, USER_MASK_IP);
+	buf4 = user_get_userhost(u, USER_MASK_CHOST);
 
 	MOWGLI_ITER_FOREACH(n, mu->access_list.head)
 	{
@@ -700,6 +776,8 @@ mynick_t *mynick_add(myuser_t *mu, const char *name)
 
 	cnt.mynick++;
 
+	db_journal_record(DB_JOURNAL_MYNICK, mn, NULL);
+
 	return mn;
 }
 
@@ -724,6 +802,8 @@ void mynick_delete(mynick_t *mn)
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "mynick_delete(): %s", mn->nick);
 
+	db_journal_record(DB_JOURNAL_MYNICK_DROP, mn, NULL);
+
 	myuser_name_remember(mn->nick, mn->owner);
 
 	mowgli_patricia_delete(nicklist, mn->nick);
@@ -867,7 +947,7 @@ void myuser_name_restore(const char *name, myuser_t *mu)
 {
 	myuser_name_t *mun;
 	metadata_t *md, *md2;
-	mowgli_patricia_iteration_state_t state;
+	object_map_iteration_state_t state;
 	char *copy;
 
 	mun = myuser_name_find(name);
@@ -892,7 +972,7 @@ void myuser_name_restore(const char *name, myuser_t *mu)
 
 	if (object(mun)->metadata)
 	{
-		MOWGLI_PATRICIA_FOREACH(md, &state, object(mun)->metadata)
+		METADATA_FOREACH(md, &state, mun)
 		{
 			/* prefer current metadata to saved */
 			if (!metadata_find(mu, md->name))
@@ -972,6 +1052,8 @@ static void mychan_delete(mychan_t *mc)
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "mychan_delete(): %s", mc->name);
 
+	db_journal_record(DB_JOURNAL_MYCHAN_DROP, mc, NULL);
+
 	if (mc->chan != NULL)
 		mc->chan->mychan = NULL;
 
@@ -979,6 +1061,8 @@ static void mychan_delete(mychan_t *mc)
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, mc->chanacs.head)
 		object_unref(n->data);
 
+	free(mc->chanacs_idx);
+
 	metadata_delete_all(mc);
 
 	mowgli_patricia_delete(mclist, mc->name);
@@ -1006,6 +1090,7 @@ mychan_t *mychan_add(char *name)
 	mc->name = strshare_get(name);
 	mc->registered = CURRTIME;
 	mc->chan = channel_find(name);
+	chanacs_invalidate(mc);
 
 	if (mc->chan != NULL)
 		mc->chan->mychan = mc;
@@ -1014,6 +1099,8 @@ mychan_t *mychan_add(char *name)
 
 	cnt.mychan++;
 
+	db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
+
 	return mc;
 }
 
@@ -1345,6 +1432,143 @@ const char *mychan_get_sts_mlock(mychan_t *mc)
  * C H A N A C S *
  *****************/
 
+/*
+ * Each mychan keeps its entity entries in a small hash table keyed on the
+ * entity pointer, so literal lookups do not have to walk the whole access
+ * list.  Hostmask entries and entries for entities that may match other
+ * entities (groups, exttargets) are additionally kept on their own lists,
+ * which are the only ones that need to be scanned for indirect matches.
+ * All of these preserve the order of mychan->chanacs.
+ */
+#define CHANACS_IDX_MINSIZE	8
+
+/*
+ * Hostmask matches are remembered per user in a small direct-mapped cache,
+ * keyed on the mychan and validated against the channel's access list
+ * generation and the user's mask generation.  Generations are drawn from a
+ * single counter so a reused mychan_t never inherits stale entries.
+ */
+#define CHANACS_CACHE_SIZE	8
+
+struct chanacs_cache_
+{
+	mychan_t *mychan;
+	unsigned int chanacs_gen;
+	unsigned int mask_gen;
+	unsigned int flags;
+};
+
+static unsigned int chanacs_generation;
+
+static inline unsigned int chanacs_idx_hash(const myentity_t *mt, unsigned int size)
+{
+	uintptr_t p = (uintptr_t) mt;
+
+	return (unsigned int) ((p >> 4) ^ (p >> 12)) & (size - 1);
+}
+
+static void chanacs_idx_insert(mychan_t *mc, chanacs_t *ca)
+{
+	chanacs_t **pp;
+
+	pp = &mc->chanacs_idx[chanacs_idx_hash(ca->entity, mc->chanacs_idx_size)];
+	while (*pp != NULL)
+		pp = &(*pp)->inext;
+
+	ca->inext = NULL;
+	*pp = ca;
+}
+
+static void chanacs_idx_rebuild(mychan_t *mc, unsigned int size)
+{
+	mowgli_node_t *n;
+
+	free(mc->chanacs_idx);
+	mc->chanacs_idx = scalloc(sizeof(chanacs_t *), size);
+	mc->chanacs_idx_size = size;
+
+	MOWGLI_ITER_FOREACH(n, mc->chanacs.head)
+	{
+		chanacs_t *ca = n->data;
+
+		if (ca->entity != NULL)
+			chanacs_idx_insert(mc, ca);
+	}
+}
+
+/* called after ca has been added to ca->mychan->chanacs */
+static void chanacs_index_add(chanacs_t *ca)
+{
+	mychan_t *mc = ca->mychan;
+
+	chanacs_invalidate(mc);
+
+	if (ca->entity == NULL)
+	{
+		mowgli_node_add(ca, &ca->inode, &mc->chanacs_hosts);
+		return;
+	}
+
+	if (!isuser(ca->entity))
+		mowgli_node_add(ca, &ca->inode, &mc->chanacs_indirect);
+
+	if (++mc->chanacs_idx_count > mc->chanacs_idx_size)
+		chanacs_idx_rebuild(mc, mc->chanacs_idx_size != 0 ? mc->chanacs_idx_size * 2 : CHANACS_IDX_MINSIZE);
+	else
+		chanacs_idx_insert(mc, ca);
+}
+
+static void chanacs_index_delete(chanacs_t *ca)
+{
+	mychan_t *mc = ca->mychan;
+	chanacs_t **pp;
+
+	chanacs_invalidate(mc);
+
+	if (ca->entity == NULL)
+	{
+		mowgli_node_delete(&ca->inode, &mc->chanacs_hosts);
+		return;
+	}
+
+	if (!isuser(ca->entity))
+		mowgli_node_delete(&ca->inode, &mc->chanacs_indirect);
+
+	for (pp = &mc->chanacs_idx[chanacs_idx_hash(ca->entity, mc->chanacs_idx_size)]; *pp != NULL; pp = &(*pp)->inext)
+	{
+		if (*pp == ca)
+		{
+			*pp = ca->inext;
+			break;
+		}
+	}
+
+	mc->chanacs_idx_count--;
+}
+
+/*
+ * chanacs_invalidate(mychan_t *mychan)
+ *
+ * Notes that the access list of a channel changed.  The chanacs functions
+ * call this themselves; code that modifies a chanacs_t's level directly
+ * must call it too.
+ *
+ * Inputs:
+ *       - channel whose access list changed
+ *
+ * Outputs:
+ *       - nothing
+ *
+ * Side Effects:
+ *       - cached access flags for the channel are invalidated
+ */
+void chanacs_invalidate(mychan_t *mychan)
+{
+	return_if_fail(mychan != NULL);
+
+	mychan->chanacs_gen = ++chanacs_generation;
+}
+
 /* private destructor for chanacs_t */
 static void chanacs_delete(chanacs_t *ca)
 {
@@ -1355,6 +1579,8 @@ static void chanacs_delete(chanacs_t *ca)
 		slog(LG_DEBUG, "chanacs_delete(): %s -> %s [%s]", ca->mychan->name,
 			ca->entity != NULL ? entity(ca->entity)->name : ca->host,
 			ca->entity != NULL ? "entity" : "hostmask");
+	db_journal_record(DB_JOURNAL_CHANACS_DROP, ca, NULL);
+	chanacs_index_delete(ca);
 	mowgli_node_delete(&ca->cnode, &ca->mychan->chanacs);
 
 	if (ca->entity != NULL)
@@ -1424,9 +1650,12 @@ chanacs_t *chanacs_add(mychan_t *mychan, myentity_t *mt, unsigned int level, tim
 
 	mowgli_node_add(ca, &ca->cnode, &mychan->chanacs);
 	mowgli_node_add(ca, &ca->unode, &mt->chanacs);
+	chanacs_index_add(ca);
 
 	cnt.chanacs++;
 
+	db_journal_record(DB_JOURNAL_CHANACS, ca, NULL);
+
 	return ca;
 }
 
@@ -1477,9 +1706,12 @@ chanacs_t *chanacs_add_host(mychan_t *mychan, const char *host, unsigned int lev
 		ca->setter_uid[0] = '\0';
 
 	mowgli_node_add(ca, &ca->cnode, &mychan->chanacs);
+	chanacs_index_add(ca);
 
 	cnt.chanacs++;
 
+	db_journal_record(DB_JOURNAL_CHANACS, ca, NULL);
+
 	return ca;
 }
 
@@ -1493,15 +1725,13 @@ chanacs_t *chanacs_find(mychan_t *mychan, myentity_t *mt, unsigned int level)
 	if ((ca = chanacs_find_literal(mychan, mt, level)) != NULL)
 		return ca;
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	/* entries for plain accounts only ever match themselves */
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_indirect.head)
 	{
 		entity_chanacs_validation_vtable_t *vt;
 
 		ca = (chanacs_t *)n->data;
 
-		if (ca->entity == NULL)
-			continue;
-
 		vt = myentity_get_chanacs_validator(ca->entity);
 		if (level != 0x0)
 		{
@@ -1523,22 +1753,27 @@ unsigned int chanacs_entity_flags(mychan_t *mychan, myentity_t *mt)
 
 	return_val_if_fail(mychan != NULL && mt != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	if (mychan->chanacs_idx != NULL)
+	{
+		for (ca = mychan->chanacs_idx[chanacs_idx_hash(mt, mychan->chanacs_idx_size)]; ca != NULL; ca = ca->inext)
+		{
+			if (ca->entity == mt)
+				result |= ca->level;
+		}
+	}
+
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_indirect.head)
 	{
 		entity_chanacs_validation_vtable_t *vt;
 
 		ca = (chanacs_t *)n->data;
 
-		if (ca->entity == NULL)
-			continue;
 		if (ca->entity == mt)
+			continue;
+
+		vt = myentity_get_chanacs_validator(ca->entity);
+		if (vt->match_entity(ca, mt) != NULL)
 			result |= ca->level;
-		else
-		{
-			vt = myentity_get_chanacs_validator(ca->entity);
-			if (vt->match_entity(ca, mt) != NULL)
-				result |= ca->level;
-		}
 	}
 
 	slog(LG_DEBUG, "chanacs_entity_flags(%s, %s): return %s", mychan->name, mt->name, bitmask_to_flags(result));
@@ -1548,15 +1783,15 @@ unsigned int chanacs_entity_flags(mychan_t *mychan, myentity_t *mt)
 
 chanacs_t *chanacs_find_literal(mychan_t *mychan, myentity_t *mt, unsigned int level)
 {
-	mowgli_node_t *n;
 	chanacs_t *ca;
 
 	return_val_if_fail(mychan != NULL && mt != NULL, NULL);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
-	{
-		ca = (chanacs_t *)n->data;
+	if (mychan->chanacs_idx == NULL)
+		return NULL;
 
+	for (ca = mychan->chanacs_idx[chanacs_idx_hash(mt, mychan->chanacs_idx_size)]; ca != NULL; ca = ca->inext)
+	{
 		if (level != 0x0)
 		{
 			if (ca->entity == mt && ((ca->level & level) == level))
@@ -1576,16 +1811,16 @@ chanacs_t *chanacs_find_host(mychan_t *mychan, const char *host, unsigned int le
 
 	return_val_if_fail(mychan != NULL && host != NULL, NULL);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_hosts.head)
 	{
 		ca = (chanacs_t *)n->data;
 
 		if (level != 0x0)
 		{
-			if ((ca->entity == NULL) && (!match(ca->host, host)) && ((ca->level & level) == level))
+			if (!match(ca->host, host) && (ca->level & level) == level)
 				return ca;
 		}
-		else if ((ca->entity == NULL) && (!match(ca->host, host)))
+		else if (!match(ca->host, host))
 			return ca;
 	}
 
@@ -1600,11 +1835,11 @@ unsigned int chanacs_host_flags(mychan_t *mychan, const char *host)
 
 	return_val_if_fail(mychan != NULL && host != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_hosts.head)
 	{
 		ca = (chanacs_t *)n->data;
 
-		if (ca->entity == NULL && !match(ca->host, host))
+		if (!match(ca->host, host))
 			result |= ca->level;
 	}
 
@@ -1619,16 +1854,16 @@ chanacs_t *chanacs_find_host_literal(mychan_t *mychan, const char *host, unsigne
 	if ((!mychan) || (!host))
 		return NULL;
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_hosts.head)
 	{
 		ca = (chanacs_t *)n->data;
 
 		if (level != 0x0)
 		{
-			if ((ca->entity == NULL) && (!strcasecmp(ca->host, host)) && ((ca->level & level) == level))
+			if (!strcasecmp(ca->host, host) && (ca->level & level) == level)
 				return ca;
 		}
-		else if ((ca->entity == NULL) && (!strcasecmp(ca->host, host)))
+		else if (!strcasecmp(ca->host, host))
 			return ca;
 	}
 
@@ -1642,7 +1877,7 @@ chanacs_t *chanacs_find_host_by_user(mychan_t *mychan, user_t *u, unsigned int l
 
 	return_val_if_fail(mychan != NULL && u != NULL, 0);
 
-	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
+	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs_hosts.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
 	{
 		ca = n->data;
 		if ((ca->level & level) == level)
@@ -1660,7 +1895,7 @@ static unsigned int chanacs_host_flags_by_user(mychan_t *mychan, user_t *u)
 
 	return_val_if_fail(mychan != NULL && u != NULL, 0);
 
-	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
+	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs_hosts.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
 	{
 		ca = n->data;
 		result |= ca->level;
@@ -1671,6 +1906,29 @@ static unsigned int chanacs_host_flags_by_user(mychan_t *mychan, user_t *u)
 	return result;
 }
 
+static unsigned int chanacs_host_flags_by_user_cached(mychan_t *mychan, user_t *u)
+{
+	struct chanacs_cache_ *cc;
+	uintptr_t p = (uintptr_t) mychan;
+
+	if (MOWGLI_LIST_LENGTH(&mychan->chanacs_hosts) == 0)
+		return 0;
+
+	if (u->chanacs_cache == NULL)
+		u->chanacs_cache = scalloc(sizeof(struct chanacs_cache_), CHANACS_CACHE_SIZE);
+
+	cc = &u->chanacs_cache[((p >> 4) ^ (p >> 10)) & (CHANACS_CACHE_SIZE - 1)];
+	if (cc->mychan == mychan && cc->chanacs_gen == mychan->chanacs_gen && cc->mask_gen == u->mask_gen)
+		return cc->flags;
+
+	cc->mychan = mychan;
+	cc->chanacs_gen = mychan->chanacs_gen;
+	cc->mask_gen = u->mask_gen;
+	cc->flags = chanacs_host_flags_by_user(mychan, u);
+
+	return cc->flags;
+}
+
 chanacs_t *chanacs_find_by_mask(mychan_t *mychan, const char *mask, unsigned int level)
 {
 	myentity_t *mt;
@@ -1717,15 +1975,13 @@ static unsigned int chanacs_entity_flags_by_user(mychan_t *mychan, user_t *u)
 	return_val_if_fail(mychan != NULL, 0);
 	return_val_if_fail(u != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	/* plain accounts have no match_user */
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_indirect.head)
 	{
 		chanacs_t *ca = n->data;
 		myentity_t *mt;
 		entity_chanacs_validation_vtable_t *vt;
 
-		if (ca->entity == NULL)
-			continue;
-
 		mt = ca->entity;
 		vt = myentity_get_chanacs_validator(mt);
 
@@ -1757,7 +2013,7 @@ unsigned int chanacs_user_flags(mychan_t *mychan, user_t *u)
 	if (u->myuser != NULL && (u->myuser->flags & MU_WAITAUTH))
 		result &= ~(ca_all & ~CA_AKICK);
 
-	result |= chanacs_host_flags_by_user(mychan, u);
+	result |= chanacs_host_flags_by_user_cached(mychan, u);
 
 	slog(LG_DEBUG, "chanacs_user_flags(%s, %s): return %s", mychan->name, u->nick, bitmask_to_flags(result));
 
@@ -1838,12 +2094,15 @@ bool chanacs_modify(chanacs_t *ca, unsigned int *addflags, unsigned int *removef
 		return false;
 	ca->level = (ca->level | *addflags) & ~*removeflags;
 	ca->tmodified = CURRTIME;
+	chanacs_invalidate(ca->mychan);
 
 	if (setter != NULL)
 		mowgli_strlcpy(ca->setter_uid, entity(setter)->id, IDLEN);
 	else
 		ca->setter_uid[0] = '\0';
 
+	db_journal_record(DB_JOURNAL_CHANACS, ca, NULL);
+
 	return true;
 }
 
@@ -1906,11 +2165,14 @@ bool chanacs_change(mychan_t *mychan, myentity_t *mt, const char *hostmask, unsi
 				return false;
 			ca->level = (ca->level | *addflags) & ~*removeflags;
 			ca->tmodified = CURRTIME;
+			chanacs_invalidate(mychan);
 			if (setter != NULL)
 				mowgli_strlcpy(ca->setter_uid, setter->id, IDLEN);
 			else
 				ca->setter_uid[0] = '\0';
 
+			db_journal_record(DB_JOURNAL_CHANACS, ca, NULL);
+
 			if (ca->level == 0)
 				object_unref(ca);
 		}
@@ -1947,11 +2209,14 @@ bool chanacs_change(mychan_t *mychan, myentity_t *mt, const char *hostmask, unsi
 				return false;
 			ca->level = (ca->level | *addflags) & ~*removeflags;
 			ca->tmodified = CURRTIME;
+			chanacs_invalidate(mychan);
 			if (setter != NULL)
 				mowgli_strlcpy(ca->setter_uid, setter->id, IDLEN);
 			else
 				ca->setter_uid[0] = '\0';
 
+			db_journal_record(DB_JOURNAL_CHANACS, ca, NULL);
+
 			if (ca->level == 0)
 				object_unref(ca);
 		}
@@ -2161,6 +2426,35 @@ void db_check(void)
 	myentity_foreach_t(ENT_USER, check_myuser_cb, NULL);
 }
 
+/*
+ * db_object_type(void *object)
+ *
+ * Tells which kind of persistent object something is, so backends can
+ * name the owner of a metadata entry.
+ *
+ * Inputs:
+ *      - any object_t
+ *
+ * Outputs:
+ *      - the object type, or DB_OBJECT_NONE for transient objects
+ *
+ * Side Effects:
+ *      - none
+ */
+db_object_type_t db_object_type(void *object)
+{
+	destructor_t destructor = object(object)->destructor;
+
+	if (destructor == (destructor_t) myuser_delete)
+		return DB_OBJECT_MYUSER;
+	if (destructor == (destructor_t) mychan_delete)
+		return DB_OBJECT_MYCHAN;
+	if (destructor == (destructor_t) chanacs_delete)
+		return DB_OBJECT_CHANACS;
+
+	return DB_OBJECT_NONE;
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
@@ -392,6 +392,7 @@ int atheme_main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 	db_check();
+	object_map_report();
 
 #ifdef HAVE_GETPID
 	/* write pid */
@@ -455,6 +456,7 @@ int atheme_main(int argc, char *argv[])
 	if (curr_uplink != NULL && curr_uplink->conn != NULL)
 		sendq_flush(curr_uplink->conn);
 	connection_close_all();
+	crypt_workers_shutdown();
 
 	me.connected = false;
 
@@ -462,6 +464,7 @@ int atheme_main(int argc, char *argv[])
 	if (runflags & RF_RESTART)
 	{
 		slog(LG_INFO, "main(): restarting");
+		log_flush();
 
 #ifdef HAVE_EXECVE
 		execv(BINDIR "/xtheme-services", argv);
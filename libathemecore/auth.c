@@ -49,6 +49,38 @@ set_password(myuser_t *const restrict mu, const char *const restrict password)
 		(void) slog(LG_ERROR, "%s: cannot encrypt password for account '%s'; is an encryption-capable "
 		                      "password crypto module loaded?", __func__, entity(mu)->name);
 	}
+
+	db_journal_record(DB_JOURNAL_MYUSER, mu, NULL);
+}
+
+/* moves an account's password hash to the default crypto provider if needed */
+static void
+verify_password_recrypt(myuser_t *const restrict mu, const crypt_impl_t *const restrict ci,
+                        const char *const restrict password)
+{
+	const crypt_impl_t *ci_default;
+	const char *new_salt, *new_hash;
+
+	if ((ci_default = crypt_get_default_provider()) == NULL)
+		// Verification succeeded but we don't have a module that can create new password hashes
+		return;
+
+	if (ci != ci_default)
+		(void) slog(LG_INFO, "%s: transitioning from crypt scheme '%s' to '%s' for account '%s'",
+			             __func__, ci->id, ci_default->id, entity(mu)->name);
+	else if (ci->recrypt != NULL && ci->recrypt(mu->pass))
+		(void) slog(LG_INFO, "%s: re-encrypting password for account '%s'",
+		                     __func__, entity(mu)->name);
+	else
+		// Verification succeeded and re-encrypting not required, nothing more to do
+		return;
+
+	if ((new_salt = ci_default->salt()) == NULL)
+		(void) slog(LG_ERROR, "%s: salt generation failed", __func__);
+	else if ((new_hash = ci_default->crypt(password, new_salt)) == NULL)
+		(void) slog(LG_ERROR, "%s: hash generation failed", __func__);
+	else
+		(void) mowgli_strlcpy(mu->pass, new_hash, PASSLEN);
 }
 
 bool
@@ -62,37 +94,140 @@ verify_password(myuser_t *const restrict mu, const char *const restrict password
 
 	if (mu->flags & MU_CRYPTPASS)
 	{
-		const crypt_impl_t *ci, *ci_default;
-		const char *new_salt, *new_hash;
+		const crypt_impl_t *ci;
 
 		if ((ci = crypt_verify_password(password, mu->pass)) == NULL)
 			// Verification failure
 			return false;
 
-		if ((ci_default = crypt_get_default_provider()) == NULL)
-			// Verification succeeded but we don't have a module that can create new password hashes
-			return true;
-
-		if (ci != ci_default)
-			(void) slog(LG_INFO, "%s: transitioning from crypt scheme '%s' to '%s' for account '%s'",
-				             __func__, ci->id, ci_default->id, entity(mu)->name);
-		else if (ci->recrypt != NULL && ci->recrypt(mu->pass))
-			(void) slog(LG_INFO, "%s: re-encrypting password for account '%s'",
-			                     __func__, entity(mu)->name);
-		else
-			// Verification succeeded and re-encrypting not required, nothing more to do
-			return true;
-
-		if ((new_salt = ci_default->salt()) == NULL)
-			(void) slog(LG_ERROR, "%s: salt generation failed", __func__);
-		else if ((new_hash = ci_default->crypt(password, new_salt)) == NULL)
-			(void) slog(LG_ERROR, "%s: hash generation failed", __func__);
-		else
-			(void) mowgli_strlcpy(mu->pass, new_hash, PASSLEN);
-
 		// Verification succeeded and user's password (possibly) re-encrypted
+		(void) verify_password_recrypt(mu, ci, password);
 		return true;
 	}
 
 	return (strcmp(mu->pass, password) == 0);
 }
+
+struct verify_password_req_
+{
+	char entity_id[IDLEN];
+	char *password;
+	char *pass;
+
+	bool verified;
+
+	verify_password_cb_t cb;
+	void *priv;
+};
+
+static void
+verify_password_req_finish(verify_password_req_t *const restrict req, const crypt_impl_t *const restrict ci)
+{
+	myuser_t *mu;
+	bool verified = req->verified;
+
+	/* the account may have been dropped, or its password changed, while
+	 * we were waiting; neither should let the old password in
+	 */
+	mu = user(myentity_find_uid(req->entity_id));
+
+	if (mu == NULL)
+		verified = false;
+	else if (req->pass != NULL)
+	{
+		verified = (ci != NULL && strcmp(mu->pass, req->pass) == 0);
+
+		if (verified)
+			(void) verify_password_recrypt(mu, ci, req->password);
+	}
+
+	if (req->cb != NULL)
+		req->cb(mu, verified, req->priv);
+
+	(void) explicit_bzero(req->password, strlen(req->password));
+
+	free(req->password);
+	free(req->pass);
+	free(req);
+}
+
+static void
+verify_password_crypt_done(const crypt_impl_t *const ci, void *const vreq)
+{
+	(void) verify_password_req_finish(vreq, ci);
+}
+
+static void
+verify_password_timer_done(void *const vreq)
+{
+	(void) verify_password_req_finish(vreq, NULL);
+}
+
+/*
+ * verify_password_async(myuser_t *mu, const char *password,
+ *                       verify_password_cb_t cb, void *priv)
+ *
+ * Non-blocking version of verify_password(). Crypted passwords are verified
+ * by crypt_verify_password_async(), so expensive hashes do not hold up the
+ * event loop.
+ *
+ * Inputs:
+ *       - account and password to check
+ *       - callback receiving the account (NULL if it went away) and the
+ *         verification result
+ *       - opaque data passed to the callback
+ *
+ * Outputs:
+ *       - handle for verify_password_cancel()
+ *
+ * Side Effects:
+ *       - the callback runs from the event loop later, never from within
+ *         this function
+ */
+verify_password_req_t *
+verify_password_async(myuser_t *const restrict mu, const char *const restrict password,
+                      const verify_password_cb_t cb, void *const restrict priv)
+{
+	verify_password_req_t *req;
+
+	return_val_if_fail(mu != NULL, NULL);
+	return_val_if_fail(password != NULL, NULL);
+	return_val_if_fail(cb != NULL, NULL);
+
+	req = scalloc(sizeof *req, 1);
+	mowgli_strlcpy(req->entity_id, entity(mu)->id, sizeof req->entity_id);
+	req->password = sstrdup(password);
+	req->cb = cb;
+	req->priv = priv;
+
+	if (!(auth_module_loaded && auth_user_custom) && (mu->flags & MU_CRYPTPASS))
+	{
+		req->pass = sstrdup(mu->pass);
+
+		if (crypt_verify_password_async(password, mu->pass, verify_password_crypt_done, req) != NULL)
+			return req;
+
+		free(req->pass);
+		req->pass = NULL;
+	}
+
+	req->verified = verify_password(mu, password);
+
+	(void) mowgli_timer_add_once(base_eventloop, "verify_password", verify_password_timer_done, req, 0);
+
+	return req;
+}
+
+/*
+ * verify_password_cancel(verify_password_req_t *req)
+ *
+ * Makes sure the callback for a pending verification will not run.
+ */
+void
+verify_password_cancel(verify_password_req_t *const restrict req)
+{
+	return_if_fail(req != NULL);
+
+	req->cb = NULL;
+	req->priv = NULL;
+}
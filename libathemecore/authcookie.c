@@ -25,8 +25,12 @@
 #include "atheme.h"
 #include "authcookie.h"
 
+/* every cookie lives for AUTHCOOKIE_LIFETIME, so this is also in order of expiry */
+#define AUTHCOOKIE_LIFETIME	3600
+
 mowgli_list_t authcookie_list;
 mowgli_heap_t *authcookie_heap;
+static mowgli_patricia_t *authcookie_tickets;
 
 void authcookie_init(void)
 {
@@ -37,6 +41,8 @@ void authcookie_init(void)
 		slog(LG_ERROR, "authcookie_init(): cannot initialize block allocator.");
 		exit(EXIT_FAILURE);
 	}
+
+	authcookie_tickets = mowgli_patricia_create(noopcanon);
 }
 
 /*
@@ -57,9 +63,11 @@ authcookie_t *authcookie_create(myuser_t *mu)
 
 	au->ticket = random_string(20);
 	au->myuser = mu;
-	au->expire = CURRTIME + 3600;
+	au->expire = CURRTIME + AUTHCOOKIE_LIFETIME;
 
 	mowgli_node_add(au, &au->node, &authcookie_list);
+	mowgli_node_add(au, &au->unode, &mu->authcookies);
+	mowgli_patricia_add(authcookie_tickets, au->ticket, au);
 
 	return au;
 }
@@ -78,45 +86,20 @@ authcookie_t *authcookie_create(myuser_t *mu)
  */
 authcookie_t *authcookie_find(char *ticket, myuser_t *myuser)
 {
-	mowgli_node_t *n;
 	authcookie_t *ac;
 
 	/* at least one must be specified */
 	return_val_if_fail(ticket != NULL || myuser != NULL, NULL);
 
-	if (!myuser)		/* must have ticket */
-	{
-		MOWGLI_ITER_FOREACH(n, authcookie_list.head)
-		{
-			ac = n->data;
+	if (!ticket)		/* must have myuser */
+		return myuser->authcookies.head != NULL ? myuser->authcookies.head->data : NULL;
 
-			if (!strcmp(ac->ticket, ticket))
-				return ac;
-		}
-	}
-	else if (!ticket)	/* must have myuser */
-	{
-		MOWGLI_ITER_FOREACH(n, authcookie_list.head)
-		{
-			ac = n->data;
+	ac = mowgli_patricia_retrieve(authcookie_tickets, ticket);
 
-			if (ac->myuser == myuser)
-				return ac;
-		}
-	}
-	else			/* must have both */
-	{
-		MOWGLI_ITER_FOREACH(n, authcookie_list.head)
-		{
-			ac = n->data;
-
-			if (ac->myuser == myuser
-				&& !strcmp(ac->ticket, ticket))
-				return ac;
-		}
-	}
+	if (ac != NULL && myuser != NULL && ac->myuser != myuser)
+		return NULL;
 
-	return NULL;
+	return ac;
 }
 
 /*
@@ -136,6 +119,8 @@ void authcookie_destroy(authcookie_t * ac)
 	return_if_fail(ac != NULL);
 
 	mowgli_node_delete(&ac->node, &authcookie_list);
+	mowgli_node_delete(&ac->unode, &ac->myuser->authcookies);
+	mowgli_patricia_delete(authcookie_tickets, ac->ticket);
 	free(ac->ticket);
 	mowgli_heap_free(authcookie_heap, ac);
 }
@@ -157,12 +142,11 @@ void authcookie_destroy_all(myuser_t *mu)
 	mowgli_node_t *n, *tn;
 	authcookie_t *ac;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, authcookie_list.head)
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->authcookies.head)
 	{
 		ac = n->data;
 
-		if (ac->myuser == mu)
-			authcookie_destroy(ac);
+		authcookie_destroy(ac);
 	}
 }
 
@@ -184,12 +168,16 @@ void authcookie_expire(void *arg)
 	mowgli_node_t *n, *tn;
 
 	(void)arg;
-        MOWGLI_ITER_FOREACH_SAFE(n, tn, authcookie_list.head)
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, authcookie_list.head)
 	{
 		ac = n->data;
 
-		if (ac->expire <= CURRTIME)
-			authcookie_destroy(ac);
+		/* the rest were created later; a clock step back may leave
+		 * one behind until next time, but validation checks anyway */
+		if (ac->expire > CURRTIME)
+			break;
+
+		authcookie_destroy(ac);
 	}
 }
 
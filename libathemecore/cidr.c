@@ -297,6 +297,68 @@ int match_ips(const char *s1, const char *s2)
 		return 1;
 }
 
+/*
+ * parse_cidr()
+ *
+ * Input - cidr ip mask, buffer of IN6ADDRSZ bytes, prefix length
+ * Output - 4 or 6 for a mask match_ips() can match, 0 otherwise
+ */
+int parse_cidr(const char *s1, unsigned char *addr, unsigned int *bits)
+{
+	char ipmask[BUFSIZE];
+	char *len;
+	int cidrlen;
+
+	if (s1 == NULL)
+		return 0;
+
+	mowgli_strlcpy(ipmask, s1, sizeof ipmask);
+
+	len = strrchr(ipmask, '/');
+	if (len == NULL)
+		return 0;
+
+	*len++ = '\0';
+
+	cidrlen = atoi(len);
+	if (cidrlen <= 0)
+		return 0;
+
+	if (strchr(ipmask, ':'))
+	{
+		if (cidrlen > 128 || !inet_pton6(ipmask, addr))
+			return 0;
+		*bits = cidrlen;
+		return 6;
+	}
+
+	if (cidrlen > 32 || !inet_pton4(ipmask, addr))
+		return 0;
+	*bits = cidrlen;
+	return 4;
+}
+
+/*
+ * parse_ip()
+ *
+ * Input - address, buffer of IN6ADDRSZ bytes
+ * Output - 4 or 6 for an address match_ips() can match, 0 otherwise
+ */
+int parse_ip(const char *s2, unsigned char *addr)
+{
+	char ip[HOSTLEN + 1];
+
+	if (s2 == NULL)
+		return 0;
+
+	mowgli_strlcpy(ip, s2, sizeof ip);
+
+	if (strchr(ip, ':'))
+		return inet_pton6(ip, addr) ? 6 : 0;
+
+	return inet_pton4(ip, addr) ? 4 : 0;
+}
+
 /* match_cidr()
  *
  * Input - mask n!u@i/c, address n!u@i
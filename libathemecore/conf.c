@@ -255,6 +255,7 @@ void init_newconf(void)
 	add_bool_conf_item("CLONE_IDENTIFIED_INCREASE_LIMIT", &conf_gi_table, 0, &config_options.clone_increase, false);
 
 	add_uint_conf_item("UPLINK_SENDQ_LIMIT", &conf_gi_table, 0, &config_options.uplink_sendq_limit, 10240, INT_MAX, 1048576);
+	add_uint_conf_item("CRYPT_WORKERS", &conf_gi_table, CONF_NO_REHASH, &config_options.crypt_workers, 0, 64, 2);
 	add_dupstr_conf_item("LANGUAGE", &conf_gi_table, 0, &config_options.language, "en");
 	add_conf_item("EXEMPTS", &conf_gi_table, c_gi_exempts);
 	add_conf_item("IMMUNE_LEVEL", &conf_gi_table, c_gi_immune_level);
@@ -780,6 +781,9 @@ static int c_logfile(mowgli_config_file_entry_t *ce)
 {
 	mowgli_config_file_entry_t *flce;
 	unsigned int logval = 0;
+	unsigned int bufsize = 0, flushtime = 1;
+	bool threaded = false;
+	logfile_t *lf;
 
 	if (ce->vardata == NULL)
 	{
@@ -791,6 +795,22 @@ static int c_logfile(mowgli_config_file_entry_t *ce)
 	{
 		int val;
 
+		if (!strcasecmp(flce->varname, "BUFFER"))
+		{
+			(void)process_uint_configentry(flce, &bufsize, 0, 16 * 1024 * 1024);
+			continue;
+		}
+		else if (!strcasecmp(flce->varname, "FLUSH"))
+		{
+			(void)process_duration_configentry(flce, &flushtime, "s");
+			continue;
+		}
+		else if (!strcasecmp(flce->varname, "THREADED"))
+		{
+			threaded = true;
+			continue;
+		}
+
 		val = token_to_value(logflags, flce->varname);
 
 		if ((val != TOKEN_UNMATCHED) && (val != TOKEN_ERROR))
@@ -801,7 +821,10 @@ static int c_logfile(mowgli_config_file_entry_t *ce)
 		}
 	}
 
-	logfile_new(ce->vardata, logval);
+	lf = logfile_new(ce->vardata, logval);
+
+	if (lf != NULL && bufsize != 0 && !logfile_set_buffer(lf, bufsize, flushtime, threaded))
+		conf_report_warning(ce, "buffering is only supported for log files");
 
 	return 0;
 }
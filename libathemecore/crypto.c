@@ -23,6 +23,10 @@
 
 #include "atheme.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 static mowgli_list_t crypt_impl_list = { NULL, NULL, 0 };
 
 const crypt_impl_t *
@@ -72,6 +76,8 @@ crypt_string(const char *const restrict password, const char *restrict parameter
 	return ci->crypt(password, parameters);
 }
 
+static void crypt_workers_forget(const crypt_impl_t *impl);
+
 static void
 crypt_log_modchg(const char *const restrict caller, const char *const restrict which,
                  const crypt_impl_t *const restrict impl)
@@ -110,6 +116,8 @@ crypt_unregister(crypt_impl_t *const restrict impl)
 
 	if ((impl->salt != NULL && impl->crypt != NULL) || impl->verify != NULL)
 	{
+		(void) crypt_workers_forget(impl);
+
 		mowgli_node_delete(&impl->node, &crypt_impl_list);
 		(void) crypt_log_modchg(__func__, "unregistered", impl);
 	}
@@ -143,3 +151,436 @@ crypt_verify_password(const char *const restrict password, const char *const res
 
 	return NULL;
 }
+
+/*
+ * Asynchronous password verification.
+ *
+ * Key derivation at the iteration counts we recommend takes long enough that
+ * running it on the event loop stalls the uplink for everyone whenever a
+ * burst of users identifies at once (e.g. SASL after a netsplit). Providers
+ * which set `threadsafe' have their verify method run on a small pool of
+ * worker threads instead; the result is handed back to the event loop through
+ * a pipe, and the callback always runs on the event loop.
+ *
+ * Worker threads must not touch anything but the request they were handed
+ * and the provider's verify method; in particular they must not log (vslog_ext
+ * discards messages from them) or allocate from mowgli heaps.
+ */
+
+struct crypt_verify_req_
+{
+	char *password;
+	char *parameters;
+
+	/* providers to try off-loop, snapshotted at submission time;
+	 * entries are NULLed if the provider unregisters meanwhile
+	 */
+	const crypt_impl_t **impls;
+	size_t impl_count;
+
+	const crypt_impl_t *result;
+
+	crypt_verify_cb_t cb;
+	void *priv;
+
+	mowgli_node_t node;
+};
+
+static bool crypt_workers_started = false;
+static int crypt_done_pipe[2] = { -1, -1 };
+static mowgli_eventloop_pollable_t *crypt_done_pollable = NULL;
+static mowgli_list_t crypt_done_list = { NULL, NULL, 0 };
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t crypt_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t crypt_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t crypt_idle_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t crypt_main_thread;
+static pthread_t *crypt_threads = NULL;
+static unsigned int crypt_thread_count = 0;
+static unsigned int crypt_threads_busy = 0;
+static bool crypt_threads_exiting = false;
+static mowgli_list_t crypt_work_list = { NULL, NULL, 0 };
+#endif
+
+static bool
+crypt_impl_is_registered(const crypt_impl_t *const restrict impl)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, crypt_impl_list.head)
+		if (n->data == impl)
+			return true;
+
+	return false;
+}
+
+static void
+crypt_verify_req_free(crypt_verify_req_t *const restrict req)
+{
+	(void) explicit_bzero(req->password, strlen(req->password));
+
+	free(req->password);
+	free(req->parameters);
+	free(req->impls);
+	free(req);
+}
+
+/* runs in a worker thread, or inline when there are no workers */
+static void
+crypt_verify_req_run(crypt_verify_req_t *const restrict req)
+{
+	for (size_t i = 0; i < req->impl_count; i++)
+	{
+		const crypt_impl_t *const ci = req->impls[i];
+
+		if (ci != NULL && ci->verify(req->password, req->parameters))
+		{
+			req->result = ci;
+			return;
+		}
+	}
+}
+
+/* completes a request on the event loop */
+static void
+crypt_verify_req_finish(crypt_verify_req_t *const restrict req)
+{
+	const crypt_impl_t *ci = req->result;
+	mowgli_node_t *n;
+
+	if (req->cb == NULL)
+	{
+		/* cancelled */
+		(void) crypt_verify_req_free(req);
+		return;
+	}
+
+	if (ci != NULL && !crypt_impl_is_registered(ci))
+	{
+		/* the matching provider went away before we got here, so
+		 * we can't hand it out; redo the whole check inline
+		 */
+		ci = crypt_verify_password(req->password, req->parameters);
+	}
+	else if (ci == NULL)
+	{
+		/* providers that are not safe to run off-loop get their
+		 * turn now
+		 */
+		MOWGLI_ITER_FOREACH(n, crypt_impl_list.head)
+		{
+			const crypt_impl_t *const impl = n->data;
+
+			if (impl->threadsafe && impl->verify != NULL)
+				continue;
+
+			if (impl->verify != NULL)
+			{
+				if (impl->verify(req->password, req->parameters))
+				{
+					ci = impl;
+					break;
+				}
+			}
+			else if (impl->crypt != NULL)
+			{
+				const char *const result = impl->crypt(req->password, req->parameters);
+
+				if (result != NULL && strcmp(result, req->parameters) == 0)
+				{
+					ci = impl;
+					break;
+				}
+			}
+		}
+	}
+
+	req->cb(ci, req->priv);
+
+	(void) crypt_verify_req_free(req);
+}
+
+static void
+crypt_done_read(mowgli_eventloop_t *eventloop, mowgli_eventloop_io_t *io, mowgli_eventloop_io_dir_t dir,
+                void *userdata)
+{
+	mowgli_list_t done = { NULL, NULL, 0 };
+	mowgli_node_t *n, *tn;
+	char buf[BUFSIZE];
+
+	while (read(crypt_done_pipe[0], buf, sizeof buf) > 0)
+		;
+
+#ifdef HAVE_PTHREAD
+	(void) pthread_mutex_lock(&crypt_lock);
+#endif
+	done = crypt_done_list;
+	crypt_done_list.head = crypt_done_list.tail = NULL;
+	crypt_done_list.count = 0;
+#ifdef HAVE_PTHREAD
+	(void) pthread_mutex_unlock(&crypt_lock);
+#endif
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, done.head)
+		(void) crypt_verify_req_finish(n->data);
+}
+
+static void
+crypt_done_push(crypt_verify_req_t *const restrict req)
+{
+#ifdef HAVE_PTHREAD
+	(void) pthread_mutex_lock(&crypt_lock);
+#endif
+	(void) mowgli_node_add(req, &req->node, &crypt_done_list);
+#ifdef HAVE_PTHREAD
+	(void) pthread_mutex_unlock(&crypt_lock);
+#endif
+
+	/* a full pipe means a wakeup is already pending, so errors don't matter */
+	const ssize_t ret = write(crypt_done_pipe[1], "", 1);
+
+	(void) ret;
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+crypt_worker_main(void *arg)
+{
+	for (;;)
+	{
+		crypt_verify_req_t *req;
+
+		(void) pthread_mutex_lock(&crypt_lock);
+
+		while (!crypt_threads_exiting && crypt_work_list.head == NULL)
+			(void) pthread_cond_wait(&crypt_work_cond, &crypt_lock);
+
+		if (crypt_threads_exiting)
+		{
+			(void) pthread_mutex_unlock(&crypt_lock);
+			return NULL;
+		}
+
+		req = crypt_work_list.head->data;
+		(void) mowgli_node_delete(&req->node, &crypt_work_list);
+		crypt_threads_busy++;
+
+		(void) pthread_mutex_unlock(&crypt_lock);
+
+		(void) crypt_verify_req_run(req);
+
+		(void) pthread_mutex_lock(&crypt_lock);
+		crypt_threads_busy--;
+		(void) pthread_cond_broadcast(&crypt_idle_cond);
+		(void) pthread_mutex_unlock(&crypt_lock);
+
+		(void) crypt_done_push(req);
+	}
+}
+#endif
+
+static bool
+crypt_workers_start(void)
+{
+	if (crypt_workers_started)
+		return true;
+
+	if (pipe(crypt_done_pipe) != 0)
+	{
+		(void) slog(LG_ERROR, "%s: pipe(2) failed: %s", __func__, strerror(errno));
+		return false;
+	}
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		(void) fcntl(crypt_done_pipe[i], F_SETFL, fcntl(crypt_done_pipe[i], F_GETFL) | O_NONBLOCK);
+#ifdef FD_CLOEXEC
+		(void) fcntl(crypt_done_pipe[i], F_SETFD, FD_CLOEXEC);
+#endif
+	}
+
+	crypt_done_pollable = mowgli_pollable_create(base_eventloop, crypt_done_pipe[0], NULL);
+	(void) mowgli_pollable_setselect(base_eventloop, crypt_done_pollable, MOWGLI_EVENTLOOP_IO_READ, crypt_done_read);
+
+	crypt_workers_started = true;
+
+#ifdef HAVE_PTHREAD
+	crypt_main_thread = pthread_self();
+
+	if (config_options.crypt_workers == 0)
+		return true;
+
+	crypt_threads = scalloc(config_options.crypt_workers, sizeof *crypt_threads);
+
+	for (unsigned int i = 0; i < config_options.crypt_workers; i++)
+	{
+		if (pthread_create(&crypt_threads[crypt_thread_count], NULL, crypt_worker_main, NULL) != 0)
+		{
+			(void) slog(LG_ERROR, "%s: pthread_create(3) failed: %s", __func__, strerror(errno));
+			break;
+		}
+
+		crypt_thread_count++;
+	}
+
+	(void) slog(LG_DEBUG, "%s: started %u password verification threads", __func__, crypt_thread_count);
+#endif
+
+	return true;
+}
+
+/*
+ * crypt_verify_password_async(const char *password, const char *parameters,
+ *                             crypt_verify_cb_t cb, void *priv)
+ *
+ * Like crypt_verify_password(), but runs the verification off the event loop
+ * where the provider allows it.
+ *
+ * Inputs:
+ *       - password and stored parameters, copied by this function
+ *       - callback to run with the matching provider (or NULL)
+ *       - opaque data passed to the callback
+ *
+ * Outputs:
+ *       - handle for crypt_verify_cancel()
+ *
+ * Side Effects:
+ *       - the callback runs from the event loop later, never from within
+ *         this function
+ */
+crypt_verify_req_t *
+crypt_verify_password_async(const char *const restrict password, const char *const restrict parameters,
+                            const crypt_verify_cb_t cb, void *const restrict priv)
+{
+	crypt_verify_req_t *req;
+	mowgli_node_t *n;
+
+	return_val_if_fail(password != NULL, NULL);
+	return_val_if_fail(parameters != NULL, NULL);
+	return_val_if_fail(cb != NULL, NULL);
+
+	if (!crypt_workers_start())
+		return NULL;
+
+	req = scalloc(sizeof *req, 1);
+	req->password = sstrdup(password);
+	req->parameters = sstrdup(parameters);
+	req->cb = cb;
+	req->priv = priv;
+	req->impls = scalloc(MOWGLI_LIST_LENGTH(&crypt_impl_list) + 1, sizeof *req->impls);
+
+	MOWGLI_ITER_FOREACH(n, crypt_impl_list.head)
+	{
+		const crypt_impl_t *const ci = n->data;
+
+		if (ci->threadsafe && ci->verify != NULL)
+			req->impls[req->impl_count++] = ci;
+	}
+
+#ifdef HAVE_PTHREAD
+	if (crypt_thread_count != 0 && req->impl_count != 0)
+	{
+		(void) pthread_mutex_lock(&crypt_lock);
+		(void) mowgli_node_add(req, &req->node, &crypt_work_list);
+		(void) pthread_cond_signal(&crypt_work_cond);
+		(void) pthread_mutex_unlock(&crypt_lock);
+
+		return req;
+	}
+#endif
+
+	(void) crypt_verify_req_run(req);
+	(void) crypt_done_push(req);
+
+	return req;
+}
+
+/*
+ * crypt_verify_cancel(crypt_verify_req_t *req)
+ *
+ * Makes sure the callback for a pending request will not run. The request
+ * itself is released once any worker is done with it.
+ */
+void
+crypt_verify_cancel(crypt_verify_req_t *const restrict req)
+{
+	return_if_fail(req != NULL);
+
+	req->cb = NULL;
+	req->priv = NULL;
+}
+
+/*
+ * Makes sure no worker is running, or will run, code belonging to the given
+ * provider. Called before a provider unregisters, since its module is about
+ * to be unloaded.
+ */
+static void
+crypt_workers_forget(const crypt_impl_t *const restrict impl)
+{
+#ifdef HAVE_PTHREAD
+	mowgli_node_t *n;
+
+	if (crypt_thread_count == 0)
+		return;
+
+	(void) pthread_mutex_lock(&crypt_lock);
+
+	MOWGLI_ITER_FOREACH(n, crypt_work_list.head)
+	{
+		crypt_verify_req_t *const req = n->data;
+
+		for (size_t i = 0; i < req->impl_count; i++)
+			if (req->impls[i] == impl)
+				req->impls[i] = NULL;
+	}
+
+	while (crypt_threads_busy != 0)
+		(void) pthread_cond_wait(&crypt_idle_cond, &crypt_lock);
+
+	(void) pthread_mutex_unlock(&crypt_lock);
+#endif
+}
+
+/*
+ * crypt_workers_shutdown(void)
+ *
+ * Stops the worker threads. Requests that have not completed yet are
+ * dropped without running their callbacks.
+ */
+void
+crypt_workers_shutdown(void)
+{
+#ifdef HAVE_PTHREAD
+	if (crypt_thread_count == 0)
+		return;
+
+	(void) pthread_mutex_lock(&crypt_lock);
+	crypt_threads_exiting = true;
+	(void) pthread_cond_broadcast(&crypt_work_cond);
+	(void) pthread_mutex_unlock(&crypt_lock);
+
+	for (unsigned int i = 0; i < crypt_thread_count; i++)
+		(void) pthread_join(crypt_threads[i], NULL);
+
+	free(crypt_threads);
+	crypt_threads = NULL;
+	crypt_thread_count = 0;
+#endif
+}
+
+/*
+ * crypt_in_worker(void)
+ *
+ * Returns true if called from a password verification thread.
+ */
+bool
+crypt_in_worker(void)
+{
+#ifdef HAVE_PTHREAD
+	return crypt_thread_count != 0 && !pthread_equal(pthread_self(), crypt_main_thread);
+#else
+	return false;
+#endif
+}
@@ -9,6 +9,39 @@
 
 database_module_t *db_mod = NULL;
 mowgli_patricia_t *db_types = NULL;
+void (*db_journal)(db_journal_op_t op, void *object, const char *arg) = NULL;
+
+/*
+ * Row types resolved to their handlers, so loading a database does not
+ * walk db_types for each of its rows.  Direct-mapped on a case-insensitive
+ * hash of the type; flushed whenever a handler is (un)registered.
+ */
+#define DB_TYPE_CACHE_SIZE	128
+#define DB_TYPE_MAXLEN		16
+
+typedef struct {
+	char type[DB_TYPE_MAXLEN];
+	database_handler_f fun;
+} db_type_cache_t;
+
+static db_type_cache_t db_type_cache[DB_TYPE_CACHE_SIZE];
+
+static unsigned int
+db_type_hash(const char *type)
+{
+	unsigned int h = 2166136261U;
+
+	for (; *type != '\0'; type++)
+		h = (h ^ (unsigned char) toupper((unsigned char) *type)) * 16777619U;
+
+	return h % DB_TYPE_CACHE_SIZE;
+}
+
+static void
+db_type_cache_flush(void)
+{
+	memset(db_type_cache, 0, sizeof db_type_cache);
+}
 
 database_handle_t *
 db_open(const char *filename, database_transaction_t txn)
@@ -19,11 +52,11 @@ db_open(const char *filename, database_transaction_t txn)
 	return db_mod->db_open(filename, txn);
 }
 
-void
+bool
 db_close(database_handle_t *db)
 {
-	return_if_fail(db_mod != NULL);
-	return_if_fail(db_mod->db_close != NULL);
+	return_val_if_fail(db_mod != NULL, false);
+	return_val_if_fail(db_mod->db_close != NULL, false);
 
 	return db_mod->db_close(db);
 }
@@ -37,6 +70,33 @@ db_parse(database_handle_t *db)
 	return db_mod->db_parse(db);
 }
 
+/*
+ * Segments are write handles whose rows are kept aside until appended to
+ * the handle they were opened on; NULL if the backend has none.
+ */
+database_handle_t *
+db_open_segment(database_handle_t *parent)
+{
+	return_val_if_fail(db_mod != NULL, NULL);
+	return_val_if_fail(parent != NULL, NULL);
+	return_val_if_fail(parent->txn == DB_WRITE, NULL);
+
+	if (db_mod->db_open_segment == NULL)
+		return NULL;
+
+	return db_mod->db_open_segment(parent);
+}
+
+/* appends a segment's rows to its parent and frees the segment */
+void
+db_append_segment(database_handle_t *parent, database_handle_t *segment)
+{
+	return_if_fail(db_mod != NULL);
+	return_if_fail(db_mod->db_append_segment != NULL);
+
+	db_mod->db_append_segment(parent, segment);
+}
+
 bool
 db_read_next_row(database_handle_t *db)
 {
@@ -246,6 +306,7 @@ db_register_type_handler(const char *type, database_handler_f fun)
 	return_if_fail(fun != NULL);
 
 	mowgli_patricia_add(db_types, type, fun);
+	db_type_cache_flush();
 }
 
 void
@@ -255,17 +316,29 @@ db_unregister_type_handler(const char *type)
 	return_if_fail(type != NULL);
 
 	mowgli_patricia_delete(db_types, type);
+	db_type_cache_flush();
 }
 
 void
 db_process(database_handle_t *db, const char *type)
 {
 	database_handler_f fun;
+	db_type_cache_t *dc = NULL;
 
 	return_if_fail(db_types != NULL);
 	return_if_fail(db != NULL);
 	return_if_fail(type != NULL);
 
+	if (strlen(type) < DB_TYPE_MAXLEN)
+	{
+		dc = &db_type_cache[db_type_hash(type)];
+		if (dc->fun != NULL && !strcasecmp(dc->type, type))
+		{
+			dc->fun(db, type);
+			return;
+		}
+	}
+
 	fun = mowgli_patricia_retrieve(db_types, type);
 
 	if (!fun)
@@ -273,6 +346,12 @@ db_process(database_handle_t *db, const char *type)
 		fun = mowgli_patricia_retrieve(db_types, "???");
 	}
 
+	if (dc != NULL && fun != NULL)
+	{
+		mowgli_strlcpy(dc->type, type, sizeof dc->type);
+		dc->fun = fun;
+	}
+
 	fun(db, type);
 }
 
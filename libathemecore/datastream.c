@@ -25,8 +25,18 @@
 #include "atheme.h"
 #include "datastream.h"
 
+#ifndef MOWGLI_OS_WIN
+# include <sys/uio.h>
+#endif
+
 #define SENDQSIZE (4096 - 40)
 
+/* large enough to take a good part of a netburst in one recv(2) */
+#define RECVQSIZE 65536
+
+/* chunks handed to a single writev(2) in sendq_flush() */
+#define SENDQ_IOV 32
+
 #ifdef MOWGLI_OS_WIN
 # define EWOULDBLOCK	WSAEWOULDBLOCK
 # define EALREADY	WSAEALREADY
@@ -41,6 +51,38 @@ struct sendq {
 	char buf[SENDQSIZE];
 };
 
+/* sendq chunks come from one pool shared by all connections */
+static mowgli_heap_t *sendq_heap = NULL;
+
+static struct sendq *sendq_chunk_add(mowgli_list_t *list)
+{
+	struct sendq *sq;
+
+	if (sendq_heap == NULL)
+		sendq_heap = sharedheap_get(sizeof(struct sendq));
+
+	sq = mowgli_heap_alloc(sendq_heap);
+	sq->firstused = sq->firstfree = 0;
+	mowgli_node_add(sq, &sq->node, list);
+
+	return sq;
+}
+
+static void sendq_chunk_delete(struct sendq *sq, mowgli_list_t *list)
+{
+	mowgli_node_delete(&sq->node, list);
+	mowgli_heap_free(sendq_heap, sq);
+}
+
+/* drops a drained chunk, keeping the last one around for reuse */
+static void sendq_chunk_drained(struct sendq *sq, mowgli_list_t *list)
+{
+	if (MOWGLI_LIST_LENGTH(list) > 1)
+		sendq_chunk_delete(sq, list);
+	else
+		sq->firstused = sq->firstfree = 0;
+}
+
 void sendq_add(connection_t * cptr, char *buf, size_t len)
 {
 	mowgli_node_t *n;
@@ -86,9 +128,7 @@ void sendq_add(connection_t * cptr, char *buf, size_t len)
 
 	while (len > 0)
 	{
-		sq = smalloc(sizeof(struct sendq));
-		sq->firstused = sq->firstfree = 0;
-		mowgli_node_add(sq, &sq->node, &cptr->sendq);
+		sq = sendq_chunk_add(&cptr->sendq);
 		l = SENDQSIZE - sq->firstfree;
 		if (l > len)
 			l = len;
@@ -115,24 +155,60 @@ void sendq_add_eof(connection_t * cptr)
 
 void sendq_flush(connection_t * cptr)
 {
-        mowgli_node_t *n, *tn;
-        struct sendq *sq;
-        int l;
+	mowgli_node_t *n, *tn;
+	struct sendq *sq;
+	ssize_t l;
+	size_t want;
+	bool partial;
+#ifndef MOWGLI_OS_WIN
+	struct iovec iov[SENDQ_IOV];
+	int iovcnt;
+#endif
 
 	return_if_fail(cptr != NULL);
 
-        MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->sendq.head)
-        {
-                sq = (struct sendq *)n->data;
+	for (;;)
+	{
+		want = 0;
+
+#ifndef MOWGLI_OS_WIN
+		/* gather every pending chunk into one writev(2) */
+		iovcnt = 0;
+		MOWGLI_ITER_FOREACH(n, cptr->sendq.head)
+		{
+			sq = (struct sendq *)n->data;
+
+			if (sq->firstused == sq->firstfree || iovcnt == SENDQ_IOV)
+				break;
+
+			iov[iovcnt].iov_base = sq->buf + sq->firstused;
+			iov[iovcnt].iov_len = sq->firstfree - sq->firstused;
+			want += iov[iovcnt].iov_len;
+			iovcnt++;
+		}
+
+		if (want == 0)
+			break;
+
+		l = writev(cptr->fd, iov, iovcnt);
+#else
+		if (cptr->sendq.head == NULL)
+			break;
+
+		sq = (struct sendq *)cptr->sendq.head->data;
+		want = sq->firstfree - sq->firstused;
 
-                if (sq->firstused == sq->firstfree)
-                        break;
+		if (want == 0)
+			break;
+
+		l = send(cptr->fd, sq->buf + sq->firstused, want, 0);
+#endif
 
-                if ((l = send(cptr->fd, sq->buf + sq->firstused, sq->firstfree - sq->firstused, 0)) == -1)
-                {
-                        int err = ioerrno();
+		if (l == -1)
+		{
+			int err = ioerrno();
 
-                        if (!mowgli_eventloop_ignore_errno(err))
+			if (!mowgli_eventloop_ignore_errno(err))
 			{
 				slog(LG_DEBUG, "sendq_flush(): write error %d (%s) on connection %s[%d]",
 						err, strerror(err),
@@ -140,24 +216,36 @@ void sendq_flush(connection_t * cptr)
 				cptr->flags |= CF_DEAD;
 			}
 
-                        return;
-                }
+			return;
+		}
+
+		/* socket buffer is full, wait for the next write event */
+		partial = (size_t) l < want;
+
+		/* retire whatever the kernel took */
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->sendq.head)
+		{
+			size_t done;
 
-                sq->firstused += l;
-                if (sq->firstused == sq->firstfree)
-                {
-			if (MOWGLI_LIST_LENGTH(&cptr->sendq) > 1)
+			sq = (struct sendq *)n->data;
+			done = sq->firstfree - sq->firstused;
+
+			if ((size_t) l < done)
 			{
-                        	mowgli_node_delete(&sq->node, &cptr->sendq);
-                        	free(sq);
+				sq->firstused += l;
+				break;
 			}
-			else
-				/* keep one struct sendq */
-				sq->firstused = sq->firstfree = 0;
-                }
-                else
-                        return;
-        }
+
+			l -= done;
+			sendq_chunk_drained(sq, &cptr->sendq);
+
+			if (l == 0)
+				break;
+		}
+
+		if (partial)
+			return;
+	}
 	if (cptr->flags & CF_SEND_EOF)
 	{
 		/* shut down write end, kill entire connection
@@ -195,22 +283,11 @@ void sendq_set_limit(connection_t *cptr, size_t len)
 
 int recvq_length(connection_t *cptr)
 {
-	int l = 0;
-	mowgli_node_t *n;
-	struct sendq *sq;
-
-	MOWGLI_ITER_FOREACH(n, cptr->recvq.head)
-	{
-		sq = n->data;
-		l += sq->firstfree - sq->firstused;
-	}
-	return l;
+	return cptr->recvq_end - cptr->recvq_start;
 }
 
 void recvq_put(connection_t *cptr)
 {
-	mowgli_node_t *n;
-	struct sendq *sq = NULL;
 	int l, ll;
 
 	return_if_fail(cptr != NULL);
@@ -229,35 +306,35 @@ void recvq_put(connection_t *cptr)
 		return;
 	}
 
-	n = cptr->recvq.tail;
-	if (n != NULL)
-	{
-		sq = n->data;
-		l = SENDQSIZE - sq->firstfree;
-		if (l == 0)
-			sq = NULL;
-	}
-	if (sq == NULL)
+	if (cptr->recvq == NULL)
+		cptr->recvq = smalloc(RECVQSIZE);
+
+	/* slide a partial line down so the whole tail is free for recv() */
+	if (cptr->recvq_start > 0 && cptr->recvq_end == RECVQSIZE)
 	{
-		sq = smalloc(sizeof(struct sendq));
-		sq->firstused = sq->firstfree = 0;
-		mowgli_node_add(sq, &sq->node, &cptr->recvq);
-		l = SENDQSIZE;
+		memmove(cptr->recvq, cptr->recvq + cptr->recvq_start, cptr->recvq_end - cptr->recvq_start);
+		cptr->recvq_end -= cptr->recvq_start;
+		cptr->recvq_start = 0;
 	}
+
 	errno = 0;
 
-	l = recv(cptr->fd, sq->buf + sq->firstfree, l, 0);
-	if (l == 0 || (l < 0 && !mowgli_eventloop_ignore_errno(ioerrno())))
+	l = 0;
+	if (cptr->recvq_end < RECVQSIZE)
 	{
-		if (l == 0)
-			slog(LG_DEBUG, "recvq_put(): fd %d closed the connection", cptr->fd);
-		else
-			slog(LG_DEBUG, "recvq_put(): lost connection on fd %d", cptr->fd);
-		connection_close(cptr);
-		return;
+		l = recv(cptr->fd, cptr->recvq + cptr->recvq_end, RECVQSIZE - cptr->recvq_end, 0);
+		if (l == 0 || (l < 0 && !mowgli_eventloop_ignore_errno(ioerrno())))
+		{
+			if (l == 0)
+				slog(LG_DEBUG, "recvq_put(): fd %d closed the connection", cptr->fd);
+			else
+				slog(LG_DEBUG, "recvq_put(): lost connection on fd %d", cptr->fd);
+			connection_close(cptr);
+			return;
+		}
+		else if (l > 0)
+			cptr->recvq_end += l;
 	}
-	else if (l > 0)
-		sq->firstfree += l;
 
 	if (cptr->recvq_handler)
 	{
@@ -269,104 +346,89 @@ void recvq_put(connection_t *cptr)
 			l = recvq_length(cptr);
 		} while (ll != l && l != 0);
 	}
+
+	if (cptr->recvq_start == cptr->recvq_end)
+		cptr->recvq_start = cptr->recvq_end = 0;
 	return;
 }
 
 int recvq_get(connection_t *cptr, char *buf, size_t len)
 {
-	mowgli_node_t *n, *tn;
-	struct sendq *sq;
 	size_t l;
-	char *p = buf;
 
 	return_val_if_fail(cptr != NULL, 0);
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->recvq.head)
-	{
-		sq = (struct sendq *)n->data;
-
-		if (sq->firstused == sq->firstfree || len <= 0)
-			break;
+	l = recvq_length(cptr);
+	if (l > len)
+		l = len;
+	if (l == 0)
+		return 0;
 
-		l = sq->firstfree - sq->firstused;
-		if (l > len)
-			l = len;
-		memcpy(p, sq->buf + sq->firstused, l);
+	memcpy(buf, cptr->recvq + cptr->recvq_start, l);
+	cptr->recvq_start += l;
 
-		p += l;
-		len -= l;
-		sq->firstused += l;
-		if (sq->firstused == sq->firstfree)
-		{
-			if (MOWGLI_LIST_LENGTH(&cptr->recvq) > 1)
-			{
-				mowgli_node_delete(&sq->node, &cptr->recvq);
-				free(sq);
-			}
-			else
-				/* keep one struct sendq */
-				sq->firstused = sq->firstfree = 0;
-		}
-		else
-			return p - buf;
-	}
-	return p - buf;
+	return l;
 }
 
-int recvq_getline(connection_t *cptr, char *buf, size_t len)
+/*
+ * recvq_getline_ref(connection_t *cptr, char **line, size_t len)
+ *
+ * Takes the next line off the receive queue without copying it.
+ *
+ * Inputs:
+ *       - connection, where to store the line, maximum line length
+ *         including the newline
+ *
+ * Outputs:
+ *       - number of bytes taken, 0 if no complete line is queued yet;
+ *         like recvq_getline(), a line longer than len is returned in
+ *         pieces with CF_NONEWLINE set
+ *
+ * Side Effects:
+ *       - *line points into the receive queue and stays valid until the
+ *         next recvq_put(); the caller may modify those bytes, e.g. to
+ *         replace the trailing newline with a terminating NUL
+ */
+int recvq_getline_ref(connection_t *cptr, char **line, size_t len)
 {
-	mowgli_node_t *n, *tn;
-	struct sendq *sq, *sq2 = NULL;
-	size_t l = 0;
-	char *p = buf;
-	char *newline = NULL;
+	size_t l;
+	char *start, *newline;
 
 	return_val_if_fail(cptr != NULL, 0);
+	return_val_if_fail(line != NULL, 0);
+
+	l = recvq_length(cptr);
+	start = cptr->recvq + cptr->recvq_start;
 
-	MOWGLI_ITER_FOREACH(n, cptr->recvq.head)
+	newline = memchr(start, '\n', l < len ? l : len);
+	if (newline != NULL)
 	{
-		sq2 = n->data;
-		l += sq2->firstfree - sq2->firstused;
-		newline = memchr(sq2->buf + sq2->firstused, '\n', sq2->firstfree - sq2->firstused);
-		if (newline != NULL || l >= len)
-			break;
+		cptr->flags &= ~CF_NONEWLINE;
+		l = newline - start + 1;
 	}
-	if (newline == NULL && l < len)
+	else if (l >= len)
+	{
+		cptr->flags |= CF_NONEWLINE;
+		l = len;
+	}
+	else
 		return 0;
 
-	cptr->flags |= CF_NONEWLINE;
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->recvq.head)
-	{
-		sq = (struct sendq *)n->data;
+	*line = start;
+	cptr->recvq_start += l;
 
-		if (sq->firstused == sq->firstfree || len <= 0)
-			break;
+	return l;
+}
 
-		l = sq->firstfree - sq->firstused;
-		if (l > len)
-			l = len;
-		if (sq == sq2 && l >= (size_t) (newline - sq->buf - sq->firstused + 1))
-			cptr->flags &= ~CF_NONEWLINE, l = newline - sq->buf - sq->firstused + 1;
-		memcpy(p, sq->buf + sq->firstused, l);
+int recvq_getline(connection_t *cptr, char *buf, size_t len)
+{
+	char *line;
+	int l;
 
-		p += l;
-		len -= l;
-		sq->firstused += l;
-		if (sq->firstused == sq->firstfree)
-		{
-			if (MOWGLI_LIST_LENGTH(&cptr->recvq) > 1)
-			{
-				mowgli_node_delete(&sq->node, &cptr->recvq);
-				free(sq);
-			}
-			else
-				/* keep one struct sendq */
-				sq->firstused = sq->firstfree = 0;
-		}
-		else
-			return p - buf;
-	}
-	return p - buf;
+	if ((l = recvq_getline_ref(cptr, &line, len)) > 0)
+		memcpy(buf, line, l);
+
+	return l;
 }
 
 void sendqrecvq_free(connection_t *cptr)
@@ -374,20 +436,15 @@ void sendqrecvq_free(connection_t *cptr)
 	mowgli_node_t *nptr, *nptr2;
 	struct sendq *sq;
 
-	MOWGLI_ITER_FOREACH_SAFE(nptr, nptr2, cptr->recvq.head)
-	{
-		sq = nptr->data;
-
-		mowgli_node_delete(&sq->node, &cptr->recvq);
-		free(sq);
-	}
+	free(cptr->recvq);
+	cptr->recvq = NULL;
+	cptr->recvq_start = cptr->recvq_end = 0;
 
 	MOWGLI_ITER_FOREACH_SAFE(nptr, nptr2, cptr->sendq.head)
 	{
 		sq = nptr->data;
 
-		mowgli_node_delete(&sq->node, &cptr->sendq);
-		free(sq);
+		sendq_chunk_delete(sq, &cptr->sendq);
 	}
 }
 
@@ -30,7 +30,7 @@
 unsigned int ca_all = CA_ALL_ALL;
 unsigned int ca_all_enable = CA_ALL_ALL;
 
-static char flags_buf[128];
+static char flags_buf[FLAGS_BUFLEN];
 
 struct flags_table chanacs_flags[256] = {
 	['v'] = {CA_VOICE, 0, true,      "voice"},
@@ -268,11 +268,17 @@ unsigned int flags_to_bitmask(const char *string, unsigned int flags)
 }
 
 char *bitmask_to_flags(unsigned int flags)
+{
+	return bitmask_to_flags_r(flags, flags_buf);
+}
+
+/* as above, into a caller-supplied buffer of FLAGS_BUFLEN bytes */
+char *bitmask_to_flags_r(unsigned int flags, char *buf)
 {
 	char *bptr;
 	unsigned int i = 0;
 
-	bptr = flags_buf;
+	bptr = buf;
 
 	*bptr++ = '+';
 
@@ -282,7 +288,7 @@ char *bitmask_to_flags(unsigned int flags)
 
 	*bptr++ = '\0';
 
-	return flags_buf;
+	return buf;
 }
 
 char *bitmask_to_flags2(unsigned int addflags, unsigned int removeflags)
@@ -431,7 +437,14 @@ const char *xflag_tostr(unsigned int flags)
 
 char *gflags_tostr(gflags_t *gflags, unsigned int flags)
 {
-	static char buf[257];
+	static char buf[FLAGS_BUFLEN];
+
+	return gflags_tostr_r(gflags, flags, buf);
+}
+
+/* as above, into a caller-supplied buffer of FLAGS_BUFLEN bytes */
+char *gflags_tostr_r(gflags_t *gflags, unsigned int flags, char *buf)
+{
 	char *p = buf;
 	int i;
 	*p++ = '+';
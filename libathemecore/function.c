@@ -308,8 +308,10 @@ static void canonicalize_emails(void)
 	{
 		myuser_t *mu = user(mt);
 
+		myuser_email_index_delete(mu);
 		strshare_unref(mu->email_canonical);
 		mu->email_canonical = canonicalize_email(mu->email);
+		myuser_email_index_add(mu);
 	}
 }
 
@@ -376,11 +378,9 @@ void canonicalize_email_case(char email[EMAILLEN + 1], void *user_data)
 bool email_within_limits(const char *email)
 {
 	mowgli_node_t *n;
-	myentity_iteration_state_t state;
-	myentity_t *mt;
-	unsigned int tcnt = 0;
+	mowgli_list_t *l;
 	stringref email_canonical;
-	bool result = true;
+	bool result;
 
 	if (me.maxusers <= 0)
 		return true;
@@ -393,19 +393,8 @@ bool email_within_limits(const char *email)
 
 	email_canonical = canonicalize_email(email);
 
-	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
-	{
-		myuser_t *mu = user(mt);
-
-		if (mu->email_canonical == email_canonical)
-			tcnt++;
-
-		/* optimization: if tcnt >= me.maxusers, quit iterating. -nenolod */
-		if (tcnt >= me.maxusers) {
-			result = false;
-			break;
-		}
-	}
+	l = myuser_find_by_email(email_canonical);
+	result = l == NULL || MOWGLI_LIST_LENGTH(l) < me.maxusers;
 
 	strshare_unref(email_canonical);
 	return result;
@@ -112,13 +112,184 @@ static bool evaluate_condition(sourceinfo_t *si, const char *s)
 		return false;
 }
 
+/*
+ * Parsed help files are kept in memory, keyed by their full path.  A file's
+ * mtime is looked at no more often than every HELP_RECHECK_INTERVAL seconds,
+ * and the whole cache is dropped on rehash.  Files which do not exist are
+ * cached as well, so that the language fallback costs nothing either.
+ */
+#define HELP_RECHECK_INTERVAL	60
+
+typedef enum {
+	HELP_LINE_TEXT,
+	HELP_LINE_IF,
+	HELP_LINE_ELSE,
+	HELP_LINE_ENDIF
+} help_line_type_t;
+
+typedef struct {
+	help_line_type_t type;
+	bool has_nick;		/* contains &nick& */
+	char *text;		/* the condition for HELP_LINE_IF */
+} help_line_t;
+
+typedef struct {
+	bool missing;
+	time_t mtime;
+	time_t checked;
+	size_t nlines;
+	help_line_t *lines;
+} help_file_t;
+
+static mowgli_patricia_t *help_cache = NULL;
+
+static void help_file_free(help_file_t *hf)
+{
+	size_t i;
+
+	for (i = 0; i < hf->nlines; i++)
+		free(hf->lines[i].text);
+
+	free(hf->lines);
+	free(hf);
+}
+
+static void help_cache_free_cb(const char *key, void *data, void *privdata)
+{
+	help_file_free(data);
+}
+
+static void help_cache_flush(void *unused)
+{
+	if (help_cache == NULL)
+		return;
+
+	mowgli_patricia_destroy(help_cache, help_cache_free_cb, NULL);
+	help_cache = mowgli_patricia_create(noopcanon);
+}
+
+static help_file_t *help_file_parse(const char *path)
+{
+	help_file_t *hf;
+	struct stat st;
+	FILE *f;
+	char buf[BUFSIZE];
+	size_t alloc = 0;
+	help_line_t *line;
+
+	hf = scalloc(1, sizeof *hf);
+	hf->checked = CURRTIME;
+
+	if ((f = fopen(path, "r")) == NULL || fstat(fileno(f), &st) < 0)
+	{
+		if (f != NULL)
+			fclose(f);
+		hf->missing = true;
+		return hf;
+	}
+
+	hf->mtime = st.st_mtime;
+
+	while (fgets(buf, BUFSIZE, f))
+	{
+		strip(buf);
+
+		if (hf->nlines == alloc)
+		{
+			alloc = alloc ? alloc * 2 : 32;
+			hf->lines = srealloc(hf->lines, alloc * sizeof *hf->lines);
+		}
+
+		line = &hf->lines[hf->nlines++];
+		line->has_nick = false;
+		line->text = NULL;
+
+		if (!strncmp(buf, "#if", 3))
+		{
+			line->type = HELP_LINE_IF;
+			line->text = sstrdup(buf + 3);
+		}
+		else if (!strncmp(buf, "#endif", 6))
+			line->type = HELP_LINE_ENDIF;
+		else if (!strncmp(buf, "#else", 5))
+			line->type = HELP_LINE_ELSE;
+		else
+		{
+			line->type = HELP_LINE_TEXT;
+			line->has_nick = strstr(buf, "&nick&") != NULL;
+			line->text = sstrdup(buf);
+		}
+	}
+
+	fclose(f);
+
+	return hf;
+}
+
+/*
+ * help_file_get(const char *path)
+ *
+ * Looks up a help file in the cache, loading it if needed.
+ *
+ * Inputs:
+ *       - full path of the help file
+ *
+ * Outputs:
+ *       - the parsed help file, or NULL if it does not exist
+ *
+ * Side Effects:
+ *       - the file may be (re)read and the cache updated
+ */
+static help_file_t *help_file_get(const char *path)
+{
+	help_file_t *hf;
+	struct stat st;
+	bool stale;
+
+	if (help_cache == NULL)
+	{
+		help_cache = mowgli_patricia_create(noopcanon);
+		hook_add_event("config_ready");
+		hook_add_config_ready(help_cache_flush);
+	}
+
+	hf = mowgli_patricia_retrieve(help_cache, path);
+
+	if (hf != NULL && hf->checked + HELP_RECHECK_INTERVAL <= CURRTIME)
+	{
+		hf->checked = CURRTIME;
+
+		if (stat(path, &st) < 0)
+			stale = !hf->missing;
+		else
+			stale = hf->missing || st.st_mtime != hf->mtime;
+
+		if (stale)
+		{
+			mowgli_patricia_delete(help_cache, path);
+			help_file_free(hf);
+			hf = NULL;
+		}
+	}
+
+	if (hf == NULL)
+	{
+		hf = help_file_parse(path);
+		mowgli_patricia_add(help_cache, path, hf);
+	}
+
+	return hf->missing ? NULL : hf;
+}
+
 void help_display_as_subcmd(sourceinfo_t *si, service_t *service, const char *subcmd_of, const char *command, mowgli_patricia_t *list)
 {
 	command_t *c;
-	FILE *help_file = NULL;
+	help_file_t *hf = NULL;
+	help_line_t *line;
 	char subname[BUFSIZE], buf[BUFSIZE];
 	const char *langname = NULL;
 	int ifnest, ifnest_false;
+	size_t i;
 
 
 	char *ccommand = sstrdup(command);
@@ -131,7 +302,7 @@ void help_display_as_subcmd(sourceinfo_t *si, service_t *service, const char *su
 		if (c->help.path)
 		{
 			if (*c->help.path == '/')
-				help_file = fopen(c->help.path, "r");
+				hf = help_file_get(c->help.path);
 			else
 			{
 				mowgli_strlcpy(subname, c->help.path, sizeof subname);
@@ -146,16 +317,16 @@ void help_display_as_subcmd(sourceinfo_t *si, service_t *service, const char *su
 				if (langname != NULL)
 				{
 					snprintf(buf, sizeof buf, "%s/%s/%s", SHAREDIR "/help", langname, subname);
-					help_file = fopen(buf, "r");
+					hf = help_file_get(buf);
 				}
-				if (help_file == NULL)
+				if (hf == NULL)
 				{
 					snprintf(buf, sizeof buf, "%s/%s", SHAREDIR "/help", subname);
-					help_file = fopen(buf, "r");
+					hf = help_file_get(buf);
 				}
 			}
 
-			if (!help_file)
+			if (!hf)
 			{
 				command_fail(si, fault_nosuch_target, _("Could not get help file for \2%s\2."), command);
 				free(ccommand);
@@ -165,43 +336,46 @@ void help_display_as_subcmd(sourceinfo_t *si, service_t *service, const char *su
 			command_success_nodata(si, _("***** \2%s Help\2 *****"), service->nick);
 
 			ifnest = ifnest_false = 0;
-			while (fgets(buf, BUFSIZE, help_file))
+			for (i = 0; i < hf->nlines; i++)
 			{
-				strip(buf);
+				line = &hf->lines[i];
 
-				replace(buf, sizeof(buf), "&nick&", service->disp);
-				if (!strncmp(buf, "#if", 3))
+				switch (line->type)
 				{
-					if (ifnest_false > 0 || !evaluate_condition(si, buf + 3))
+				case HELP_LINE_IF:
+					if (ifnest_false > 0 || !evaluate_condition(si, line->text))
 						ifnest_false++;
 					ifnest++;
 					continue;
-				}
-				else if (!strncmp(buf, "#endif", 6))
-				{
+				case HELP_LINE_ENDIF:
 					if (ifnest_false > 0)
 						ifnest_false--;
 					if (ifnest > 0)
 						ifnest--;
 					continue;
-				}
-				else if (!strncmp(buf, "#else", 5))
-				{
+				case HELP_LINE_ELSE:
 					if (ifnest > 0 && ifnest_false <= 1)
 						ifnest_false ^= 1;
 					continue;
+				default:
+					break;
 				}
+
 				if (ifnest_false > 0)
 					continue;
 
-				if (buf[0])
+				if (line->has_nick)
+				{
+					mowgli_strlcpy(buf, line->text, sizeof buf);
+					replace(buf, sizeof(buf), "&nick&", service->disp);
 					command_success_nodata(si, "%s", buf);
+				}
+				else if (line->text[0])
+					command_success_nodata(si, "%s", line->text);
 				else
 					command_success_nodata(si, " ");
 			}
 
-			fclose(help_file);
-
 			command_success_nodata(si, _("***** \2End of Help\2 *****"));
 		}
 		else if (c->help.func)
@@ -46,6 +46,9 @@ typedef struct {
 
 static mowgli_list_t hook_run_stack = { NULL, NULL, 0 };
 
+#define HOOK_HANDLE_DEFINE(name) hook_t *hook_handle_##name;
+HOOK_HANDLES(HOOK_HANDLE_DEFINE)
+
 void hooks_init(void)
 {
 	hooks = mowgli_patricia_create(strcasecanon);
@@ -57,6 +60,9 @@ void hooks_init(void)
 		slog(LG_INFO, "hooks_init(): block allocator failed.");
 		exit(EXIT_SUCCESS);
 	}
+
+#define HOOK_HANDLE_RESOLVE(name) hook_handle_##name = hook_add_event(#name);
+	HOOK_HANDLES(HOOK_HANDLE_RESOLVE)
 }
 
 static inline hook_t *hook_find(const char *name)
@@ -85,6 +91,7 @@ static inline void hook_destroy(hook_t *hook, hook_privfn_ctx_t *priv)
 	mowgli_heap_free(hook_privfn_heap, priv);
 }
 
+/* the hook_t itself is kept, as handles to it may be held anywhere */
 void hook_del_event(const char *name)
 {
 	hook_t *h;
@@ -95,16 +102,10 @@ void hook_del_event(const char *name)
 
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, h->hooks.head)
 		hook_destroy(h, n->data);
-
-	mowgli_patricia_delete(hooks, h->name);
-	strshare_unref(h->name);
-
-	mowgli_heap_free(hook_heap, h);
 }
 
 void hook_del_hook(const char *event, hookfn_t handler)
 {
-	mowgli_node_t *n, *n2;
 	hook_t *h;
 
 	return_if_fail(event != NULL);
@@ -114,6 +115,16 @@ void hook_del_hook(const char *event, hookfn_t handler)
 	if (h == NULL)
 		return;
 
+	hook_del_hook_handle(h, handler);
+}
+
+void hook_del_hook_handle(hook_t *h, hookfn_t handler)
+{
+	mowgli_node_t *n, *n2;
+
+	return_if_fail(h != NULL);
+	return_if_fail(handler != NULL);
+
 	MOWGLI_ITER_FOREACH_SAFE(n, n2, h->hooks.head)
 	{
 		hook_privfn_ctx_t *priv = n->data;
@@ -142,45 +153,51 @@ static inline hook_privfn_ctx_t *hook_create_and_add(hook_t *hook, hookfn_t hand
 
 void hook_add_hook(const char *event, hookfn_t handler)
 {
-	hook_t *h;
-	hook_privfn_ctx_t *priv;
-
 	return_if_fail(event != NULL);
 	return_if_fail(handler != NULL);
 
-	h = hook_find(event);
-	if (h == NULL)
-		h = hook_add_event(event);
+	hook_create_and_add(hook_add_event(event), handler, mowgli_node_add);
+}
 
+void hook_add_hook_handle(hook_t *h, hookfn_t handler)
+{
 	hook_create_and_add(h, handler, mowgli_node_add);
 }
 
 void hook_add_hook_first(const char *event, hookfn_t handler)
 {
-	hook_t *h;
-
 	return_if_fail(event != NULL);
 	return_if_fail(handler != NULL);
 
-	h = hook_find(event);
-	if (h == NULL)
-		h = hook_add_event(event);
+	hook_create_and_add(hook_add_event(event), handler, mowgli_node_add_head);
+}
 
+void hook_add_hook_first_handle(hook_t *h, hookfn_t handler)
+{
 	hook_create_and_add(h, handler, mowgli_node_add_head);
 }
 
 void hook_call_event(const char *event, void *dptr)
 {
-	hook_run_ctx_t ctx;
-	mowgli_node_t *n, *tn;
-	void (*func)(void *data);
+	hook_t *h;
 
 	return_if_fail(event != NULL);
 
-	ctx.hook = hook_find(event);
-	if (ctx.hook == NULL)
+	h = hook_find(event);
+	if (h == NULL)
 		return;
 
+	hook_call_handle(h, dptr);
+}
+
+void hook_dispatch(hook_t *hook, void *dptr)
+{
+	hook_run_ctx_t ctx;
+	mowgli_node_t *n, *tn;
+
+	return_if_fail(hook != NULL);
+
+	ctx.hook = hook;
 	ctx.dptr = dptr;
 	ctx.flags = HF_RUN;
 
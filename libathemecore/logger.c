@@ -24,11 +24,365 @@
 
 #include "atheme.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 static logfile_t *log_file;
 int log_force;
 
 static mowgli_list_t log_files = { NULL, NULL, 0 };
 
+/* until the master log is open, errors and info go to stderr */
+unsigned int log_enabled_mask = LG_ERROR | LG_INFO;
+
+static void log_update_enabled_mask(void)
+{
+	mowgli_node_t *n;
+	unsigned int mask = log_file != NULL ? 0 : LG_ERROR | LG_INFO;
+
+	MOWGLI_ITER_FOREACH(n, log_files.head)
+	{
+		logfile_t *lf = n->data;
+
+		mask |= lf->log_mask;
+	}
+
+	log_enabled_mask = mask;
+}
+
+/*
+ * log_timestamp(void)
+ *
+ * Returns the current time formatted for log lines, reformatting it
+ * at most once per second.
+ */
+static const char *log_timestamp(void)
+{
+	static char datetime[64];
+	static time_t last;
+	time_t t;
+
+	time(&t);
+	if (t != last || datetime[0] == '\0')
+	{
+		struct tm tm = *localtime(&t);
+
+		strftime(datetime, sizeof datetime, "[%Y-%m-%d %H:%M:%S]", &tm);
+		last = t;
+	}
+
+	return datetime;
+}
+
+/*
+ * Buffered log sink.  Lines are appended to buf and written out with a
+ * single write(2) once the buffer fills or flush_interval seconds pass.
+ * With a writer thread, a full buffer is swapped with wbuf and the thread
+ * writes it while the event loop keeps appending to the other one; the
+ * event loop only ever touches buf, the thread only ever touches wbuf.
+ */
+struct logbuf_ {
+	int fd;
+	char *buf;
+	size_t len;
+	size_t size;
+	unsigned int flush_interval;
+	time_t last_flush;
+
+	bool threaded;
+#ifdef HAVE_PTHREAD
+	char *wbuf;
+	size_t wlen;
+	bool stopping;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+#endif
+};
+
+static mowgli_eventloop_timer_t *log_flush_timer = NULL;
+
+static void logbuf_write_fd(int fd, const char *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len > 0)
+	{
+		ret = write(fd, buf, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		/* nowhere to report this; drop the data */
+		if (ret <= 0)
+			return;
+		buf += ret;
+		len -= ret;
+	}
+}
+
+#ifdef HAVE_PTHREAD
+static void *logbuf_writer_main(void *arg)
+{
+	struct logbuf_ *lb = arg;
+
+	(void) pthread_mutex_lock(&lb->lock);
+	for (;;)
+	{
+		while (lb->wlen == 0 && !lb->stopping)
+			(void) pthread_cond_wait(&lb->cond, &lb->lock);
+		if (lb->wlen == 0)
+			break;
+
+		(void) pthread_mutex_unlock(&lb->lock);
+		logbuf_write_fd(lb->fd, lb->wbuf, lb->wlen);
+		(void) pthread_mutex_lock(&lb->lock);
+
+		lb->wlen = 0;
+		(void) pthread_cond_broadcast(&lb->cond);
+	}
+	(void) pthread_mutex_unlock(&lb->lock);
+
+	return NULL;
+}
+
+/* a forked child must neither wait for the parent's writer nor repeat its pending lines */
+static void logbuf_atfork_child(void)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, log_files.head)
+	{
+		logfile_t *lf = n->data;
+
+		if (lf->log_buf == NULL)
+			continue;
+
+		lf->log_buf->len = 0;
+		lf->log_buf->threaded = false;
+	}
+}
+#endif
+
+static void logbuf_flush(struct logbuf_ *lb)
+{
+	lb->last_flush = CURRTIME;
+
+	if (lb->len == 0)
+		return;
+
+	if (!lb->threaded)
+	{
+		logbuf_write_fd(lb->fd, lb->buf, lb->len);
+		lb->len = 0;
+		return;
+	}
+
+#ifdef HAVE_PTHREAD
+	char *tmp;
+
+	(void) pthread_mutex_lock(&lb->lock);
+	while (lb->wlen != 0)
+		(void) pthread_cond_wait(&lb->cond, &lb->lock);
+
+	tmp = lb->wbuf;
+	lb->wbuf = lb->buf;
+	lb->wlen = lb->len;
+	lb->buf = tmp;
+	lb->len = 0;
+
+	(void) pthread_cond_signal(&lb->cond);
+	(void) pthread_mutex_unlock(&lb->lock);
+#endif
+}
+
+static void logbuf_append(struct logbuf_ *lb, const char *line, size_t len)
+{
+	if (lb->len + len > lb->size)
+		logbuf_flush(lb);
+
+	if (len > lb->size)
+	{
+		logbuf_write_fd(lb->fd, line, len);
+		return;
+	}
+
+	memcpy(lb->buf + lb->len, line, len);
+	lb->len += len;
+
+	if (lb->len == lb->size || lb->last_flush + lb->flush_interval <= CURRTIME)
+		logbuf_flush(lb);
+}
+
+static void logbuf_destroy(struct logbuf_ *lb)
+{
+	logbuf_flush(lb);
+
+#ifdef HAVE_PTHREAD
+	if (lb->threaded)
+	{
+		(void) pthread_mutex_lock(&lb->lock);
+		lb->stopping = true;
+		(void) pthread_cond_signal(&lb->cond);
+		(void) pthread_mutex_unlock(&lb->lock);
+
+		(void) pthread_join(lb->thread, NULL);
+		(void) pthread_mutex_destroy(&lb->lock);
+		(void) pthread_cond_destroy(&lb->cond);
+	}
+	free(lb->wbuf);
+#endif
+
+	free(lb->buf);
+	free(lb);
+}
+
+static void log_flush_timer_cb(void *unused)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, log_files.head)
+	{
+		logfile_t *lf = n->data;
+
+		if (lf->log_buf != NULL && lf->log_buf->last_flush + lf->log_buf->flush_interval <= CURRTIME)
+			logbuf_flush(lf->log_buf);
+	}
+}
+
+/*
+ * logfile_set_buffer(logfile_t *lf, size_t size, unsigned int flush_interval,
+ *                    bool threaded)
+ *
+ * Makes a file logfile collect lines in memory and write them out when
+ * size bytes are pending or flush_interval seconds have passed, optionally
+ * from a dedicated writer thread.
+ *
+ * Inputs:
+ *       - logfile to buffer, buffer size in bytes, flush interval in seconds
+ *         and whether to write from a background thread
+ *
+ * Outputs:
+ *       - true if the logfile is now buffered, false otherwise
+ *
+ * Side Effects:
+ *       - a writer thread may be started.
+ */
+bool logfile_set_buffer(logfile_t *lf, size_t size, unsigned int flush_interval, bool threaded)
+{
+	struct logbuf_ *lb;
+
+	return_val_if_fail(lf != NULL, false);
+
+	if (lf->log_buf != NULL || size == 0 || lf->log_type != LOG_NONINTERACTIVE || lf->log_file == NULL)
+		return false;
+
+	lb = scalloc(sizeof(struct logbuf_), 1);
+	lb->fd = fileno((FILE *) lf->log_file);
+	lb->size = size;
+	lb->buf = smalloc(size);
+	lb->flush_interval = flush_interval;
+	lb->last_flush = CURRTIME;
+
+#ifdef HAVE_PTHREAD
+	/* unthreaded buffers need this too, or the save child repeats their lines */
+	static bool atfork_registered = false;
+
+	if (!atfork_registered)
+	{
+		(void) pthread_atfork(NULL, NULL, logbuf_atfork_child);
+		atfork_registered = true;
+	}
+
+	if (threaded)
+	{
+		lb->wbuf = smalloc(size);
+		(void) pthread_mutex_init(&lb->lock, NULL);
+		(void) pthread_cond_init(&lb->cond, NULL);
+
+		if (pthread_create(&lb->thread, NULL, logbuf_writer_main, lb) == 0)
+			lb->threaded = true;
+		else
+		{
+			(void) pthread_mutex_destroy(&lb->lock);
+			(void) pthread_cond_destroy(&lb->cond);
+		}
+	}
+#endif
+
+	/* whatever stdio still holds must land before our first write(2) */
+	fflush((FILE *) lf->log_file);
+	lf->log_buf = lb;
+
+	if (log_flush_timer == NULL && base_eventloop != NULL)
+		log_flush_timer = mowgli_timer_add(base_eventloop, "log_flush", log_flush_timer_cb, NULL, 1);
+
+	return true;
+}
+
+/*
+ * log_flush(void)
+ *
+ * Writes out every buffered logfile.
+ *
+ * Inputs:
+ *       - none
+ *
+ * Outputs:
+ *       - none
+ *
+ * Side Effects:
+ *       - pending log lines are handed to write(2) or the writer threads.
+ */
+void log_flush(void)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, log_files.head)
+	{
+		logfile_t *lf = n->data;
+
+		if (lf->log_buf != NULL)
+			logbuf_flush(lf->log_buf);
+	}
+}
+
+/*
+ * log_flush_crash(void)
+ *
+ * Best-effort flush of every buffered logfile from a fatal signal handler.
+ * Takes no locks and only calls write(2).
+ *
+ * Inputs:
+ *       - none
+ *
+ * Outputs:
+ *       - none
+ *
+ * Side Effects:
+ *       - pending log lines are written synchronously.
+ */
+void log_flush_crash(void)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, log_files.head)
+	{
+		logfile_t *lf = n->data;
+		struct logbuf_ *lb = lf->log_buf;
+
+		if (lb == NULL)
+			continue;
+
+#ifdef HAVE_PTHREAD
+		/* may duplicate a chunk the writer was halfway through */
+		if (lb->threaded && lb->wlen != 0)
+			logbuf_write_fd(lb->fd, lb->wbuf, lb->wlen);
+#endif
+		logbuf_write_fd(lb->fd, lb->buf, lb->len);
+		lb->len = 0;
+	}
+}
+
 /* private destructor function for logfile_t. */
 static void logfile_delete_file(void *vdata)
 {
@@ -36,6 +390,8 @@ static void logfile_delete_file(void *vdata)
 
 	logfile_unregister(lf);
 
+	if (lf->log_buf != NULL)
+		logbuf_destroy(lf->log_buf);
 	fclose(lf->log_file);
 	free(lf->log_path);
 	metadata_delete_all(lf);
@@ -187,19 +543,29 @@ logfile_strip_control_codes(const char *buf)
  */
 static void logfile_write(logfile_t *lf, const char *buf)
 {
-	char datetime[BUFSIZE];
-	time_t t;
-	struct tm tm;
-
 	return_if_fail(lf != NULL);
 	return_if_fail(lf->log_file != NULL);
 	return_if_fail(buf != NULL);
 
-	time(&t);
-	tm = *localtime(&t);
-	strftime(datetime, sizeof datetime, "[%Y-%m-%d %H:%M:%S]", &tm);
+	if (lf->log_buf != NULL)
+	{
+		char line[BUFSIZE * 2];
+		int len;
 
-	fprintf((FILE *) lf->log_file, "%s %s\n", datetime, logfile_strip_control_codes(buf));
+		len = snprintf(line, sizeof line, "%s %s\n", log_timestamp(), logfile_strip_control_codes(buf));
+		if (len < 0)
+			return;
+		if ((size_t) len >= sizeof line)
+		{
+			len = sizeof line - 1;
+			line[len - 1] = '\n';
+		}
+
+		logbuf_append(lf->log_buf, line, len);
+		return;
+	}
+
+	fprintf((FILE *) lf->log_file, "%s %s\n", log_timestamp(), logfile_strip_control_codes(buf));
 	fflush((FILE *) lf->log_file);
 }
 
@@ -312,6 +678,7 @@ static void logfile_write_snotices(logfile_t *lf, const char *buf)
 void logfile_register(logfile_t *lf)
 {
 	mowgli_node_add(lf, &lf->node, &log_files);
+	log_update_enabled_mask();
 }
 
 /*
@@ -331,6 +698,7 @@ void logfile_register(logfile_t *lf)
 void logfile_unregister(logfile_t *lf)
 {
 	mowgli_node_delete(&lf->node, &log_files);
+	log_update_enabled_mask();
 }
 
 /*
@@ -437,6 +805,7 @@ logfile_t *logfile_new(const char *path, unsigned int log_mask)
 void log_open(void)
 {
 	log_file = logfile_new(log_path, LG_ERROR | LG_INFO | LG_CMD_ADMIN);
+	log_update_enabled_mask();
 }
 
 /*
@@ -477,18 +846,7 @@ void log_shutdown(void)
  */
 bool log_debug_enabled(void)
 {
-	mowgli_node_t *n;
-	logfile_t *lf;
-
-	if (log_force)
-		return true;
-	MOWGLI_ITER_FOREACH(n, log_files.head)
-	{
-		lf = n->data;
-		if (lf->log_mask & (LG_DEBUG | LG_RAWDATA))
-			return true;
-	}
-	return false;
+	return log_level_enabled(LG_DEBUG | LG_RAWDATA);
 }
 
 /*
@@ -511,6 +869,7 @@ void log_master_set_mask(unsigned int mask)
 	if (log_file == NULL)
 		return;
 	log_file->log_mask = mask;
+	log_update_enabled_mask();
 }
 
 /*
@@ -558,20 +917,19 @@ static void vslog_ext(log_type_t type, unsigned int level, const char *fmt,
 {
 	static bool in_slog = false;
 	char buf[BUFSIZE];
+	bool formatted = false;
 	mowgli_node_t *n;
-	char datetime[BUFSIZE];
-	time_t t;
-	struct tm tm;
 
-	if (in_slog)
+	if (!log_level_enabled(level))
 		return;
-	in_slog = true;
 
-	vsnprintf(buf, BUFSIZE, fmt, args);
+	/* log streams belong to the event loop */
+	if (crypt_in_worker())
+		return;
 
-	time(&t);
-	tm = *localtime(&t);
-	strftime(datetime, sizeof datetime, "[%Y-%m-%d %H:%M:%S]", &tm);
+	if (in_slog)
+		return;
+	in_slog = true;
 
 	MOWGLI_ITER_FOREACH(n, log_files.head)
 	{
@@ -584,6 +942,12 @@ static void vslog_ext(log_type_t type, unsigned int level, const char *fmt,
 
 		return_if_fail(lf->write_func != NULL);
 
+		if (!formatted)
+		{
+			vsnprintf(buf, BUFSIZE, fmt, args);
+			formatted = true;
+		}
+
 		lf->write_func(lf, buf);
 	}
 
@@ -594,7 +958,12 @@ static void vslog_ext(log_type_t type, unsigned int level, const char *fmt,
 	if (type != LOG_INTERACTIVE && ((runflags & (RF_LIVE | RF_STARTING) &&
 		(log_file != NULL ? log_file->log_mask : LG_ERROR | LG_INFO) & level) ||
 		(runflags & RF_LIVE && log_force)))
-		fprintf(stderr, "%s %s\n", datetime, logfile_strip_control_codes(buf));
+	{
+		if (!formatted)
+			vsnprintf(buf, BUFSIZE, fmt, args);
+
+		fprintf(stderr, "%s %s\n", log_timestamp(), logfile_strip_control_codes(buf));
+	}
 
 	in_slog = false;
 }
@@ -627,7 +996,7 @@ static PRINTFLIKE(3, 4) void slog_ext(log_type_t type, unsigned int level,
  * Side Effects:
  *       - logfiles are updated depending on how they are configured.
  */
-void slog(unsigned int level, const char *fmt, ...)
+void (slog)(unsigned int level, const char *fmt, ...)
 {
 	va_list args;
 
@@ -586,6 +586,22 @@ enum atheme_regex_type
 	at_pcre = 2
 };
 
+#ifdef HAVE_PCRE
+/*
+ * Patterns are studied, and JIT compiled where libpcre supports it, since
+ * RWATCH and RMATCH run them against every user.  Every pattern also gets
+ * a match limit so that a pathological one cannot stall services.
+ */
+#define REGEX_MATCH_LIMIT		100000
+#define REGEX_MATCH_LIMIT_RECURSION	5000
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+# define REGEX_STUDY_FLAGS	PCRE_STUDY_JIT_COMPILE
+#else
+# define REGEX_STUDY_FLAGS	0
+#endif
+#endif
+
 struct atheme_regex_
 {
 	enum atheme_regex_type type;
@@ -593,7 +609,12 @@ struct atheme_regex_
 	{
 		regex_t posix;
 #ifdef HAVE_PCRE
-		pcre *pcre;
+		struct
+		{
+			pcre *re;
+			pcre_extra *extra;
+			bool extra_owned;	/* allocated here, not by pcre_study() */
+		} pcre;
 #endif
 	} un;
 };
@@ -620,14 +641,31 @@ atheme_regex_t *regex_create(char *pattern, int flags)
 		const char *errptr;
 		int erroffset;
 
-		preg->un.pcre = pcre_compile(pattern, (flags & AREGEX_ICASE ? PCRE_CASELESS : 0) | PCRE_NO_AUTO_CAPTURE, &errptr, &erroffset, NULL);
-		if (preg->un.pcre == NULL)
+		preg->un.pcre.re = pcre_compile(pattern, (flags & AREGEX_ICASE ? PCRE_CASELESS : 0) | PCRE_NO_AUTO_CAPTURE, &errptr, &erroffset, NULL);
+		if (preg->un.pcre.re == NULL)
 		{
 			slog(LG_ERROR, "regex_match(): %s at offset %d in %s",
 					errptr, erroffset, pattern);
 			free(preg);
 			return NULL;
 		}
+
+		errptr = NULL;
+		preg->un.pcre.extra = pcre_study(preg->un.pcre.re, REGEX_STUDY_FLAGS, &errptr);
+		if (errptr != NULL)
+			slog(LG_DEBUG, "regex_create(): could not study %s: %s", pattern, errptr);
+
+		/* pcre_study() returns NULL if it found nothing to speed up */
+		if (preg->un.pcre.extra == NULL)
+		{
+			preg->un.pcre.extra = scalloc(1, sizeof(pcre_extra));
+			preg->un.pcre.extra_owned = true;
+		}
+
+		preg->un.pcre.extra->flags |= PCRE_EXTRA_MATCH_LIMIT | PCRE_EXTRA_MATCH_LIMIT_RECURSION;
+		preg->un.pcre.extra->match_limit = REGEX_MATCH_LIMIT;
+		preg->un.pcre.extra->match_limit_recursion = REGEX_MATCH_LIMIT_RECURSION;
+
 		preg->type = at_pcre;
 #else
 		slog(LG_ERROR, "regex_match(): PCRE support is not compiled in");
@@ -699,6 +737,27 @@ char *regex_extract(char *pattern, char **pend, int *pflags)
  */
 bool regex_match(atheme_regex_t *preg, char *string)
 {
+	if (string == NULL)
+	{
+		slog(LG_ERROR, "regex_match(): we were given NULL string or pattern, bad!");
+		return false;
+	}
+
+	return regex_match_len(preg, string, strlen(string));
+}
+
+/*
+ * regex_match_len()
+ *  Like regex_match(), for callers that already know the length of
+ *  `string', which must still be NUL terminated for POSIX regexes.
+ *  A PCRE pattern that hits its match limit does not match.
+ */
+bool regex_match_len(atheme_regex_t *preg, const char *string, size_t len)
+{
+#ifdef HAVE_PCRE
+	int ret;
+#endif
+
 	if (preg == NULL || string == NULL)
 	{
 		slog(LG_ERROR, "regex_match(): we were given NULL string or pattern, bad!");
@@ -711,7 +770,10 @@ bool regex_match(atheme_regex_t *preg, char *string)
 			return regexec(&preg->un.posix, string, 0, NULL, 0) == 0;
 #ifdef HAVE_PCRE
 		case at_pcre:
-			return pcre_exec(preg->un.pcre, NULL, string, strlen(string), 0, 0, NULL, 0) >= 0;
+			ret = pcre_exec(preg->un.pcre.re, preg->un.pcre.extra, string, len, 0, 0, NULL, 0);
+			if (ret == PCRE_ERROR_MATCHLIMIT || ret == PCRE_ERROR_RECURSIONLIMIT)
+				slog(LG_DEBUG, "regex_match(): match limit reached on %s", string);
+			return ret >= 0;
 #endif
 		default:
 			slog(LG_ERROR, "regex_match(): we were given a pattern of unknown type %d, bad!", preg->type);
@@ -732,7 +794,15 @@ bool regex_destroy(atheme_regex_t *preg)
 			break;
 #ifdef HAVE_PCRE
 		case at_pcre:
-			pcre_free(preg->un.pcre);
+			if (preg->un.pcre.extra_owned)
+				free(preg->un.pcre.extra);
+			else
+#ifdef PCRE_STUDY_JIT_COMPILE
+				pcre_free_study(preg->un.pcre.extra);
+#else
+				pcre_free(preg->un.pcre.extra);
+#endif
+			pcre_free(preg->un.pcre.re);
 			break;
 #endif
 		default:
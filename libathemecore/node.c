@@ -36,6 +36,43 @@ mowgli_heap_t *zline_heap;	/* 16 */
 mowgli_heap_t *xline_heap;	/* 16 */
 mowgli_heap_t *qline_heap;	/* 16 */
 
+/*
+ * Klines and zlines are indexed by host so that checking a connecting
+ * user does not mean calling match() on every entry:
+ *  - masks without wildcards are kept in buckets keyed on the mask,
+ *  - valid CIDR masks are additionally kept in buckets keyed on the
+ *    masked prefix, one lookup per prefix length in use,
+ *  - everything else is on a residual list that is still scanned.
+ */
+typedef struct {
+	mowgli_patricia_t *exact;
+	mowgli_patricia_t *cidr;
+	unsigned int cidr_lens[2][129];
+	mowgli_list_t wild;
+	unsigned long seq;
+} hostmask_index_t;
+
+static hostmask_index_t kline_index;
+static hostmask_index_t zline_index;
+
+static mowgli_patricia_t *kline_ids;
+static mowgli_patricia_t *zline_ids;
+
+/*
+ * Timed bans are also kept in a binary min-heap on their expiry time, so
+ * the periodic expiry checks only look at entries that have expired.
+ */
+typedef struct {
+	expiry_node_t **heap;
+	unsigned int count;
+	unsigned int size;
+} expiry_queue_t;
+
+static expiry_queue_t kline_expiry;
+static expiry_queue_t zline_expiry;
+static expiry_queue_t xline_expiry;
+static expiry_queue_t qline_expiry;
+
 /*************
  * L I S T S *
  *************/
@@ -53,6 +90,13 @@ void init_nodes(void)
 		exit(EXIT_FAILURE);
 	}
 
+	kline_index.exact = mowgli_patricia_create(irccasecanon);
+	kline_index.cidr = mowgli_patricia_create(NULL);
+	zline_index.exact = mowgli_patricia_create(irccasecanon);
+	zline_index.cidr = mowgli_patricia_create(NULL);
+	kline_ids = mowgli_patricia_create(NULL);
+	zline_ids = mowgli_patricia_create(NULL);
+
 	init_uplinks();
 	init_servers();
 	init_metadata();
@@ -119,20 +163,357 @@ void remove_illegals()
 	}
 }
 
+/*****************************
+ * E X P I R Y   Q U E U E S *
+ *****************************/
+
+static inline void expiry_queue_set(expiry_queue_t *q, unsigned int slot, expiry_node_t *en)
+{
+	q->heap[slot - 1] = en;
+	en->slot = slot;
+}
+
+static void expiry_queue_sift_up(expiry_queue_t *q, unsigned int slot)
+{
+	expiry_node_t *en = q->heap[slot - 1];
+
+	while (slot > 1 && q->heap[slot / 2 - 1]->expires > en->expires)
+	{
+		expiry_queue_set(q, slot, q->heap[slot / 2 - 1]);
+		slot /= 2;
+	}
+
+	expiry_queue_set(q, slot, en);
+}
+
+static void expiry_queue_sift_down(expiry_queue_t *q, unsigned int slot)
+{
+	expiry_node_t *en = q->heap[slot - 1];
+	unsigned int child;
+
+	while ((child = slot * 2) <= q->count)
+	{
+		if (child < q->count && q->heap[child]->expires < q->heap[child - 1]->expires)
+			child++;
+		if (q->heap[child - 1]->expires >= en->expires)
+			break;
+
+		expiry_queue_set(q, slot, q->heap[child - 1]);
+		slot = child;
+	}
+
+	expiry_queue_set(q, slot, en);
+}
+
+static void expiry_queue_delete(expiry_queue_t *q, expiry_node_t *en)
+{
+	unsigned int slot = en->slot;
+	expiry_node_t *last;
+
+	if (slot == 0)
+		return;
+
+	en->slot = 0;
+	last = q->heap[--q->count];
+	if (last == en)
+		return;
+
+	expiry_queue_set(q, slot, last);
+	expiry_queue_sift_up(q, slot);
+	expiry_queue_sift_down(q, last->slot);
+}
+
+/* (re)queues an entry; permanent entries (duration 0) are never queued */
+static void expiry_queue_update(expiry_queue_t *q, expiry_node_t *en, void *owner, long duration, time_t expires)
+{
+	expiry_queue_delete(q, en);
+
+	if (duration == 0)
+		return;
+
+	if (q->count == q->size)
+	{
+		q->size = q->size != 0 ? q->size * 2 : 64;
+		q->heap = srealloc(q->heap, q->size * sizeof(expiry_node_t *));
+	}
+
+	en->owner = owner;
+	en->expires = expires;
+	expiry_queue_set(q, ++q->count, en);
+	expiry_queue_sift_up(q, q->count);
+}
+
+/* returns the entry expiring first if it has expired by now */
+static void *expiry_queue_next(expiry_queue_t *q, time_t now)
+{
+	if (q->count == 0 || q->heap[0]->expires > now)
+		return NULL;
+
+	return q->heap[0]->owner;
+}
+
+/*************************
+ * H O S T   I N D E X E S *
+ *************************/
+
+/* the characters match() treats specially */
+static inline bool hostmask_is_literal(const char *mask)
+{
+	return strpbrk(mask, "*?&#%\\") == NULL;
+}
+
+static void hostmask_cidr_key(char *buf, size_t size, int family, const unsigned char *addr, unsigned int bits)
+{
+	unsigned int i, nbytes = (bits + 7) / 8;
+	size_t len;
+
+	len = snprintf(buf, size, "%d/%u/", family, bits);
+	for (i = 0; i < nbytes && len + 2 < size; i++)
+	{
+		unsigned char c = addr[i];
+
+		if (i == nbytes - 1 && bits % 8 != 0)
+			c &= 0xff << (8 - bits % 8);
+
+		len += snprintf(buf + len, size - len, "%02x", c);
+	}
+}
+
+static void hostmask_bucket_add(mowgli_patricia_t *tree, const char *key, hostmask_index_node_t *in, mowgli_node_t *n)
+{
+	mowgli_list_t *l;
+
+	if ((l = mowgli_patricia_retrieve(tree, key)) == NULL)
+	{
+		l = mowgli_list_create();
+		mowgli_patricia_add(tree, key, l);
+	}
+
+	mowgli_node_add(in, n, l);
+}
+
+static void hostmask_bucket_delete(mowgli_patricia_t *tree, const char *key, mowgli_node_t *n)
+{
+	mowgli_list_t *l;
+
+	if ((l = mowgli_patricia_retrieve(tree, key)) == NULL)
+		return;
+
+	mowgli_node_delete(n, l);
+
+	if (MOWGLI_LIST_LENGTH(l) == 0)
+	{
+		mowgli_patricia_delete(tree, key);
+		mowgli_list_free(l);
+	}
+}
+
+static void hostmask_index_add(hostmask_index_t *hi, hostmask_index_node_t *in, void *owner, const char *mask)
+{
+	unsigned char addr[16];
+	unsigned int bits;
+	int family;
+	char key[64];
+
+	in->owner = owner;
+	in->mask = mask;
+	in->seq = ++hi->seq;
+
+	if (!hostmask_is_literal(mask))
+	{
+		mowgli_node_add(in, &in->hnode, &hi->wild);
+		return;
+	}
+
+	hostmask_bucket_add(hi->exact, mask, in, &in->hnode);
+
+	if ((family = parse_cidr(mask, addr, &bits)) != 0)
+	{
+		hostmask_cidr_key(key, sizeof key, family, addr, bits);
+		hostmask_bucket_add(hi->cidr, key, in, &in->cnode);
+		hi->cidr_lens[family == 6][bits]++;
+	}
+}
+
+static void hostmask_index_delete(hostmask_index_t *hi, hostmask_index_node_t *in)
+{
+	unsigned char addr[16];
+	unsigned int bits;
+	int family;
+	char key[64];
+
+	if (!hostmask_is_literal(in->mask))
+	{
+		mowgli_node_delete(&in->hnode, &hi->wild);
+		return;
+	}
+
+	hostmask_bucket_delete(hi->exact, in->mask, &in->hnode);
+
+	if ((family = parse_cidr(in->mask, addr, &bits)) != 0)
+	{
+		hostmask_cidr_key(key, sizeof key, family, addr, bits);
+		hostmask_bucket_delete(hi->cidr, key, &in->cnode);
+		hi->cidr_lens[family == 6][bits]--;
+	}
+}
+
+/* buckets are in insertion order, so only their first acceptable entry matters */
+static hostmask_index_node_t *hostmask_bucket_find(mowgli_list_t *l, hostmask_index_node_t *best, bool (*accept)(void *owner, void *arg), void *arg)
+{
+	mowgli_node_t *n;
+
+	if (l == NULL)
+		return best;
+
+	MOWGLI_ITER_FOREACH(n, l->head)
+	{
+		hostmask_index_node_t *in = n->data;
+
+		if (best != NULL && in->seq >= best->seq)
+			break;
+		if (accept(in->owner, arg))
+			return in;
+	}
+
+	return best;
+}
+
+/*
+ * Returns the oldest entry whose mask matches host or ip, using match()
+ * semantics, and, if cidr is set, the oldest whose mask matches ip using
+ * match_ips() semantics.  ip may be NULL.
+ */
+static void *hostmask_index_find(hostmask_index_t *hi, const char *host, const char *ip, bool cidr, bool (*accept)(void *owner, void *arg), void *arg)
+{
+	hostmask_index_node_t *best = NULL;
+	mowgli_node_t *n;
+	unsigned char addr[16];
+	unsigned int bits;
+	int family;
+	char key[64];
+
+	best = hostmask_bucket_find(mowgli_patricia_retrieve(hi->exact, host), best, accept, arg);
+
+	if (ip != NULL)
+	{
+		best = hostmask_bucket_find(mowgli_patricia_retrieve(hi->exact, ip), best, accept, arg);
+
+		if (cidr && (family = parse_ip(ip, addr)) != 0)
+		{
+			unsigned int *lens = hi->cidr_lens[family == 6];
+
+			for (bits = 1; bits <= (family == 6 ? 128U : 32U); bits++)
+			{
+				if (lens[bits] == 0)
+					continue;
+
+				hostmask_cidr_key(key, sizeof key, family, addr, bits);
+				best = hostmask_bucket_find(mowgli_patricia_retrieve(hi->cidr, key), best, accept, arg);
+			}
+		}
+	}
+
+	MOWGLI_ITER_FOREACH(n, hi->wild.head)
+	{
+		hostmask_index_node_t *in = n->data;
+
+		if (best != NULL && in->seq >= best->seq)
+			break;
+		if ((!match(in->mask, host) || (ip != NULL && !match(in->mask, ip))) && accept(in->owner, arg))
+		{
+			best = in;
+			break;
+		}
+	}
+
+	return best != NULL ? best->owner : NULL;
+}
+
+/*
+ * Each id maps to a chain of the entries carrying it, in insertion order,
+ * so duplicate ids resolve to the oldest entry as the list walk did and a
+ * delete never has to look for a replacement.
+ */
+static void hostmask_id_add(mowgli_patricia_t *ids, unsigned long number, mowgli_node_t *n, void *owner)
+{
+	mowgli_list_t *chain;
+	char key[32];
+
+	snprintf(key, sizeof key, "%lu", number);
+
+	if ((chain = mowgli_patricia_retrieve(ids, key)) == NULL)
+	{
+		chain = mowgli_list_create();
+		mowgli_patricia_add(ids, key, chain);
+	}
+
+	mowgli_node_add(owner, n, chain);
+}
+
+static void hostmask_id_delete(mowgli_patricia_t *ids, unsigned long number, mowgli_node_t *n)
+{
+	mowgli_list_t *chain;
+	char key[32];
+
+	snprintf(key, sizeof key, "%lu", number);
+
+	if ((chain = mowgli_patricia_retrieve(ids, key)) == NULL)
+		return;
+
+	mowgli_node_delete(n, chain);
+
+	if (MOWGLI_LIST_LENGTH(chain) == 0)
+	{
+		mowgli_patricia_delete(ids, key);
+		mowgli_list_free(chain);
+	}
+}
+
+static void *hostmask_id_find(mowgli_patricia_t *ids, unsigned long number)
+{
+	mowgli_list_t *chain;
+	char key[32];
+
+	snprintf(key, sizeof key, "%lu", number);
+
+	if ((chain = mowgli_patricia_retrieve(ids, key)) == NULL)
+		return NULL;
+
+	return chain->head->data;
+}
+
 /*************
  * K L I N E *
  *************/
 
+static bool kline_match_user(void *owner, void *arg)
+{
+	kline_t *k = owner;
+
+	return !match(k->user, (const char *) arg);
+}
+
+static bool kline_match_active_user(void *owner, void *arg)
+{
+	kline_t *k = owner;
+	user_t *u = arg;
+
+	if (k->duration != 0 && k->expires <= CURRTIME)
+		return false;
+
+	return !match(k->user, u->user);
+}
+
 kline_t *kline_add_with_id(const char *user, const char *host, const char *reason, long duration, const char *setby, unsigned long id)
 {
 	kline_t *k;
-	mowgli_node_t *n = mowgli_node_create();
 
 	slog(LG_DEBUG, "kline_add(): %s@%s -> %s (%ld)", user, host, reason, duration);
 
 	k = mowgli_heap_alloc(kline_heap);
 
-	mowgli_node_add(k, n, &klnlist);
+	mowgli_node_add(k, &k->node, &klnlist);
 
 	k->user = sstrdup(user);
 	k->host = sstrdup(host);
@@ -143,6 +524,10 @@ kline_t *kline_add_with_id(const char *user, const char *host, const char *reaso
 	k->expires = CURRTIME + duration;
 	k->number = id;
 
+	hostmask_index_add(&kline_index, &k->idx, k, k->host);
+	hostmask_id_add(kline_ids, k->number, &k->idnode, k);
+	expiry_queue_update(&kline_expiry, &k->expiry, k, k->duration, k->expires);
+
 	cnt.kline++;
 
 
@@ -169,8 +554,6 @@ kline_t *kline_add_user(user_t *u, const char *reason, long duration, const char
 
 void kline_delete(kline_t *k)
 {
-	mowgli_node_t *n;
-
 	return_if_fail(k != NULL);
 
 	slog(LG_DEBUG, "kline_delete(): %s@%s -> %s", k->user, k->host, k->reason);
@@ -179,9 +562,10 @@ void kline_delete(kline_t *k)
 	if (me.connected && (k->duration == 0 || k->expires > CURRTIME))
 		unkline_sts("*", k->user, k->host);
 
-	n = mowgli_node_find(k, &klnlist);
-	mowgli_node_delete(n, &klnlist);
-	mowgli_node_free(n);
+	mowgli_node_delete(&k->node, &klnlist);
+	hostmask_index_delete(&kline_index, &k->idx);
+	expiry_queue_delete(&kline_expiry, &k->expiry);
+	hostmask_id_delete(kline_ids, k->number, &k->idnode);
 
 	free(k->user);
 	free(k->host);
@@ -193,82 +577,51 @@ void kline_delete(kline_t *k)
 	cnt.kline--;
 }
 
-kline_t *kline_find(const char *user, const char *host)
+/* for backends restoring a kline's original set time */
+void kline_set_settime(kline_t *k, time_t settime)
 {
-	kline_t *k;
-	mowgli_node_t *n;
+	return_if_fail(k != NULL);
 
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
-	{
-		k = (kline_t *)n->data;
+	k->settime = settime;
+	k->expires = k->settime + k->duration;
+	expiry_queue_update(&kline_expiry, &k->expiry, k, k->duration, k->expires);
+}
 
-		if ((!match(k->user, user)) && (!match(k->host, host)))
-			return k;
-	}
+kline_t *kline_find(const char *user, const char *host)
+{
+	if (user == NULL || host == NULL)
+		return NULL;
 
-	return NULL;
+	return hostmask_index_find(&kline_index, host, NULL, false, kline_match_user, (void *) user);
 }
 
 kline_t *kline_find_num(unsigned long number)
 {
-	kline_t *k;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
-	{
-		k = (kline_t *)n->data;
-
-		if (k->number == number)
-			return k;
-	}
-
-	return NULL;
+	return hostmask_id_find(kline_ids, number);
 }
 
 kline_t *kline_find_user(user_t *u)
 {
-	kline_t *k;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
-	{
-		k = (kline_t *)n->data;
-
-		if (k->duration != 0 && k->expires <= CURRTIME)
-			continue;
-		if (!match(k->user, u->user) && (!match(k->host, u->host) || !match(k->host, u->ip) || !match_ips(k->host, u->ip)))
-			return k;
-	}
-
-	return NULL;
+	return hostmask_index_find(&kline_index, u->host, u->ip, true, kline_match_active_user, u);
 }
 
 void kline_expire(void *arg)
 {
 	kline_t *k;
 	char *reason;
-	mowgli_node_t *n, *tn;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, klnlist.head)
+	while ((k = expiry_queue_next(&kline_expiry, CURRTIME)) != NULL)
 	{
-		k = (kline_t *)n->data;
+		/* TODO: determine validity of k->reason */
+		reason = k->reason ? k->reason : "(none)";
 
-		if (k->duration == 0)
-			continue;
-
-		if (k->expires <= CURRTIME)
-		{
-			/* TODO: determine validity of k->reason */
-			reason = k->reason ? k->reason : "(none)";
+		slog(LG_INFO, _("AKILL:EXPIRE: \2%s@%s\2 set \2%s\2 ago by \2%s\2 (reason: %s)"),
+			k->user, k->host, time_ago(k->settime), k->setby, reason);
 
-			slog(LG_INFO, _("AKILL:EXPIRE: \2%s@%s\2 set \2%s\2 ago by \2%s\2 (reason: %s)"),
-				k->user, k->host, time_ago(k->settime), k->setby, reason);
+		verbose_wallops(_("AKILL expired on \2%s@%s\2, set by \2%s\2 (reason: %s)"),
+			k->user, k->host, k->setby, reason);
 
-			verbose_wallops(_("AKILL expired on \2%s@%s\2, set by \2%s\2 (reason: %s)"),
-				k->user, k->host, k->setby, reason);
-
-			kline_delete(k);
-		}
+		kline_delete(k);
 	}
 }
 
@@ -276,16 +629,27 @@ void kline_expire(void *arg)
  * Z L I N E *
  *************/
 
+static bool zline_match_any(void *owner, void *arg)
+{
+	return true;
+}
+
+static bool zline_match_active(void *owner, void *arg)
+{
+	zline_t *z = owner;
+
+	return z->duration == 0 || z->expires > CURRTIME;
+}
+
 zline_t *zline_add_with_id(const char *host, const char *reason, long duration, const char *setby, unsigned long id)
 {
 	zline_t *z;
-	mowgli_node_t *n = mowgli_node_create();
 
 	slog(LG_DEBUG, "zline_add(): %s -> %s (%ld)", host, reason, duration);
 
 	z = mowgli_heap_alloc(zline_heap);
 
-	mowgli_node_add(z, n, &zlnlist);
+	mowgli_node_add(z, &z->node, &zlnlist);
 
 	z->host = sstrdup(host);
 	z->reason = sstrdup(reason);
@@ -295,6 +659,10 @@ zline_t *zline_add_with_id(const char *host, const char *reason, long duration,
 	z->expires = CURRTIME + duration;
 	z->number = id;
 
+	hostmask_index_add(&zline_index, &z->idx, z, z->host);
+	hostmask_id_add(zline_ids, z->number, &z->idnode, z);
+	expiry_queue_update(&zline_expiry, &z->expiry, z, z->duration, z->expires);
+
 	cnt.zline++;
 
 
@@ -319,8 +687,6 @@ zline_t *zline_add_user(user_t *u, const char *reason, long duration, const char
 
 void zline_delete(zline_t *z)
 {
-	mowgli_node_t *n;
-
 	return_if_fail(z != NULL);
 
 	slog(LG_DEBUG, "zline_delete(): %s -> %s", z->host, z->reason);
@@ -329,9 +695,10 @@ void zline_delete(zline_t *z)
 	if (me.connected && (z->duration == 0 || z->expires > CURRTIME))
 		undline_sts("*", z->host);
 
-	n = mowgli_node_find(z, &zlnlist);
-	mowgli_node_delete(n, &zlnlist);
-	mowgli_node_free(n);
+	mowgli_node_delete(&z->node, &zlnlist);
+	hostmask_index_delete(&zline_index, &z->idx);
+	expiry_queue_delete(&zline_expiry, &z->expiry);
+	hostmask_id_delete(zline_ids, z->number, &z->idnode);
 
 	free(z->host);
 	free(z->reason);
@@ -342,82 +709,51 @@ void zline_delete(zline_t *z)
 	cnt.zline--;
 }
 
-zline_t *zline_find(const char *host)
+/* for backends restoring a zline's original set time */
+void zline_set_settime(zline_t *z, time_t settime)
 {
-	zline_t *z;
-	mowgli_node_t *n;
+	return_if_fail(z != NULL);
 
-	MOWGLI_ITER_FOREACH(n, zlnlist.head)
-	{
-		z = (zline_t *)n->data;
+	z->settime = settime;
+	z->expires = z->settime + z->duration;
+	expiry_queue_update(&zline_expiry, &z->expiry, z, z->duration, z->expires);
+}
 
-		if (!match(z->host, host))
-			return z;
-	}
+zline_t *zline_find(const char *host)
+{
+	if (host == NULL)
+		return NULL;
 
-	return NULL;
+	return hostmask_index_find(&zline_index, host, NULL, false, zline_match_any, NULL);
 }
 
 zline_t *zline_find_num(unsigned long number)
 {
-	zline_t *z;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, zlnlist.head)
-	{
-		z = (zline_t *)n->data;
-
-		if (z->number == number)
-			return z;
-	}
-
-	return NULL;
+	return hostmask_id_find(zline_ids, number);
 }
 
 zline_t *zline_find_user(user_t *u)
 {
-	zline_t *z;
-	mowgli_node_t *n;
-
-	MOWGLI_ITER_FOREACH(n, zlnlist.head)
-	{
-		z = (zline_t *)n->data;
-
-		if (z->duration != 0 && z->expires <= CURRTIME)
-			continue;
-		if (!match(z->host, u->host) || !match(z->host, u->ip) || !match_ips(z->host, u->ip))
-			return z;
-	}
-
-	return NULL;
+	return hostmask_index_find(&zline_index, u->host, u->ip, true, zline_match_active, NULL);
 }
 
 void zline_expire(void *arg)
 {
 	zline_t *z;
 	char *reason;
-	mowgli_node_t *n, *tn;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, zlnlist.head)
+	while ((z = expiry_queue_next(&zline_expiry, CURRTIME)) != NULL)
 	{
-		z = (zline_t *)n->data;
-
-		if (z->duration == 0)
-			continue;
-
-		if (z->expires <= CURRTIME)
-		{
-			/* TODO: determine validity of z->reason */
-			reason = z->reason ? z->reason : "(none)";
+		/* TODO: determine validity of z->reason */
+		reason = z->reason ? z->reason : "(none)";
 
-			slog(LG_INFO, _("ZLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2 (reason: %s)"),
-				z->host, time_ago(z->settime), z->setby, reason);
+		slog(LG_INFO, _("ZLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2 (reason: %s)"),
+			z->host, time_ago(z->settime), z->setby, reason);
 
-			verbose_wallops(_("ZLINE expired on \2%s\2, set by \2%s\2 (reason: %s)"),
-				z->host, z->setby, reason);
+		verbose_wallops(_("ZLINE expired on \2%s\2, set by \2%s\2 (reason: %s)"),
+			z->host, z->setby, reason);
 
-			zline_delete(z);
-		}
+		zline_delete(z);
 	}
 }
 
@@ -428,14 +764,13 @@ void zline_expire(void *arg)
 xline_t *xline_add(const char *realname, const char *reason, long duration, const char *setby)
 {
 	xline_t *x;
-	mowgli_node_t *n = mowgli_node_create();
 	static unsigned int xcnt = 0;
 
 	slog(LG_DEBUG, "xline_add(): %s -> %s (%ld)", realname, reason, duration);
 
 	x = mowgli_heap_alloc(xline_heap);
 
-	mowgli_node_add(x, n, &xlnlist);
+	mowgli_node_add(x, &x->node, &xlnlist);
 
 	x->realname = sstrdup(realname);
 	x->reason = sstrdup(reason);
@@ -445,6 +780,8 @@ xline_t *xline_add(const char *realname, const char *reason, long duration, cons
 	x->expires = CURRTIME + duration;
 	x->number = ++xcnt;
 
+	expiry_queue_update(&xline_expiry, &x->expiry, x, x->duration, x->expires);
+
 	cnt.xline++;
 
 	if (me.connected)
@@ -453,26 +790,17 @@ xline_t *xline_add(const char *realname, const char *reason, long duration, cons
 	return x;
 }
 
-void xline_delete(const char *realname)
+static void xline_destroy(xline_t *x)
 {
-	xline_t *x = xline_find(realname);
-	mowgli_node_t *n;
-
-	if (!x)
-	{
-		slog(LG_DEBUG, "xline_delete(): called for nonexistant xline: %s", realname);
-		return;
-	}
-
 	slog(LG_DEBUG, "xline_delete(): %s -> %s", x->realname, x->reason);
 
 	/* only unxline if ircd has not already removed this -- jilles */
 	if (me.connected && (x->duration == 0 || x->expires > CURRTIME))
 		unxline_sts("*", x->realname);
 
-	n = mowgli_node_find(x, &xlnlist);
-	mowgli_node_delete(n, &xlnlist);
-	mowgli_node_free(n);
+	mowgli_node_delete(&x->node, &xlnlist);
+
+	expiry_queue_delete(&xline_expiry, &x->expiry);
 
 	free(x->realname);
 	free(x->reason);
@@ -483,6 +811,29 @@ void xline_delete(const char *realname)
 	cnt.xline--;
 }
 
+void xline_delete(const char *realname)
+{
+	xline_t *x = xline_find(realname);
+
+	if (!x)
+	{
+		slog(LG_DEBUG, "xline_delete(): called for nonexistant xline: %s", realname);
+		return;
+	}
+
+	xline_destroy(x);
+}
+
+/* for backends restoring an xline's original set time */
+void xline_set_settime(xline_t *x, time_t settime)
+{
+	return_if_fail(x != NULL);
+
+	x->settime = settime;
+	x->expires = x->settime + x->duration;
+	expiry_queue_update(&xline_expiry, &x->expiry, x, x->duration, x->expires);
+}
+
 xline_t *xline_find(const char *realname)
 {
 	xline_t *x;
@@ -537,25 +888,16 @@ xline_t *xline_find_user(user_t *u)
 void xline_expire(void *arg)
 {
 	xline_t *x;
-	mowgli_node_t *n, *tn;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, xlnlist.head)
+	while ((x = expiry_queue_next(&xline_expiry, CURRTIME)) != NULL)
 	{
-		x = (xline_t *)n->data;
+		slog(LG_INFO, _("XLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2"),
+			x->realname, time_ago(x->settime), x->setby);
 
-		if (x->duration == 0)
-			continue;
+		verbose_wallops(_("XLINE expired on \2%s\2, set by \2%s\2"),
+			x->realname, x->setby);
 
-		if (x->expires <= CURRTIME)
-		{
-			slog(LG_INFO, _("XLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2"),
-				x->realname, time_ago(x->settime), x->setby);
-
-			verbose_wallops(_("XLINE expired on \2%s\2, set by \2%s\2"),
-				x->realname, x->setby);
-
-			xline_delete(x->realname);
-		}
+		xline_destroy(x);
 	}
 }
 
@@ -566,13 +908,12 @@ void xline_expire(void *arg)
 qline_t *qline_add(const char *mask, const char *reason, long duration, const char *setby)
 {
 	qline_t *q;
-	mowgli_node_t *n = mowgli_node_create();
 	static unsigned int qcnt = 0;
 
 	slog(LG_DEBUG, "qline_add(): %s -> %s (%ld)", mask, reason, duration);
 
 	q = mowgli_heap_alloc(qline_heap);
-	mowgli_node_add(q, n, &qlnlist);
+	mowgli_node_add(q, &q->node, &qlnlist);
 
 	q->mask = sstrdup(mask);
 	q->reason = sstrdup(reason);
@@ -582,6 +923,8 @@ qline_t *qline_add(const char *mask, const char *reason, long duration, const ch
 	q->expires = CURRTIME + duration;
 	q->number = ++qcnt;
 
+	expiry_queue_update(&qline_expiry, &q->expiry, q, q->duration, q->expires);
+
 	cnt.qline++;
 
 	if (me.connected)
@@ -590,26 +933,17 @@ qline_t *qline_add(const char *mask, const char *reason, long duration, const ch
 	return q;
 }
 
-void qline_delete(const char *mask)
+static void qline_destroy(qline_t *q)
 {
-	qline_t *q = qline_find(mask);
-	mowgli_node_t *n;
-
-	if (!q)
-	{
-		slog(LG_DEBUG, "qline_delete(): called for nonexistant qline: %s", mask);
-		return;
-	}
-
 	slog(LG_DEBUG, "qline_delete(): %s -> %s", q->mask, q->reason);
 
 	/* only unqline if ircd has not already removed this -- jilles */
 	if (me.connected && (q->duration == 0 || q->expires > CURRTIME))
 		unqline_sts("*", q->mask);
 
-	n = mowgli_node_find(q, &qlnlist);
-	mowgli_node_delete(n, &qlnlist);
-	mowgli_node_free(n);
+	mowgli_node_delete(&q->node, &qlnlist);
+
+	expiry_queue_delete(&qline_expiry, &q->expiry);
 
 	free(q->mask);
 	free(q->reason);
@@ -620,6 +954,29 @@ void qline_delete(const char *mask)
 	cnt.qline--;
 }
 
+void qline_delete(const char *mask)
+{
+	qline_t *q = qline_find(mask);
+
+	if (!q)
+	{
+		slog(LG_DEBUG, "qline_delete(): called for nonexistant qline: %s", mask);
+		return;
+	}
+
+	qline_destroy(q);
+}
+
+/* for backends restoring a qline's original set time */
+void qline_set_settime(qline_t *q, time_t settime)
+{
+	return_if_fail(q != NULL);
+
+	q->settime = settime;
+	q->expires = q->settime + q->duration;
+	expiry_queue_update(&qline_expiry, &q->expiry, q, q->duration, q->expires);
+}
+
 qline_t *qline_find(const char *mask)
 {
 	qline_t *q;
@@ -711,25 +1068,16 @@ qline_t *qline_find_channel(channel_t *c)
 void qline_expire(void *arg)
 {
 	qline_t *q;
-	mowgli_node_t *n, *tn;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, qlnlist.head)
+	while ((q = expiry_queue_next(&qline_expiry, CURRTIME)) != NULL)
 	{
-		q = (qline_t *)n->data;
+		slog(LG_INFO, _("QLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2"),
+			q->mask, time_ago(q->settime), q->setby);
 
-		if (q->duration == 0)
-			continue;
+		verbose_wallops(_("QLINE expired on \2%s\2, set by \2%s\2"),
+			q->mask, q->setby);
 
-		if (q->expires <= CURRTIME)
-		{
-			slog(LG_INFO, _("QLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2"),
-				q->mask, time_ago(q->settime), q->setby);
-
-			verbose_wallops(_("QLINE expired on \2%s\2, set by \2%s\2"),
-				q->mask, q->setby);
-
-			qline_delete(q->mask);
-		}
+		qline_destroy(q);
 	}
 }
 
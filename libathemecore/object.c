@@ -30,6 +30,28 @@ mowgli_list_t object_list = { NULL, NULL, 0 };
 
 mowgli_heap_t *metadata_heap;	/* HEAP_CHANUSER */
 
+/*
+ * Metadata names that are looked up on hot paths can be interned once into
+ * a small integer key.  Every entry still lives in the object's
+ * object_map_t, a sorted array that only becomes a patricia past
+ * OBJECT_MAP_MAX entries; an object that has been asked for an interned
+ * key additionally keeps a slot vector of pointers to those entries,
+ * indexed by key, which metadata_add() and metadata_remove() keep up to
+ * date.  Keys are never released.
+ */
+static mowgli_patricia_t *metadata_keys = NULL;
+static char **metadata_key_names = NULL;
+static metadata_key_t metadata_nkeys = 0;
+
+static struct {
+	unsigned int maps;
+	unsigned int trees;
+	unsigned int entries;	/* arrays only */
+	size_t bytes;		/* arrays and the headers of trees */
+} object_map_stats;
+
+static void object_map_osinfo(sourceinfo_t *si);
+
 void init_metadata(void)
 {
 	metadata_heap = sharedheap_get(sizeof(metadata_t));
@@ -39,6 +61,289 @@ void init_metadata(void)
 		slog(LG_ERROR, "init_metadata(): block allocator failure.");
 		exit(EXIT_FAILURE);
 	}
+
+	hook_add_event("operserv_info");
+	hook_add_operserv_info(object_map_osinfo);
+}
+
+static inline size_t object_map_size(unsigned int alloc)
+{
+	return sizeof(object_map_t) + alloc * sizeof(object_map_item_t);
+}
+
+/* adds a map's share to the statistics, or takes it out again */
+static void object_map_account(object_map_t *map, bool add)
+{
+	unsigned int trees = 0, entries = 0;
+	size_t bytes = object_map_size(map->alloc);
+
+	if (map->tree != NULL)
+		trees = 1;
+	else
+		entries = map->count;
+
+	if (add)
+	{
+		object_map_stats.maps++;
+		object_map_stats.trees += trees;
+		object_map_stats.entries += entries;
+		object_map_stats.bytes += bytes;
+	}
+	else
+	{
+		object_map_stats.maps--;
+		object_map_stats.trees -= trees;
+		object_map_stats.entries -= entries;
+		object_map_stats.bytes -= bytes;
+	}
+}
+
+static object_map_t *object_map_create(bool casefold, bool owns_keys)
+{
+	object_map_t *map;
+
+	map = smalloc(object_map_size(2));
+	map->alloc = 2;
+	map->casefold = casefold;
+	map->owns_keys = owns_keys;
+
+	object_map_account(map, true);
+
+	return map;
+}
+
+static void object_map_destroy(object_map_t *map)
+{
+	unsigned int i;
+
+	if (map == NULL)
+		return;
+
+	object_map_account(map, false);
+
+	if (map->tree != NULL)
+		mowgli_patricia_destroy(map->tree, NULL, NULL);
+	else if (map->owns_keys)
+	{
+		for (i = 0; i < map->count; i++)
+			strshare_unref(map->items[i].key);
+	}
+
+	free(map);
+}
+
+static inline unsigned int object_map_count(object_map_t *map)
+{
+	if (map == NULL)
+		return 0;
+
+	return map->tree != NULL ? mowgli_patricia_size(map->tree) : map->count;
+}
+
+/* position of key in the array, or where it would be inserted */
+static unsigned int object_map_search(object_map_t *map, const char *key, bool *found)
+{
+	unsigned int lo = 0, hi = map->count, mid;
+	int cmp;
+
+	*found = false;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		cmp = map->casefold ? strcasecmp(key, map->items[mid].key) : strcmp(key, map->items[mid].key);
+
+		if (cmp == 0)
+		{
+			*found = true;
+			return mid;
+		}
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+static void *object_map_find(object_map_t *map, const char *key)
+{
+	unsigned int i;
+	bool found;
+
+	if (map == NULL)
+		return NULL;
+
+	if (map->tree != NULL)
+		return mowgli_patricia_retrieve(map->tree, key);
+
+	i = object_map_search(map, key, &found);
+
+	return found ? map->items[i].data : NULL;
+}
+
+/* the caller has already taken the map out of the statistics */
+static object_map_t *object_map_upgrade(object_map_t *map)
+{
+	unsigned int i;
+
+	map->tree = mowgli_patricia_create(map->casefold ? strcasecanon : noopcanon);
+
+	for (i = 0; i < map->count; i++)
+	{
+		mowgli_patricia_add(map->tree, map->items[i].key, map->items[i].data);
+
+		if (map->owns_keys)
+			strshare_unref(map->items[i].key);
+	}
+
+	map->count = map->alloc = 0;
+
+	return srealloc(map, object_map_size(0));
+}
+
+/* like mowgli_patricia_add(), an existing entry is left alone */
+static bool object_map_add(object_map_t **mapp, const char *key, void *data)
+{
+	object_map_t *map = *mapp;
+	unsigned int i;
+	bool found;
+
+	if (map->tree != NULL)
+		return mowgli_patricia_add(map->tree, key, data);
+
+	i = object_map_search(map, key, &found);
+	if (found)
+		return false;
+
+	object_map_account(map, false);
+
+	if (map->count == OBJECT_MAP_MAX)
+	{
+		map = *mapp = object_map_upgrade(map);
+		mowgli_patricia_add(map->tree, key, data);
+		object_map_account(map, true);
+		return true;
+	}
+
+	if (map->count == map->alloc)
+	{
+		map->alloc = map->alloc * 2 > OBJECT_MAP_MAX ? OBJECT_MAP_MAX : map->alloc * 2;
+		map = *mapp = srealloc(map, object_map_size(map->alloc));
+	}
+
+	memmove(&map->items[i + 1], &map->items[i], (map->count - i) * sizeof(object_map_item_t));
+	map->items[i].key = map->owns_keys ? strshare_get(key) : key;
+	map->items[i].data = data;
+	map->count++;
+
+	object_map_account(map, true);
+
+	return true;
+}
+
+static void *object_map_delete(object_map_t *map, const char *key)
+{
+	unsigned int i;
+	bool found;
+	void *data;
+
+	if (map == NULL)
+		return NULL;
+
+	if (map->tree != NULL)
+		return mowgli_patricia_delete(map->tree, key);
+
+	i = object_map_search(map, key, &found);
+	if (!found)
+		return NULL;
+
+	object_map_account(map, false);
+
+	data = map->items[i].data;
+	if (map->owns_keys)
+		strshare_unref(map->items[i].key);
+
+	map->count--;
+	memmove(&map->items[i], &map->items[i + 1], (map->count - i) * sizeof(object_map_item_t));
+
+	object_map_account(map, true);
+
+	return data;
+}
+
+void object_map_foreach_start(object_map_t *map, object_map_iteration_state_t *state)
+{
+	state->i = 0;
+	state->cur = NULL;
+
+	if (map != NULL && map->tree != NULL)
+		mowgli_patricia_foreach_start(map->tree, &state->tstate);
+}
+
+void *object_map_foreach_cur(object_map_t *map, object_map_iteration_state_t *state)
+{
+	if (map == NULL)
+		return NULL;
+
+	if (map->tree != NULL)
+		return mowgli_patricia_foreach_cur(map->tree, &state->tstate);
+
+	state->cur = state->i < map->count ? map->items[state->i].data : NULL;
+
+	return state->cur;
+}
+
+void object_map_foreach_next(object_map_t *map, object_map_iteration_state_t *state)
+{
+	if (map == NULL)
+		return;
+
+	if (map->tree != NULL)
+	{
+		mowgli_patricia_foreach_next(map->tree, &state->tstate);
+		return;
+	}
+
+	/* if the current entry was deleted, the next one has moved into its place */
+	if (state->i < map->count && map->items[state->i].data == state->cur)
+		state->i++;
+}
+
+static size_t object_map_array_bytes(void)
+{
+	return object_map_stats.bytes - object_map_stats.trees * object_map_size(0);
+}
+
+/*
+ * object_map_report()
+ *
+ * Logs how many metadata and privatedata maps there are and how much
+ * memory their arrays use.
+ *
+ * Inputs:
+ *      - none
+ *
+ * Outputs:
+ *      - none
+ *
+ * Side Effects:
+ *      - a line is logged
+ */
+void object_map_report(void)
+{
+	slog(LG_INFO, "object_map_report(): %u maps (%u grown into trees), %u entries in arrays using %zu bytes",
+			object_map_stats.maps, object_map_stats.trees, object_map_stats.entries,
+			object_map_array_bytes());
+}
+
+static void object_map_osinfo(sourceinfo_t *si)
+{
+	command_success_nodata(si, "Object maps: %u (%u trees), %u array entries in %zu bytes",
+			object_map_stats.maps, object_map_stats.trees, object_map_stats.entries,
+			object_map_array_bytes());
 }
 
 /*
@@ -181,7 +486,8 @@ void object_unref(void *obj)
 void object_dispose(void *object)
 {
 	object_t *obj;
-	mowgli_patricia_t *privatedata, *metadata;
+	object_map_t *privatedata, *metadata;
+	metadata_t **mdslots;
 
 	return_if_fail(object != NULL);
 	obj = object(object);
@@ -197,6 +503,7 @@ void object_dispose(void *object)
 
 	privatedata = obj->privatedata;
 	metadata = obj->metadata;
+	mdslots = obj->mdslots;
 
 #ifdef OBJECT_DEBUG
 	mowgli_node_delete(&obj->dnode, &object_list);
@@ -210,11 +517,42 @@ void object_dispose(void *object)
 		free(obj);
 	}
 
-	if (privatedata != NULL)
-		mowgli_patricia_destroy(privatedata, NULL, NULL);
+	object_map_destroy(privatedata);
+	object_map_destroy(metadata);
 
-	if (metadata != NULL)
-		mowgli_patricia_destroy(metadata, NULL, NULL);
+	free(mdslots);
+}
+
+/* the interned key for name, or 0 */
+static inline metadata_key_t metadata_key_lookup(const char *name)
+{
+	if (metadata_keys == NULL)
+		return 0;
+
+	return (metadata_key_t) (uintptr_t) mowgli_patricia_retrieve(metadata_keys, name);
+}
+
+static void metadata_slot_set(object_t *obj, const char *name, metadata_t *md)
+{
+	metadata_key_t key;
+
+	if (obj->mdslots == NULL)
+		return;
+
+	if ((key = metadata_key_lookup(name)) != 0 && key < obj->nmdslots)
+		obj->mdslots[key] = md;
+}
+
+/* unlinks and frees an entry without telling the journal */
+static void metadata_remove(object_t *obj, metadata_t *md)
+{
+	object_map_delete(obj->metadata, md->name);
+	metadata_slot_set(obj, md->name, NULL);
+
+	strshare_unref(md->name);
+	free(md->value);
+
+	mowgli_heap_free(metadata_heap, md);
 }
 
 metadata_t *metadata_add(void *target, const char *name, const char *value)
@@ -228,17 +566,20 @@ metadata_t *metadata_add(void *target, const char *name, const char *value)
 	obj = object(target);
 
 	if (obj->metadata == NULL)
-		obj->metadata = mowgli_patricia_create(strcasecanon);
+		obj->metadata = object_map_create(true, false);
 
-	if (metadata_find(target, name))
-		metadata_delete(target, name);
+	if ((md = metadata_find(target, name)) != NULL)
+		metadata_remove(obj, md);
 
 	md = mowgli_heap_alloc(metadata_heap);
 
 	md->name = strshare_get(name);
 	md->value = sstrdup(value);
 
-	mowgli_patricia_add(obj->metadata, md->name, md);
+	object_map_add(&obj->metadata, md->name, md);
+	metadata_slot_set(obj, md->name, md);
+
+	db_journal_record(DB_JOURNAL_METADATA, target, md->name);
 
 	return md;
 }
@@ -253,15 +594,9 @@ void metadata_delete(void *target, const char *name)
 
 	obj = object(target);
 
-	if (obj->metadata == NULL)
-		obj->metadata = mowgli_patricia_create(strcasecanon);
-
-	mowgli_patricia_delete(obj->metadata, name);
+	db_journal_record(DB_JOURNAL_METADATA_DROP, target, md->name);
 
-	strshare_unref(md->name);
-	free(md->value);
-
-	mowgli_heap_free(metadata_heap, md);
+	metadata_remove(obj, md);
 }
 
 metadata_t *metadata_find(void *target, const char *name)
@@ -273,38 +608,105 @@ metadata_t *metadata_find(void *target, const char *name)
 
 	obj = object(target);
 
-	if (obj->metadata == NULL)
-		obj->metadata = mowgli_patricia_create(strcasecanon);
-
-	return mowgli_patricia_retrieve(obj->metadata, name);
+	return object_map_find(obj->metadata, name);
 }
 
 void metadata_delete_all(void *target)
 {
 	object_t *obj;
 	metadata_t *md;
-	mowgli_patricia_iteration_state_t state;
+	object_map_iteration_state_t state;
 
 	obj = object(target);
 
-	if (obj->metadata == NULL)
-		obj->metadata = mowgli_patricia_create(strcasecanon);
-
-	MOWGLI_PATRICIA_FOREACH(md, &state, obj->metadata)
+	/* the owner is going away; the journal records that instead */
+	METADATA_FOREACH(md, &state, obj)
 	{
-		metadata_delete(obj, md->name);
+		metadata_remove(obj, md);
 	}
 }
 
-void *privatedata_get(void *target, const char *key)
+/*
+ * metadata_key_intern(const char *name)
+ *
+ * Resolves a metadata name to a key for metadata_find_key().
+ *
+ * Inputs:
+ *      - metadata name
+ *
+ * Outputs:
+ *      - the key; the same name always gives the same key
+ *
+ * Side Effects:
+ *      - the name is added to the key registry if it was not there
+ */
+metadata_key_t metadata_key_intern(const char *name)
+{
+	metadata_key_t key;
+
+	return_val_if_fail(name != NULL, 0);
+
+	if (metadata_keys == NULL)
+		metadata_keys = mowgli_patricia_create(strcasecanon);
+
+	if ((key = metadata_key_lookup(name)) != 0)
+		return key;
+
+	key = ++metadata_nkeys;
+	metadata_key_names = srealloc(metadata_key_names, (metadata_nkeys + 1) * sizeof(char *));
+	metadata_key_names[key] = sstrdup(name);
+	mowgli_patricia_add(metadata_keys, metadata_key_names[key], (void *) (uintptr_t) key);
+
+	return key;
+}
+
+/*
+ * metadata_find_key(void *target, metadata_key_t key)
+ *
+ * Like metadata_find(), with a name from metadata_key_intern().
+ *
+ * Inputs:
+ *      - object to look in
+ *      - interned key
+ *
+ * Outputs:
+ *      - the metadata entry, or NULL
+ *
+ * Side Effects:
+ *      - the object's key vector may be extended to cover newer keys
+ */
+metadata_t *metadata_find_key(void *target, metadata_key_t key)
 {
 	object_t *obj;
+	unsigned int i;
+
+	return_val_if_fail(target != NULL, NULL);
+	return_val_if_fail(key != 0 && key <= metadata_nkeys, NULL);
 
 	obj = object(target);
-	if (obj->privatedata == NULL)
+
+	if (key < obj->nmdslots)
+		return obj->mdslots[key];
+
+	/* nothing to index yet */
+	if (object_map_count(obj->metadata) == 0)
 		return NULL;
 
-	return mowgli_patricia_retrieve(obj->privatedata, key);
+	obj->mdslots = srealloc(obj->mdslots, (metadata_nkeys + 1) * sizeof(metadata_t *));
+	for (i = obj->nmdslots; i <= metadata_nkeys; i++)
+		obj->mdslots[i] = i == 0 ? NULL : object_map_find(obj->metadata, metadata_key_names[i]);
+	obj->nmdslots = metadata_nkeys + 1;
+
+	return obj->mdslots[key];
+}
+
+void *privatedata_get(void *target, const char *key)
+{
+	object_t *obj;
+
+	obj = object(target);
+
+	return object_map_find(obj->privatedata, key);
 }
 
 void privatedata_set(void *target, const char *key, void *data)
@@ -313,9 +715,9 @@ void privatedata_set(void *target, const char *key, void *data)
 
 	obj = object(target);
 	if (obj->privatedata == NULL)
-		obj->privatedata = mowgli_patricia_create(noopcanon);
+		obj->privatedata = object_map_create(false, true);
 
-	mowgli_patricia_add(obj->privatedata, key, data);
+	object_map_add(&obj->privatedata, key, data);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
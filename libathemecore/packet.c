@@ -36,11 +36,13 @@ mowgli_eventloop_timer_t *ping_uplink_timer = NULL;
 static void irc_recvq_handler(connection_t *cptr)
 {
 	bool wasnonl;
-	char parsebuf[BUFSIZE + 1];
+	char *line;
 	int count;
 
+	/* parse straight out of the recvq; the last byte taken
+	 * (newline, or overflow of a too long line) holds the NUL */
 	wasnonl = cptr->flags & CF_NONEWLINE ? true : false;
-	count = recvq_getline(cptr, parsebuf, sizeof parsebuf - 1);
+	count = recvq_getline_ref(cptr, &line, BUFSIZE + 1);
 	if (count <= 0)
 		return;
 	cnt.bin += count;
@@ -48,12 +50,11 @@ static void irc_recvq_handler(connection_t *cptr)
 	if (wasnonl)
 		return;
 	me.uplinkpong = CURRTIME;
-	if (parsebuf[count - 1] == '\n')
+	count--;
+	if (count > 0 && line[count - 1] == '\r')
 		count--;
-	if (count > 0 && parsebuf[count - 1] == '\r')
-		count--;
-	parsebuf[count] = '\0';
-	parse(parsebuf);
+	line[count] = '\0';
+	parse(line);
 }
 
 static void ping_uplink(void *arg)
@@ -306,16 +306,16 @@ mowgli_node_t *generic_next_matching_ban(channel_t *c, user_t *u, int type, mowg
 {
 	chanban_t *cb;
 	mowgli_node_t *n;
-	char hostbuf[NICKLEN+USERLEN+HOSTLEN];
-	char cloakbuf[NICKLEN+USERLEN+HOSTLEN];
-	char realbuf[NICKLEN+USERLEN+HOSTLEN];
-	char ipbuf[NICKLEN+USERLEN+HOSTLEN];
-
-	snprintf(hostbuf, sizeof hostbuf, "%s!%s@%s", u->nick, u->user, u->vhost);
-	snprintf(cloakbuf, sizeof cloakbuf, "%s!%s@%s", u->nick, u->user, u->chost);
-	snprintf(realbuf, sizeof realbuf, "%s!%s@%s", u->nick, u->user, u->host);
+	const char *hostbuf;
+	const char *cloakbuf;
+	const char *realbuf;
+	const char *ipbuf;
+
+	hostbuf = user_get_mask(u, USER_MASK_VHOST);
+	cloakbuf = user_get_mask(u, USER_MASK_CHOST);
+	realbuf = user_get_mask(u, USER_MASK_HOST);
 	/* will be nick!user@ if ip unknown, doesn't matter */
-	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
+	ipbuf = user_get_mask(u, USER_MASK_IP);
 	MOWGLI_ITER_FOREACH(n, first)
 	{
 		cb = n->data;
@@ -331,14 +331,14 @@ mowgli_node_t *generic_next_matching_host_chanacs(mychan_t *mc, user_t *u, mowgl
 {
 	chanacs_t *ca;
 	mowgli_node_t *n;
-	char hostbuf[NICKLEN+USERLEN+HOSTLEN];
-	char hostbuf2[NICKLEN+USERLEN+HOSTLEN];
-	char ipbuf[NICKLEN+USERLEN+HOSTLEN];
+	const char *hostbuf;
+	const char *hostbuf2;
+	const char *ipbuf;
 
-	snprintf(hostbuf, sizeof hostbuf, "%s!%s@%s", u->nick, u->user, u->vhost);
-	snprintf(hostbuf2, sizeof hostbuf2, "%s!%s@%s", u->nick, u->user, u->chost);
+	hostbuf = user_get_mask(u, USER_MASK_VHOST);
+	hostbuf2 = user_get_mask(u, USER_MASK_CHOST);
 	/* will be nick!user@ if ip unknown, doesn't matter */
-	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
+	ipbuf = user_get_mask(u, USER_MASK_IP);
 
 	MOWGLI_ITER_FOREACH(n, first)
 	{
@@ -79,6 +79,16 @@ signal_usr2_handler(int signum)
 	got_sigusr2 = 1;
 }
 
+/* get buffered log lines onto disk before dying */
+static void
+signal_crash_handler(int signum)
+{
+	log_flush_crash();
+
+	signal(signum, SIG_DFL);
+	raise(signum);
+}
+
 /* XXX */
 static void
 signal_usr1_handler(int signum)
@@ -130,6 +140,26 @@ void init_signal_handlers(void)
 #ifdef SIGUSR2
 	mowgli_signal_install_handler(SIGUSR2, signal_usr2_handler);
 #endif
+
+#ifdef SIGSEGV
+	mowgli_signal_install_handler(SIGSEGV, signal_crash_handler);
+#endif
+
+#ifdef SIGBUS
+	mowgli_signal_install_handler(SIGBUS, signal_crash_handler);
+#endif
+
+#ifdef SIGFPE
+	mowgli_signal_install_handler(SIGFPE, signal_crash_handler);
+#endif
+
+#ifdef SIGILL
+	mowgli_signal_install_handler(SIGILL, signal_crash_handler);
+#endif
+
+#ifdef SIGABRT
+	mowgli_signal_install_handler(SIGABRT, signal_crash_handler);
+#endif
 #endif
 }
 
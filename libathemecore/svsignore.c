@@ -26,6 +26,84 @@
 
 mowgli_list_t svs_ignore_list;
 
+/*
+ * The ignore list is compiled into a matcher the first time it is needed
+ * after a change:
+ *  - masks without wildcards are looked up by the whole nick!user@host,
+ *  - masks of the form *!*@host with a literal host by the host alone,
+ *  - masks of the form *literal are compared against the end of the mask,
+ *  - everything else still goes through match().
+ */
+typedef struct {
+	svsignore_t *svsignore;
+	const char *tail;
+	size_t len;
+} svsignore_suffix_t;
+
+static struct {
+	bool dirty;
+	mowgli_patricia_t *exact;
+	mowgli_patricia_t *hosts;
+	svsignore_suffix_t *suffix;
+	size_t nsuffix;
+	svsignore_t **wild;
+	size_t nwild;
+} svsignore_matcher = { .dirty = true };
+
+static bool svsignore_is_literal(const char *mask)
+{
+	return *mask != '\0' && strpbrk(mask, "*?&#%\\") == NULL;
+}
+
+static void svsignore_compile(void)
+{
+	svsignore_t *svsignore;
+	mowgli_node_t *n;
+	size_t len = MOWGLI_LIST_LENGTH(&svs_ignore_list);
+
+	if (svsignore_matcher.exact != NULL)
+	{
+		mowgli_patricia_destroy(svsignore_matcher.exact, NULL, NULL);
+		mowgli_patricia_destroy(svsignore_matcher.hosts, NULL, NULL);
+	}
+
+	svsignore_matcher.exact = mowgli_patricia_create(irccasecanon);
+	svsignore_matcher.hosts = mowgli_patricia_create(irccasecanon);
+
+	svsignore_matcher.suffix = srealloc(svsignore_matcher.suffix, (len + 1) * sizeof(svsignore_suffix_t));
+	svsignore_matcher.wild = srealloc(svsignore_matcher.wild, (len + 1) * sizeof(svsignore_t *));
+	svsignore_matcher.nsuffix = svsignore_matcher.nwild = 0;
+
+	MOWGLI_ITER_FOREACH(n, svs_ignore_list.head)
+	{
+		svsignore = (svsignore_t *)n->data;
+
+		/* patricia keys are unique; any one matching ignore will do */
+		if (svsignore_is_literal(svsignore->mask))
+		{
+			if (mowgli_patricia_retrieve(svsignore_matcher.exact, svsignore->mask) == NULL)
+				mowgli_patricia_add(svsignore_matcher.exact, svsignore->mask, svsignore);
+		}
+		else if (!strncmp(svsignore->mask, "*!*@", 4) && svsignore_is_literal(svsignore->mask + 4))
+		{
+			if (mowgli_patricia_retrieve(svsignore_matcher.hosts, svsignore->mask + 4) == NULL)
+				mowgli_patricia_add(svsignore_matcher.hosts, svsignore->mask + 4, svsignore);
+		}
+		else if (svsignore->mask[0] == '*' && svsignore_is_literal(svsignore->mask + 1))
+		{
+			svsignore_suffix_t *sf = &svsignore_matcher.suffix[svsignore_matcher.nsuffix++];
+
+			sf->svsignore = svsignore;
+			sf->tail = svsignore->mask + 1;
+			sf->len = strlen(sf->tail);
+		}
+		else
+			svsignore_matcher.wild[svsignore_matcher.nwild++] = svsignore;
+	}
+
+	svsignore_matcher.dirty = false;
+}
+
 /*
  * svsignore_add(const char *mask, const char *reason)
  *
@@ -58,6 +136,8 @@ svsignore_t *svsignore_add(const char *mask, const char *reason)
         svsignore->reason = sstrdup(reason);
         cnt.svsignore++;
 
+        svsignore_matcher.dirty = true;
+
         return svsignore;
 }
 
@@ -70,7 +150,7 @@ svsignore_t *svsignore_add(const char *mask, const char *reason)
  *     - user object to check
  *
  * Outputs:
- *     - if any ignores match, the ignore that matches
+ *     - if any ignores match, one of the ignores that match
  *     - if none match, NULL
  *
  * Side Effects:
@@ -79,26 +159,43 @@ svsignore_t *svsignore_add(const char *mask, const char *reason)
 svsignore_t *svsignore_find(user_t *source)
 {
         svsignore_t *svsignore;
-        mowgli_node_t *n;
-        char host[BUFSIZE];
+        svsignore_suffix_t *sf;
+        const char *host;
+        size_t i, len;
 
 	if (!use_svsignore)
 		return NULL;
 
-        *host = '\0';
-        mowgli_strlcpy(host, source->nick, BUFSIZE);
-        mowgli_strlcat(host, "!", BUFSIZE);
-        mowgli_strlcat(host, source->user, BUFSIZE);
-        mowgli_strlcat(host, "@", BUFSIZE);
-        mowgli_strlcat(host, source->host, BUFSIZE);
+	if (MOWGLI_LIST_LENGTH(&svs_ignore_list) == 0)
+		return NULL;
+
+	if (svsignore_matcher.dirty)
+		svsignore_compile();
+
+	host = user_get_mask(source, USER_MASK_HOST);
+
+	if ((svsignore = mowgli_patricia_retrieve(svsignore_matcher.exact, host)) != NULL)
+		return svsignore;
 
-        MOWGLI_ITER_FOREACH(n, svs_ignore_list.head)
-        {
-                svsignore = (svsignore_t *)n->data;
+	if ((svsignore = mowgli_patricia_retrieve(svsignore_matcher.hosts, source->host)) != NULL)
+		return svsignore;
 
-                if (!match(svsignore->mask, host))
-                        return svsignore;
-        }
+	len = strlen(host);
+	for (i = 0; i < svsignore_matcher.nsuffix; i++)
+	{
+		sf = &svsignore_matcher.suffix[i];
+
+		if (sf->len <= len && !ircncasecmp(host + len - sf->len, sf->tail, sf->len))
+			return sf->svsignore;
+	}
+
+	for (i = 0; i < svsignore_matcher.nwild; i++)
+	{
+		svsignore = svsignore_matcher.wild[i];
+
+		if (!match(svsignore->mask, host))
+			return svsignore;
+	}
 
         return NULL;
 }
@@ -123,8 +220,12 @@ void svsignore_delete(svsignore_t *svsignore)
 
 	n = mowgli_node_find(svsignore, &svs_ignore_list);
 	mowgli_node_delete(n, &svs_ignore_list);
+	mowgli_node_free(n);
+
+	svsignore_matcher.dirty = true;
 
 	free(svsignore->mask);
+	free(svsignore->setby);
 	free(svsignore->reason);
 	free(svsignore);
 }
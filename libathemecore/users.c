@@ -279,6 +279,9 @@ void user_delete(user_t *u, const char *comment)
 	strshare_unref(u->chost);
 	strshare_unref(u->ip);
 
+	free(u->chanacs_cache);
+	free(u->masks);
+
 	mowgli_heap_free(user_heap, u);
 
 	cnt.user--;
@@ -494,6 +497,7 @@ bool user_changenick(user_t *u, const char *nick, time_t ts)
 
 	strshare_unref(u->nick);
 	u->nick = strshare_get(nick);
+	user_mask_changed(u);
 
 	u->ts = ts;
 
@@ -617,11 +621,105 @@ void user_sethost(user_t *source, user_t *target, stringref host)
 
 	strshare_unref(target->vhost);
 	target->vhost = strshare_get(host);
+	user_mask_changed(target);
 
 	sethost_sts(source, target, target->vhost);
 	hook_call_user_sethost(target);
 }
 
+/*
+ * user_mask_changed(user_t *u)
+ *
+ * Notes that the nick, username or one of the hosts of a user changed.
+ * Protocol modules must call this after replacing any of these fields.
+ *
+ * Inputs:
+ *     - user object whose mask changed
+ *
+ * Outputs:
+ *     - nothing
+ *
+ * Side Effects:
+ *     - results cached against the user's old masks are invalidated
+ */
+void user_mask_changed(user_t *u)
+{
+	return_if_fail(u != NULL);
+
+	u->mask_gen++;
+}
+
+/*
+ * user_get_mask(user_t *u, user_mask_type_t type)
+ *
+ * Returns one of the nick!user@host forms of a user.  The forms are built
+ * on first use and kept until the user's mask changes.
+ *
+ * Inputs:
+ *     - user object
+ *     - which form to return
+ *
+ * Outputs:
+ *     - the mask, valid until the next user_mask_changed() on the user
+ *
+ * Side Effects:
+ *     - the user's cached masks may be rebuilt
+ */
+const char *user_get_mask(user_t *u, user_mask_type_t type)
+{
+	user_masks_t *um;
+
+	return_val_if_fail(u != NULL, NULL);
+	return_val_if_fail(type < USER_MASK_COUNT, NULL);
+
+	if ((um = u->masks) == NULL)
+	{
+		um = u->masks = smalloc(sizeof *um);
+		um->gen = u->mask_gen - 1;
+	}
+
+	if (um->gen != u->mask_gen)
+	{
+		snprintf(um->mask[USER_MASK_HOST], USER_MASKLEN, "%s!%s@%s", u->nick, u->user, u->host);
+		snprintf(um->mask[USER_MASK_VHOST], USER_MASKLEN, "%s!%s@%s", u->nick, u->user, u->vhost);
+		snprintf(um->mask[USER_MASK_CHOST], USER_MASKLEN, "%s!%s@%s", u->nick, u->user, u->chost);
+		snprintf(um->mask[USER_MASK_IP], USER_MASKLEN, "%s!%s@%s", u->nick, u->user, u->ip != NULL ? u->ip : "");
+		um->nicklen = strlen(u->nick);
+		if (um->nicklen >= USER_MASKLEN)
+			um->nicklen = USER_MASKLEN - 1;
+		um->gen = u->mask_gen;
+	}
+
+	return um->mask[type];
+}
+
+/*
+ * user_get_userhost(user_t *u, user_mask_type_t type)
+ *
+ * Like user_get_mask(), but without the nick.
+ *
+ * Inputs:
+ *     - user object
+ *     - which form to return
+ *
+ * Outputs:
+ *     - the user@host mask, valid until the next user_mask_changed()
+ *
+ * Side Effects:
+ *     - the user's cached masks may be rebuilt
+ */
+const char *user_get_userhost(user_t *u, user_mask_type_t type)
+{
+	const char *mask;
+
+	return_val_if_fail(u != NULL, NULL);
+
+	if ((mask = user_get_mask(u, type)) == NULL)
+		return NULL;
+
+	return mask[u->masks->nicklen] != '\0' ? mask + u->masks->nicklen + 1 : mask + u->masks->nicklen;
+}
+
 const char *user_get_umodestr(user_t *u)
 {
 	static char result[34];
@@ -654,6 +752,9 @@ bool user_is_channel_banned(user_t *u, char ban_type)
 		if (cu->modes != 0)
 			continue;
 
+		if (MOWGLI_LIST_LENGTH(&cu->chan->bans) == 0)
+			continue;
+
 		if (next_matching_ban(cu->chan, u, ban_type, cu->chan->bans.head) != NULL)
 		{
 			if (ircd->except_mchar == '\0' || next_matching_ban(cu->chan, u, ircd->except_mchar, cu->chan->bans.head) == NULL)
@@ -0,0 +1,979 @@
+/*
+ * Copyright (c) 2014-2018 Xtheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Compact binary database backend.  Rows are the same rows corestorage
+ * and the modules write to opensex, but numbers are stored as varints
+ * instead of decimal text and every distinct word (row types, setters,
+ * metadata keys, flags) is written once and referred to by index after
+ * that.
+ *
+ * File layout, all integers little-endian:
+ *
+ *   header:  "XTBDB\r\n\032" u32 version
+ *   block:   u32 length, u32 crc32 of the payload, payload
+ *
+ * A payload is a run of whole rows; a row is a run of cells, the first
+ * of them its type, ended by BDB_CELL_END.  Strings are written with a
+ * trailing NUL so the loaded file can be used without copying them.
+ * A row may be preceded by BDB_CELL_RESET, which empties the table of
+ * shared words; segments written on other threads start with one.
+ */
+
+#include "atheme.h"
+#ifdef HAVE_FLOCK
+# include <unistd.h>
+# include <sys/file.h>
+#endif
+#ifndef MOWGLI_OS_WIN
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+DECLARE_MODULE_V1
+(
+	"backend/binary", true, _modinit, NULL,
+	PACKAGE_STRING,
+	VENDOR_STRING
+);
+
+#define BDB_MAGIC		"XTBDB\r\n\032"
+#define BDB_MAGICLEN		8
+#define BDB_VERSION		1
+#define BDB_HEADERLEN		(BDB_MAGICLEN + 4)
+#define BDB_BLOCKHDRLEN		8
+#define BDB_BLOCKSIZE		65536
+#define BDB_NUMLEN		24	/* room for any formatted cell number */
+
+enum {
+	BDB_CELL_END = 0,
+	BDB_CELL_WORD,		/* new word: varint length, bytes, NUL */
+	BDB_CELL_WORDREF,	/* varint index of an earlier word */
+	BDB_CELL_STR,		/* varint length, bytes, NUL; not shared */
+	BDB_CELL_INT,		/* zigzag varint */
+	BDB_CELL_UINT,		/* varint */
+	BDB_CELL_TIME,		/* zigzag varint */
+	BDB_CELL_RESET		/* before a row: forget all shared words */
+};
+
+typedef struct {
+	unsigned char tag;
+	const char *s;
+	size_t len;
+	int64_t v;
+} bdb_cell_t;
+
+/* words written so far; a plain hash table since segments fill it on other threads */
+typedef struct {
+	char *s;
+	unsigned int idx;
+} bdb_wstring_t;
+
+typedef struct binary_ {
+	/* Reading state */
+	unsigned char *buf;
+	size_t bufsize;
+	bool mapped;
+	const unsigned char *pos;
+	const unsigned char *block_end;
+
+	const char **strings;
+	size_t nstrings, stringsize;
+
+	bdb_cell_t *cells;
+	size_t ncells, cellsize, cur;
+
+	/* numbers read as words, and joined strings, for the current row */
+	char *scratch;
+	size_t scratchsize, scratchused;
+
+	/* Writing state */
+	FILE *f;
+	unsigned char *block;
+	size_t blocklen, blocksize;
+	bdb_wstring_t *wtable;
+	unsigned int wtablesize, nwstrings;
+	bool reset_pending;
+	bool failed;
+} binary_t;
+
+#ifdef HAVE_FLOCK
+static int lockfd;
+#endif
+
+static uint32_t crc_table[256];
+
+static uint32_t bdb_crc32(const unsigned char *p, size_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	unsigned int i, j;
+
+	if (crc_table[1] == 0)
+	{
+		for (i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+
+			for (j = 0; j < 8; j++)
+				c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			crc_table[i] = c;
+		}
+	}
+
+	while (len--)
+		crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+
+	return crc ^ 0xFFFFFFFF;
+}
+
+static void bdb_put_u32(unsigned char *p, uint32_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+
+static uint32_t bdb_get_u32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void binary_corrupt(database_handle_t *db, const char *what)
+{
+	slog(LG_ERROR, "db-read: %s: %s near row %u", db->file, what, db->line);
+	slog(LG_ERROR, "db-read: exiting to avoid data loss");
+	exit(EXIT_FAILURE);
+}
+
+/***************************************************************************************************/
+
+static void binary_db_parse(database_handle_t *db)
+{
+	const char *cmd;
+	while (db_read_next_row(db))
+	{
+		cmd = db_read_word(db);
+		if (!cmd || !*cmd) continue;
+		db_process(db, cmd);
+	}
+}
+
+static bool binary_next_block(database_handle_t *db)
+{
+	binary_t *rs = (binary_t *)db->priv;
+	const unsigned char *end = rs->buf + rs->bufsize;
+	uint32_t len;
+
+	while (rs->pos < end)
+	{
+		if ((size_t) (end - rs->pos) < BDB_BLOCKHDRLEN)
+			binary_corrupt(db, "truncated block header");
+
+		len = bdb_get_u32(rs->pos);
+		if (len > (size_t) (end - rs->pos) - BDB_BLOCKHDRLEN)
+			binary_corrupt(db, "truncated block");
+
+		if (bdb_crc32(rs->pos + BDB_BLOCKHDRLEN, len) != bdb_get_u32(rs->pos + 4))
+			binary_corrupt(db, "block checksum mismatch");
+
+		rs->pos += BDB_BLOCKHDRLEN;
+		rs->block_end = rs->pos + len;
+
+		if (len > 0)
+			return true;
+	}
+
+	return false;
+}
+
+static bool binary_get_varint(binary_t *rs, uint64_t *v)
+{
+	unsigned int shift = 0;
+
+	*v = 0;
+	while (rs->pos < rs->block_end && shift < 64)
+	{
+		unsigned char c = *rs->pos++;
+
+		*v |= (uint64_t) (c & 0x7F) << shift;
+		if (!(c & 0x80))
+			return true;
+		shift += 7;
+	}
+
+	return false;
+}
+
+static bool binary_get_string(binary_t *rs, bdb_cell_t *c)
+{
+	uint64_t len;
+
+	if (!binary_get_varint(rs, &len) || len >= (uint64_t) (rs->block_end - rs->pos) || rs->pos[len] != '\0')
+		return false;
+
+	c->s = (const char *) rs->pos;
+	c->len = len;
+	rs->pos += len + 1;
+	return true;
+}
+
+static bool binary_read_next_row(database_handle_t *hdl)
+{
+	binary_t *rs = (binary_t *)hdl->priv;
+	bdb_cell_t *c;
+	uint64_t v;
+	size_t need = 1, i;
+
+	for (;;)
+	{
+		if (rs->pos >= rs->block_end && !binary_next_block(hdl))
+			return false;
+		if (*rs->pos != BDB_CELL_RESET)
+			break;
+
+		rs->nstrings = 0;
+		rs->pos++;
+	}
+
+	hdl->line++;
+	hdl->token = 0;
+	rs->ncells = rs->cur = 0;
+
+	for (;;)
+	{
+		if (rs->pos >= rs->block_end)
+			binary_corrupt(hdl, "row runs past end of block");
+
+		if (rs->ncells == rs->cellsize)
+		{
+			rs->cellsize = rs->cellsize ? rs->cellsize * 2 : 32;
+			rs->cells = srealloc(rs->cells, rs->cellsize * sizeof *rs->cells);
+		}
+		c = &rs->cells[rs->ncells];
+		c->tag = *rs->pos++;
+
+		switch (c->tag)
+		{
+			case BDB_CELL_END:
+				goto done;
+			case BDB_CELL_WORD:
+				if (!binary_get_string(rs, c))
+					binary_corrupt(hdl, "malformed word");
+				if (rs->nstrings == rs->stringsize)
+				{
+					rs->stringsize = rs->stringsize ? rs->stringsize * 2 : 1024;
+					rs->strings = srealloc(rs->strings, rs->stringsize * sizeof *rs->strings);
+				}
+				rs->strings[rs->nstrings++] = c->s;
+				break;
+			case BDB_CELL_WORDREF:
+				if (!binary_get_varint(rs, &v) || v >= rs->nstrings)
+					binary_corrupt(hdl, "bad word reference");
+				c->s = rs->strings[v];
+				c->len = strlen(c->s);
+				break;
+			case BDB_CELL_STR:
+				if (!binary_get_string(rs, c))
+					binary_corrupt(hdl, "malformed string");
+				break;
+			case BDB_CELL_INT:
+			case BDB_CELL_TIME:
+				if (!binary_get_varint(rs, &v))
+					binary_corrupt(hdl, "malformed number");
+				c->v = (int64_t) ((v >> 1) ^ -(v & 1));
+				c->s = NULL;
+				break;
+			case BDB_CELL_UINT:
+				if (!binary_get_varint(rs, &v))
+					binary_corrupt(hdl, "malformed number");
+				c->v = (int64_t) v;
+				c->s = NULL;
+				break;
+			default:
+				binary_corrupt(hdl, "unknown cell type");
+		}
+
+		rs->ncells++;
+	}
+
+done:
+	/* enough for every cell as text, which also covers one join */
+	for (i = 0; i < rs->ncells; i++)
+		need += rs->cells[i].s != NULL ? rs->cells[i].len + 1 : BDB_NUMLEN;
+
+	if (need > rs->scratchsize)
+	{
+		rs->scratchsize = need;
+		free(rs->scratch);
+		rs->scratch = smalloc(need);
+	}
+	rs->scratchused = 0;
+
+	return true;
+}
+
+/* writes a cell out as text, returning its length */
+static size_t binary_format_cell(const bdb_cell_t *c, char *dst)
+{
+	if (c->s != NULL)
+	{
+		memcpy(dst, c->s, c->len + 1);
+		return c->len;
+	}
+
+	if (c->tag == BDB_CELL_UINT)
+		return snprintf(dst, BDB_NUMLEN, "%llu", (unsigned long long) c->v);
+	return snprintf(dst, BDB_NUMLEN, "%lld", (long long) c->v);
+}
+
+static const bdb_cell_t *binary_next_cell(database_handle_t *db)
+{
+	binary_t *rs = (binary_t *)db->priv;
+
+	if (rs->cur >= rs->ncells)
+		return NULL;
+
+	db->token++;
+	return &rs->cells[rs->cur++];
+}
+
+static const char *binary_read_word(database_handle_t *db)
+{
+	binary_t *rs = (binary_t *)db->priv;
+	const bdb_cell_t *c = binary_next_cell(db);
+	char *res;
+
+	if (c == NULL)
+		return NULL;
+	if (c->s != NULL)
+		return c->s;
+
+	res = rs->scratch + rs->scratchused;
+	rs->scratchused += binary_format_cell(c, res) + 1;
+	return res;
+}
+
+/* like opensex, a multiword string is the rest of the row */
+static const char *binary_read_str(database_handle_t *db)
+{
+	binary_t *rs = (binary_t *)db->priv;
+	char *res, *p;
+	size_t first = rs->cur;
+
+	if (rs->cur + 1 >= rs->ncells)
+		return binary_read_word(db);
+
+	res = p = rs->scratch + rs->scratchused;
+	for (; rs->cur < rs->ncells; rs->cur++)
+	{
+		if (rs->cur != first)
+			*p++ = ' ';
+		p += binary_format_cell(&rs->cells[rs->cur], p);
+	}
+	rs->scratchused += p - res + 1;
+
+	db->token++;
+	return res;
+}
+
+static bool binary_read_number(database_handle_t *db, long long *res)
+{
+	const bdb_cell_t *c = binary_next_cell(db);
+	char *rp;
+
+	if (c == NULL)
+		return false;
+
+	if (c->s == NULL)
+	{
+		*res = c->v;
+		return true;
+	}
+
+	*res = strtoll(c->s, &rp, 0);
+	return *c->s && !*rp;
+}
+
+static bool binary_read_int(database_handle_t *db, int *res)
+{
+	long long v;
+
+	if (!binary_read_number(db, &v))
+		return false;
+
+	*res = v;
+	return true;
+}
+
+static bool binary_read_uint(database_handle_t *db, unsigned int *res)
+{
+	long long v;
+
+	if (!binary_read_number(db, &v))
+		return false;
+
+	*res = v;
+	return true;
+}
+
+static bool binary_read_time(database_handle_t *db, time_t *res)
+{
+	long long v;
+
+	if (!binary_read_number(db, &v))
+		return false;
+
+	*res = v;
+	return true;
+}
+
+/***************************************************************************************************/
+
+static unsigned char *binary_reserve(binary_t *rs, size_t len)
+{
+	if (rs->blocklen + len > rs->blocksize)
+	{
+		while (rs->blocklen + len > rs->blocksize)
+			rs->blocksize *= 2;
+		rs->block = srealloc(rs->block, rs->blocksize);
+	}
+
+	return rs->block + rs->blocklen;
+}
+
+static void binary_put_varint(binary_t *rs, uint64_t v)
+{
+	unsigned char *p = binary_reserve(rs, 10), *start = p;
+
+	while (v >= 0x80)
+	{
+		*p++ = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+
+	rs->blocklen += p - start;
+}
+
+static void binary_put_tag(binary_t *rs, unsigned char tag)
+{
+	*binary_reserve(rs, 1) = tag;
+	rs->blocklen++;
+}
+
+static void binary_put_string(binary_t *rs, unsigned char tag, const char *s)
+{
+	size_t len = strlen(s);
+
+	binary_put_tag(rs, tag);
+	binary_put_varint(rs, len);
+	memcpy(binary_reserve(rs, len + 1), s, len + 1);
+	rs->blocklen += len + 1;
+}
+
+static unsigned int binary_word_hash(const char *word)
+{
+	unsigned int h = 2166136261U;
+
+	for (; *word != '\0'; word++)
+		h = (h ^ (unsigned char) *word) * 16777619U;
+
+	return h;
+}
+
+static void binary_clear_words(binary_t *rs)
+{
+	unsigned int i;
+
+	for (i = 0; i < rs->wtablesize; i++)
+		free(rs->wtable[i].s);
+	free(rs->wtable);
+
+	rs->wtable = NULL;
+	rs->wtablesize = rs->nwstrings = 0;
+}
+
+static void binary_put_word(binary_t *rs, const char *word)
+{
+	bdb_wstring_t *old, *w;
+	unsigned int i, oldsize;
+
+	/* keep the table at most half full */
+	if (rs->nwstrings * 2 >= rs->wtablesize)
+	{
+		old = rs->wtable;
+		oldsize = rs->wtablesize;
+
+		rs->wtablesize = oldsize ? oldsize * 2 : 4096;
+		rs->wtable = scalloc(rs->wtablesize, sizeof *rs->wtable);
+
+		for (i = 0; i < oldsize; i++)
+		{
+			if (old[i].s == NULL)
+				continue;
+			for (w = &rs->wtable[binary_word_hash(old[i].s) & (rs->wtablesize - 1)]; w->s != NULL;
+					w = w + 1 < rs->wtable + rs->wtablesize ? w + 1 : rs->wtable)
+				;
+			*w = old[i];
+		}
+		free(old);
+	}
+
+	for (w = &rs->wtable[binary_word_hash(word) & (rs->wtablesize - 1)]; w->s != NULL;
+			w = w + 1 < rs->wtable + rs->wtablesize ? w + 1 : rs->wtable)
+	{
+		if (!strcmp(w->s, word))
+		{
+			binary_put_tag(rs, BDB_CELL_WORDREF);
+			binary_put_varint(rs, w->idx);
+			return;
+		}
+	}
+
+	w->s = sstrdup(word);
+	w->idx = rs->nwstrings++;
+	binary_put_string(rs, BDB_CELL_WORD, word);
+}
+
+static void binary_flush_block(binary_t *rs)
+{
+	unsigned char hdr[BDB_BLOCKHDRLEN];
+
+	if (rs->blocklen == 0)
+		return;
+
+	bdb_put_u32(hdr, rs->blocklen);
+	bdb_put_u32(hdr + 4, bdb_crc32(rs->block, rs->blocklen));
+
+	if (fwrite(hdr, sizeof hdr, 1, rs->f) != 1 || fwrite(rs->block, rs->blocklen, 1, rs->f) != 1)
+		rs->failed = true;
+
+	rs->blocklen = 0;
+}
+
+static bool binary_start_row(database_handle_t *db, const char *type)
+{
+	binary_t *rs;
+
+	return_val_if_fail(db != NULL, false);
+	return_val_if_fail(type != NULL, false);
+	rs = (binary_t *)db->priv;
+
+	if (rs->reset_pending)
+	{
+		binary_put_tag(rs, BDB_CELL_RESET);
+		rs->reset_pending = false;
+	}
+
+	binary_put_word(rs, type);
+
+	return true;
+}
+
+static bool binary_write_word(database_handle_t *db, const char *word)
+{
+	return_val_if_fail(db != NULL, false);
+
+	binary_put_word(db->priv, word != NULL ? word : "*");
+	return true;
+}
+
+static bool binary_write_str(database_handle_t *db, const char *str)
+{
+	return_val_if_fail(db != NULL, false);
+
+	binary_put_string(db->priv, BDB_CELL_STR, str != NULL ? str : "*");
+	return true;
+}
+
+static bool binary_write_int(database_handle_t *db, int num)
+{
+	int64_t v = num;
+
+	return_val_if_fail(db != NULL, false);
+
+	binary_put_tag(db->priv, BDB_CELL_INT);
+	binary_put_varint(db->priv, ((uint64_t) v << 1) ^ (uint64_t) (v >> 63));
+	return true;
+}
+
+static bool binary_write_uint(database_handle_t *db, unsigned int num)
+{
+	return_val_if_fail(db != NULL, false);
+
+	binary_put_tag(db->priv, BDB_CELL_UINT);
+	binary_put_varint(db->priv, num);
+	return true;
+}
+
+static bool binary_write_time(database_handle_t *db, time_t tm)
+{
+	int64_t v = tm;
+
+	return_val_if_fail(db != NULL, false);
+
+	binary_put_tag(db->priv, BDB_CELL_TIME);
+	binary_put_varint(db->priv, ((uint64_t) v << 1) ^ (uint64_t) (v >> 63));
+	return true;
+}
+
+static bool binary_commit_row(database_handle_t *db)
+{
+	binary_t *rs;
+
+	return_val_if_fail(db != NULL, false);
+	rs = (binary_t *)db->priv;
+
+	binary_put_tag(rs, BDB_CELL_END);
+	if (rs->blocklen >= BDB_BLOCKSIZE)
+		binary_flush_block(rs);
+
+	return true;
+}
+
+static database_vtable_t binary_vt = {
+	.name = "binary",
+
+	.read_next_row = binary_read_next_row,
+
+	.read_word = binary_read_word,
+	.read_str = binary_read_str,
+	.read_int = binary_read_int,
+	.read_uint = binary_read_uint,
+	.read_time = binary_read_time,
+
+	.start_row = binary_start_row,
+	.write_word = binary_write_word,
+	.write_str = binary_write_str,
+	.write_int = binary_write_int,
+	.write_uint = binary_write_uint,
+	.write_time = binary_write_time,
+	.commit_row = binary_commit_row
+};
+
+/*
+ * Brings the whole database into memory, mapped where possible; strings
+ * are NUL terminated in the file, so nothing is ever written to it.
+ */
+static bool binary_load_file(binary_t *rs, int fd, const char *path)
+{
+	struct stat sb;
+	size_t done = 0;
+	ssize_t l;
+
+	if (fstat(fd, &sb) < 0)
+		return false;
+
+	rs->bufsize = sb.st_size;
+
+#ifndef MOWGLI_OS_WIN
+	if (rs->bufsize > 0)
+	{
+		rs->buf = mmap(NULL, rs->bufsize, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (rs->buf != MAP_FAILED)
+		{
+			(void) madvise(rs->buf, rs->bufsize, MADV_SEQUENTIAL);
+			rs->mapped = true;
+			return true;
+		}
+
+		slog(LG_DEBUG, "db-open-read: mmap of '%s' failed (%s), reading it instead", path, strerror(errno));
+	}
+#endif
+
+	rs->buf = smalloc(rs->bufsize + 1);
+	while (done < rs->bufsize)
+	{
+		l = read(fd, rs->buf + done, rs->bufsize - done);
+		if (l < 0 && errno == EINTR)
+			continue;
+		if (l <= 0)
+			break;
+		done += l;
+	}
+	if (done != rs->bufsize)
+	{
+		free(rs->buf);
+		rs->buf = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+static database_handle_t *binary_db_open_read(const char *filename)
+{
+	database_handle_t *db;
+	binary_t *rs;
+	int fd;
+	int errno1;
+	uint32_t version;
+	char path[BUFSIZE];
+
+	snprintf(path, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.bdb");
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		errno1 = errno;
+
+		/* ENOENT can happen if the database does not exist yet. */
+		if (errno == ENOENT)
+		{
+			slog(LG_ERROR, "db-open-read: database '%s' does not yet exist; a new one will be created.", path);
+			return NULL;
+		}
+
+		slog(LG_ERROR, "db-open-read: cannot open '%s' for reading: %s", path, strerror(errno1));
+		wallops(_("\2DATABASE ERROR\2: db-open-read: cannot open '%s' for reading: %s"), path, strerror(errno1));
+		return NULL;
+	}
+
+	rs = scalloc(sizeof(binary_t), 1);
+
+	if (!binary_load_file(rs, fd, path))
+	{
+		errno1 = errno;
+		slog(LG_ERROR, "db-open-read: cannot read '%s': %s", path, strerror(errno1));
+		slog(LG_ERROR, "db-open-read: exiting to avoid data loss");
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
+
+	if (rs->bufsize < BDB_HEADERLEN || memcmp(rs->buf, BDB_MAGIC, BDB_MAGICLEN))
+	{
+		slog(LG_ERROR, "db-open-read: '%s' is not a binary database (use dbconvert to convert an opensex one)", path);
+		slog(LG_ERROR, "db-open-read: exiting to avoid data loss");
+		exit(EXIT_FAILURE);
+	}
+
+	version = bdb_get_u32(rs->buf + BDB_MAGICLEN);
+	if (version > BDB_VERSION)
+	{
+		slog(LG_ERROR, "db-open-read: '%s' has format version %u, newer than the supported %u", path, version, BDB_VERSION);
+		slog(LG_ERROR, "db-open-read: exiting to avoid data loss");
+		exit(EXIT_FAILURE);
+	}
+
+	rs->pos = rs->block_end = rs->buf + BDB_HEADERLEN;
+
+	db = scalloc(sizeof(database_handle_t), 1);
+	db->priv = rs;
+	db->vt = &binary_vt;
+	db->txn = DB_READ;
+	db->file = sstrdup(path);
+	db->line = 0;
+	db->token = 0;
+
+	return db;
+}
+
+static database_handle_t *binary_db_open_write(const char *filename)
+{
+	database_handle_t *db;
+	binary_t *rs;
+	int fd;
+	FILE *f;
+	int errno1;
+	unsigned char hdr[BDB_HEADERLEN];
+	char bpath[BUFSIZE], path[BUFSIZE];
+#ifdef HAVE_FLOCK
+	char lpath[BUFSIZE];
+#endif
+
+	snprintf(bpath, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.bdb");
+
+	mowgli_strlcpy(path, bpath, sizeof path);
+	mowgli_strlcat(path, ".new", sizeof path);
+
+#ifdef HAVE_FLOCK
+	mowgli_strlcpy(lpath, bpath, sizeof lpath);
+	mowgli_strlcat(lpath, ".lock", sizeof lpath);
+
+	lockfd = open(lpath, O_RDONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+	flock(lockfd, LOCK_EX);
+#endif
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+	if (fd < 0 || ! (f = fdopen(fd, "wb")))
+	{
+		errno1 = errno;
+		slog(LG_ERROR, "db-open-write: cannot open '%s' for writing: %s", path, strerror(errno1));
+		wallops(_("\2DATABASE ERROR\2: db-open-write: cannot open '%s' for writing: %s"), path, strerror(errno1));
+#ifdef HAVE_FLOCK
+		close(lockfd);
+#endif
+		return NULL;
+	}
+
+	rs = scalloc(sizeof(binary_t), 1);
+	rs->f = f;
+	rs->blocksize = BDB_BLOCKSIZE * 2;
+	rs->block = smalloc(rs->blocksize);
+
+	memcpy(hdr, BDB_MAGIC, BDB_MAGICLEN);
+	bdb_put_u32(hdr + BDB_MAGICLEN, BDB_VERSION);
+	if (fwrite(hdr, sizeof hdr, 1, f) != 1)
+		rs->failed = true;
+
+	db = scalloc(sizeof(database_handle_t), 1);
+	db->priv = rs;
+	db->vt = &binary_vt;
+	db->txn = DB_WRITE;
+	db->file = sstrdup(bpath);
+	db->line = 0;
+	db->token = 0;
+
+	return db;
+}
+
+static database_handle_t *binary_db_open(const char *filename, database_transaction_t txn)
+{
+	if (txn == DB_WRITE)
+		return binary_db_open_write(filename);
+	return binary_db_open_read(filename);
+}
+
+/*
+ * Segments get their own table of shared words and start with a reset,
+ * so they can be written without touching the parent; the parent resets
+ * after each append for the same reason.
+ */
+static database_handle_t *binary_db_open_segment(database_handle_t *parent)
+{
+	database_handle_t *db;
+	binary_t *rs;
+	FILE *f;
+
+	if ((f = tmpfile()) == NULL)
+	{
+		slog(LG_DEBUG, "db-open-segment: tmpfile() failed: %s", strerror(errno));
+		return NULL;
+	}
+
+	rs = scalloc(sizeof(binary_t), 1);
+	rs->f = f;
+	rs->blocksize = BDB_BLOCKSIZE * 2;
+	rs->block = smalloc(rs->blocksize);
+	rs->reset_pending = true;
+
+	db = scalloc(sizeof(database_handle_t), 1);
+	db->priv = rs;
+	db->vt = &binary_vt;
+	db->txn = DB_WRITE;
+	db->file = sstrdup(parent->file);
+
+	return db;
+}
+
+static void binary_db_append_segment(database_handle_t *parent, database_handle_t *segment)
+{
+	binary_t *prs = parent->priv, *rs = segment->priv;
+	unsigned char buf[BDB_BLOCKSIZE];
+	size_t l;
+
+	binary_flush_block(prs);
+	binary_flush_block(rs);
+
+	rewind(rs->f);
+	while ((l = fread(buf, 1, sizeof buf, rs->f)) > 0)
+		if (fwrite(buf, 1, l, prs->f) != l)
+			prs->failed = true;
+	if (ferror(rs->f) || rs->failed)
+		prs->failed = true;
+
+	binary_clear_words(prs);
+	prs->reset_pending = true;
+
+	fclose(rs->f);
+	binary_clear_words(rs);
+	free(rs->block);
+	free(rs);
+	free(segment->file);
+	free(segment);
+}
+
+static bool binary_db_close(database_handle_t *db)
+{
+	binary_t *rs;
+	bool committed = true;
+	int errno1;
+	char oldpath[BUFSIZE], newpath[BUFSIZE];
+
+	return_val_if_fail(db != NULL, false);
+	rs = db->priv;
+
+	mowgli_strlcpy(oldpath, db->file, sizeof oldpath);
+	mowgli_strlcat(oldpath, ".new", sizeof oldpath);
+
+	mowgli_strlcpy(newpath, db->file, sizeof newpath);
+
+	if (db->txn == DB_WRITE)
+	{
+		binary_flush_block(rs);
+		if (fclose(rs->f) != 0)
+			rs->failed = true;
+
+		/* never replace a good database with a short one */
+		if (rs->failed)
+		{
+			errno1 = errno;
+			slog(LG_ERROR, "db_save(): cannot write %s: %s", oldpath, strerror(errno1));
+			wallops(_("\2DATABASE ERROR\2: db_save(): cannot write %s: %s"), oldpath, strerror(errno1));
+			committed = false;
+		}
+		else if (srename(oldpath, newpath) < 0)
+		{
+			errno1 = errno;
+			slog(LG_ERROR, "db_save(): cannot rename %s to %s: %s", oldpath, newpath, strerror(errno1));
+			wallops(_("\2DATABASE ERROR\2: db_save(): cannot rename %s to %s: %s"), oldpath, newpath, strerror(errno1));
+			committed = false;
+		}
+#ifdef HAVE_FLOCK
+		close(lockfd);
+#endif
+		binary_clear_words(rs);
+		free(rs->block);
+	}
+
+#ifndef MOWGLI_OS_WIN
+	if (rs->mapped)
+		munmap(rs->buf, rs->bufsize);
+	else
+#endif
+		free(rs->buf);
+	free(rs->strings);
+	free(rs->cells);
+	free(rs->scratch);
+	free(rs);
+	free(db->file);
+	free(db);
+
+	return committed;
+}
+
+static database_module_t binary_mod = {
+	.db_open = binary_db_open,
+	.db_close = binary_db_close,
+	.db_parse = binary_db_parse,
+	.db_open_segment = binary_db_open_segment,
+	.db_append_segment = binary_db_append_segment,
+};
+
+void _modinit(module_t *m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "backend/corestorage");
+
+	m->mflags = MODTYPE_CORE;
+
+	db_mod = &binary_mod;
+
+	backend_loaded = true;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
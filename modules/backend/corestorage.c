@@ -19,6 +19,10 @@
 
 #include "atheme.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 DECLARE_MODULE_V1
 (
 	"backend/corestorage", true, _modinit, NULL,
@@ -33,29 +37,22 @@ extern mowgli_list_t modules;
 
 static void corestorage_db_write(void *filename, db_save_strategy_t strategy);
 static void corestorage_db_write_blocking(void *filename);
+static bool corestorage_db_write_file(void *filename, bool parallel);
 static void corestorage_db_saved_cb(pid_t, int, void*);
 
-/* write atheme.db (core fields) */
+/*
+ * The core rows are written in four partitions.  Other than the header,
+ * each one only reads the object store and formats with the reentrant
+ * flag helpers, so a background save can serialize them on separate
+ * threads into segments that are appended in this order afterwards.
+ */
+
+/* DBV, MDEP, LUID, CF */
 static void
-corestorage_db_save(database_handle_t *db)
+corestorage_save_header(database_handle_t *db)
 {
-	metadata_t *md;
-	myuser_t *mu;
-	myentity_t *ment;
-	myuser_name_t *mun;
-	mychan_t *mc;
-	chanacs_t *ca;
-	kline_t *k;
-	zline_t *z;
-	xline_t *x;
-	qline_t *q;
-	svsignore_t *svsignore;
-	soper_t *soper;
-	mowgli_node_t *n, *tn;
-	mowgli_patricia_iteration_state_t state;
-	myentity_iteration_state_t mestate;
-
-	errno = 0;
+	mowgli_node_t *n;
+	char flagbuf[FLAGS_BUFLEN];
 
 	/* write the database version */
 	db_start_row(db, "DBV");
@@ -76,10 +73,21 @@ corestorage_db_save(database_handle_t *db)
 	db_commit_row(db);
 
 	db_start_row(db, "CF");
-	db_write_word(db, bitmask_to_flags(ca_all));
+	db_write_word(db, bitmask_to_flags_r(ca_all, flagbuf));
 	db_commit_row(db);
+}
 
-	slog(LG_DEBUG, "db_save(): saving myusers");
+/* accounts and everything hanging off them */
+static void
+corestorage_save_myusers(database_handle_t *db)
+{
+	metadata_t *md;
+	myuser_t *mu;
+	myentity_t *ment;
+	mowgli_node_t *tn;
+	object_map_iteration_state_t state;
+	myentity_iteration_state_t mestate;
+	char flagbuf[FLAGS_BUFLEN];
 
 	MYENTITY_FOREACH_T(ment, &mestate, ENT_USER)
 	{
@@ -89,7 +97,7 @@ corestorage_db_save(database_handle_t *db)
 		 *
 		 *  * failnum, lastfail, and lastfailon are deprecated (moved to metadata)
 		 */
-		char *flags = gflags_tostr(mu_flags, MOWGLI_LIST_LENGTH(&mu->logins) ? mu->flags & ~MU_NOBURSTLOGIN : mu->flags);
+		char *flags = gflags_tostr_r(mu_flags, MOWGLI_LIST_LENGTH(&mu->logins) ? mu->flags & ~MU_NOBURSTLOGIN : mu->flags, flagbuf);
 		db_start_row(db, "MU");
 		db_write_word(db, entity(mu)->id);
 		db_write_word(db, entity(mu)->name);
@@ -103,7 +111,7 @@ corestorage_db_save(database_handle_t *db)
 
 		if (object(mu)->metadata)
 		{
-			MOWGLI_PATRICIA_FOREACH(md, &state, object(mu)->metadata)
+			METADATA_FOREACH(md, &state, mu)
 			{
 				db_start_row(db, "MDU");
 				db_write_word(db, entity(mu)->name);
@@ -164,17 +172,25 @@ corestorage_db_save(database_handle_t *db)
 			db_commit_row(db);
 		}
 	}
+}
 
-	/* XXX: groupserv hack.  remove when we have proper dependency resolution. --nenolod */
-	hook_call_db_write_pre_ca(db);
-
-	slog(LG_DEBUG, "db_save(): saving mychans");
+/* channels and their access lists */
+static void
+corestorage_save_mychans(database_handle_t *db)
+{
+	metadata_t *md;
+	myuser_t *mu;
+	mychan_t *mc;
+	chanacs_t *ca;
+	mowgli_node_t *tn;
+	mowgli_patricia_iteration_state_t state;
+	char flagbuf[FLAGS_BUFLEN];
 
 	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
 	{
-		mowgli_patricia_iteration_state_t state2;
+		object_map_iteration_state_t state2;
 
-		char *flags = gflags_tostr(mc_flags, mc->flags);
+		char *flags = gflags_tostr_r(mc_flags, mc->flags, flagbuf);
 		/* find a founder */
 		mu = NULL;
 		MOWGLI_ITER_FOREACH(tn, mc->chanacs.head)
@@ -206,7 +222,7 @@ corestorage_db_save(database_handle_t *db)
 			db_start_row(db, "CA");
 			db_write_word(db, ca->mychan->name);
 			db_write_word(db, ca->entity ? ca->entity->name : ca->host);
-			db_write_word(db, bitmask_to_flags(ca->level));
+			db_write_word(db, bitmask_to_flags_r(ca->level, flagbuf));
 			db_write_time(db, ca->tmodified);
 
 			if (*ca->setter_uid != '\0' && (setter = myentity_find_uid(ca->setter_uid)))
@@ -217,7 +233,7 @@ corestorage_db_save(database_handle_t *db)
 
 			if (object(ca)->metadata)
 			{
-				MOWGLI_PATRICIA_FOREACH(md, &state2, object(ca)->metadata)
+				METADATA_FOREACH(md, &state2, ca)
 				{
 					db_start_row(db, "MDA");
 					db_write_word(db, ca->mychan->name);
@@ -231,7 +247,7 @@ corestorage_db_save(database_handle_t *db)
 
 		if (object(mc)->metadata)
 		{
-			MOWGLI_PATRICIA_FOREACH(md, &state2, object(mc)->metadata)
+			METADATA_FOREACH(md, &state2, mc)
 			{
 				db_start_row(db, "MDC");
 				db_write_word(db, mc->name);
@@ -241,11 +257,28 @@ corestorage_db_save(database_handle_t *db)
 			}
 		}
 	}
+}
+
+/* old names, services ignores and operators, network bans */
+static void
+corestorage_save_misc(database_handle_t *db)
+{
+	metadata_t *md;
+	myuser_name_t *mun;
+	kline_t *k;
+	zline_t *z;
+	xline_t *x;
+	qline_t *q;
+	svsignore_t *svsignore;
+	soper_t *soper;
+	mowgli_node_t *n;
+	mowgli_patricia_iteration_state_t state;
+	char flagbuf[FLAGS_BUFLEN];
 
 	/* Old names */
 	MOWGLI_PATRICIA_FOREACH(mun, &state, oldnameslist)
 	{
-		mowgli_patricia_iteration_state_t state2;
+		object_map_iteration_state_t state2;
 
 		db_start_row(db, "NAM");
 		db_write_word(db, mun->name);
@@ -253,7 +286,7 @@ corestorage_db_save(database_handle_t *db)
 
 		if (object(mun)->metadata)
 		{
-			MOWGLI_PATRICIA_FOREACH(md, &state2, object(mun)->metadata)
+			METADATA_FOREACH(md, &state2, mun)
 			{
 				db_start_row(db, "MDN");
 				db_write_word(db, mun->name);
@@ -265,8 +298,6 @@ corestorage_db_save(database_handle_t *db)
 	}
 
 	/* Services ignores */
-	slog(LG_DEBUG, "db_save(): saving svsignores");
-
 	MOWGLI_ITER_FOREACH(n, svs_ignore_list.head)
 	{
 		svsignore = (svsignore_t *)n->data;
@@ -281,13 +312,11 @@ corestorage_db_save(database_handle_t *db)
 	}
 
 	/* Services operators */
-	slog(LG_DEBUG, "db_save(): saving sopers");
-
 	MOWGLI_ITER_FOREACH(n, soperlist.head)
 	{
 		const char *flags;
 		soper = n->data;
-		flags = gflags_tostr(soper_flags, soper->flags);
+		flags = gflags_tostr_r(soper_flags, soper->flags, flagbuf);
 
 		if (soper->flags & SOPER_CONF || soper->myuser == NULL)
 			continue;
@@ -304,8 +333,6 @@ corestorage_db_save(database_handle_t *db)
 		db_commit_row(db);
 	}
 
-	slog(LG_DEBUG, "db_save(): saving klines");
-
 	db_start_row(db, "KID");
 	db_write_uint(db, me.kline_id);
 	db_commit_row(db);
@@ -326,8 +353,6 @@ corestorage_db_save(database_handle_t *db)
 		db_commit_row(db);
 	}
 
-	slog(LG_DEBUG, "db_save(): saving zlines");
-
 	db_start_row(db, "ZID");
 	db_write_uint(db, me.zline_id);
 	db_commit_row(db);
@@ -347,8 +372,6 @@ corestorage_db_save(database_handle_t *db)
 		db_commit_row(db);
 	}
 
-	slog(LG_DEBUG, "db_save(): saving xlines");
-
 	db_start_row(db, "XID");
 	db_write_uint(db, me.xline_id);
 	db_commit_row(db);
@@ -388,6 +411,110 @@ corestorage_db_save(database_handle_t *db)
 	}
 }
 
+/* write atheme.db (core fields) */
+static void
+corestorage_db_save(database_handle_t *db)
+{
+	errno = 0;
+
+	corestorage_save_header(db);
+
+	slog(LG_DEBUG, "db_save(): saving myusers");
+	corestorage_save_myusers(db);
+
+	/* XXX: groupserv hack.  remove when we have proper dependency resolution. --nenolod */
+	hook_call_db_write_pre_ca(db);
+
+	slog(LG_DEBUG, "db_save(): saving mychans");
+	corestorage_save_mychans(db);
+
+	slog(LG_DEBUG, "db_save(): saving names, svsignores, sopers and network bans");
+	corestorage_save_misc(db);
+}
+
+#ifdef HAVE_PTHREAD
+typedef struct {
+	void (*save)(database_handle_t *db);
+	database_handle_t *db;
+	pthread_t thread;
+	bool threaded;
+} corestorage_part_t;
+
+static void *corestorage_part_thread(void *arg)
+{
+	corestorage_part_t *part = arg;
+
+	part->save(part->db);
+	return NULL;
+}
+
+/*
+ * Background saves: each core partition goes to a segment on its own
+ * thread while this one runs the hooks into segments of their own; the
+ * segments are then appended in the same order corestorage_db_save()
+ * and hook_call_db_write() would have written them.  Returns false,
+ * having written nothing, if the backend cannot do segments.
+ */
+static bool corestorage_db_save_parallel(database_handle_t *db)
+{
+	corestorage_part_t parts[] = {
+		{ corestorage_save_myusers },
+		{ corestorage_save_mychans },
+		{ corestorage_save_misc },
+	};
+	database_handle_t *pre_ca, *modrows;
+	size_t i;
+	bool ok;
+
+	pre_ca = db_open_segment(db);
+	modrows = db_open_segment(db);
+	ok = pre_ca != NULL && modrows != NULL;
+	for (i = 0; i < ARRAY_SIZE(parts); i++)
+		ok = (parts[i].db = db_open_segment(db)) != NULL && ok;
+
+	if (!ok)
+	{
+		/* nothing was written to them yet */
+		if (pre_ca != NULL)
+			db_append_segment(db, pre_ca);
+		if (modrows != NULL)
+			db_append_segment(db, modrows);
+		for (i = 0; i < ARRAY_SIZE(parts); i++)
+			if (parts[i].db != NULL)
+				db_append_segment(db, parts[i].db);
+		return false;
+	}
+
+	errno = 0;
+
+	corestorage_save_header(db);
+
+	for (i = 0; i < ARRAY_SIZE(parts); i++)
+		parts[i].threaded = pthread_create(&parts[i].thread, NULL, corestorage_part_thread, &parts[i]) == 0;
+
+	/* XXX: groupserv hack.  remove when we have proper dependency resolution. --nenolod */
+	hook_call_db_write_pre_ca(pre_ca);
+	hook_call_db_write(modrows);
+
+	for (i = 0; i < ARRAY_SIZE(parts); i++)
+	{
+		if (parts[i].threaded)
+			pthread_join(parts[i].thread, NULL);
+		else
+			parts[i].save(parts[i].db);
+	}
+
+	db_append_segment(db, parts[0].db);
+	db_append_segment(db, pre_ca);
+	db_append_segment(db, parts[1].db);
+	db_append_segment(db, parts[2].db);
+	db_append_segment(db, modrows);
+
+	slog(LG_DEBUG, "db_save(): wrote %zu partitions in parallel", ARRAY_SIZE(parts));
+	return true;
+}
+#endif
+
 static void corestorage_h_unknown(database_handle_t *db, const char *type)
 {
 	slog(LG_ERROR, "db %s:%d: unknown directive '%s'", db->file, db->line, type);
@@ -868,8 +995,7 @@ static void corestorage_h_kl(database_handle_t *db, const char *type)
 	strip(buf);
 
 	k = kline_add_with_id(user, host, buf, duration, setby, id ? id : ++me.kline_id);
-	k->settime = settime;
-	k->expires = k->settime + k->duration;
+	kline_set_settime(k, settime);
 }
 
 static void corestorage_h_zid(database_handle_t *db, const char *type)
@@ -899,8 +1025,7 @@ static void corestorage_h_zl(database_handle_t *db, const char *type)
 	strip(buf);
 
 	z = zline_add_with_id(host, buf, duration, setby, id ? id : ++me.zline_id);
-	z->settime = settime;
-	z->expires = z->settime + z->duration;
+	zline_set_settime(z, settime);
 }
 
 static void corestorage_h_xid(database_handle_t *db, const char *type)
@@ -930,8 +1055,7 @@ static void corestorage_h_xl(database_handle_t *db, const char *type)
 	strip(buf);
 
 	x = xline_add(realname, buf, duration, setby);
-	x->settime = settime;
-	x->expires = x->settime + x->duration;
+	xline_set_settime(x, settime);
 
 	if (id)
 		x->number = id;
@@ -964,8 +1088,7 @@ static void corestorage_h_ql(database_handle_t *db, const char *type)
 	strip(buf);
 
 	q = qline_add(mask, buf, duration, setby);
-	q->settime = settime;
-	q->expires = q->settime + q->duration;
+	qline_set_settime(q, settime);
 
 	if (id)
 		q->number = id;
@@ -979,12 +1102,29 @@ static void corestorage_ignore_row(database_handle_t *db, const char *type)
 static void corestorage_db_load(const char *filename)
 {
 	database_handle_t *db;
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval load_start, load_time;
+	unsigned int rows;
+	int ms;
+
+	s_time(&load_start);
+#endif
 
 	db = db_open(filename, DB_READ);
 	if (db == NULL)
 		return;
 
 	db_parse(db);
+
+#ifdef HAVE_GETTIMEOFDAY
+	/* keep an eye on cold start cost as databases grow */
+	rows = db->line;
+	e_time(load_start, &load_time);
+	ms = tv2ms(&load_time);
+	slog(LG_INFO, "db_load(): loaded %u rows from %s in %d ms (%u rows/s)", rows, db->file, ms,
+			ms > 0 ? (unsigned int) (rows * 1000ULL / ms) : rows);
+#endif
+
 	db_close(db);
 }
 
@@ -995,11 +1135,17 @@ static void corestorage_db_saved_cb(pid_t pid, int status, void *data)
 {
 	if (child_pid != pid)
 		return; /* probably killed our child for a forced write */
-	else
+
+	child_pid = 0;
+
+	/* the child only exits successfully once the new database is in place */
+	if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)
 	{
-		child_pid = 0;
 		slog(LG_DEBUG, "db_save(): finished asynchronous DB write");
+		hook_call_db_saved();
 	}
+	else
+		slog(LG_ERROR, "db_save(): asynchronous DB write failed");
 }
 #endif
 
@@ -1040,8 +1186,8 @@ static void corestorage_db_write(void *filename, db_save_strategy_t strategy)
 			return;
 
 		case 0:
-			corestorage_db_write_blocking(filename);
-			exit(EXIT_SUCCESS);
+			/* the child has the object store to itself */
+			exit(corestorage_db_write_file(filename, true) ? EXIT_SUCCESS : EXIT_FAILURE);
 
 		default:
 			child_pid = pid;
@@ -1052,6 +1198,12 @@ static void corestorage_db_write(void *filename, db_save_strategy_t strategy)
 }
 
 static void corestorage_db_write_blocking(void *filename)
+{
+	if (corestorage_db_write_file(filename, false))
+		hook_call_db_saved();
+}
+
+static bool corestorage_db_write_file(void *filename, bool parallel)
 {
 	database_handle_t *db;
 
@@ -1060,13 +1212,18 @@ static void corestorage_db_write_blocking(void *filename)
 	if (! db)
 	{
 		slog(LG_ERROR, "db_write_blocking(): db_open() failed, aborting save");
-		return;
+		return false;
 	}
 
-	corestorage_db_save(db);
-	hook_call_db_write(db);
+#ifdef HAVE_PTHREAD
+	if (!parallel || !corestorage_db_save_parallel(db))
+#endif
+	{
+		corestorage_db_save(db);
+		hook_call_db_write(db);
+	}
 
-	db_close(db);
+	return db_close(db);
 }
 
 void _modinit(module_t *m)
@@ -1078,6 +1235,7 @@ void _modinit(module_t *m)
 
 	db_register_type_handler("DBV", corestorage_h_dbv);
 	db_register_type_handler("MDEP", corestorage_ignore_row);
+	db_register_type_handler("JSEQ", corestorage_ignore_row);
 	db_register_type_handler("LUID", corestorage_h_luid);
 	db_register_type_handler("CF", corestorage_h_cf);
 	db_register_type_handler("MU", corestorage_h_mu);
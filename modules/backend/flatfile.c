@@ -626,9 +626,7 @@ static void flatfile_db_load(const char *filename)
 			strip(reason);
 
 			k = kline_add(user, host, reason, duration, setby);
-			k->settime = settime;
-			/* XXX this is not nice, oh well -- jilles */
-			k->expires = k->settime + k->duration;
+			kline_set_settime(k, settime);
 
 			kin++;
 		}
@@ -656,9 +654,7 @@ static void flatfile_db_load(const char *filename)
 			strip(reason);
 
 			z = zline_add(host, reason, duration, setby);
-			z->settime = settime;
-			/* XXX this is not nice, oh well -- jilles */
-			z->expires = z->settime + z->duration;
+			zline_set_settime(z, settime);
 
 			zin++;
 		}
@@ -685,10 +681,7 @@ static void flatfile_db_load(const char *filename)
 			strip(reason);
 
 			x = xline_add(realname, reason, duration, setby);
-			x->settime = settime;
-
-			/* XXX this is not nice, oh well -- jilles */
-			x->expires = x->settime + x->duration;
+			xline_set_settime(x, settime);
 
 			xin++;
 		}
@@ -715,10 +708,7 @@ static void flatfile_db_load(const char *filename)
 			strip(reason);
 
 			q = qline_add(mask, reason, duration, setby);
-			q->settime = settime;
-
-			/* XXX this is not nice, oh well -- jilles */
-			q->expires = q->settime + q->duration;
+			qline_set_settime(q, settime);
 
 			qin++;
 		}
@@ -0,0 +1,647 @@
+/*
+ * Copyright (c) 2014-2018 Xtheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Append-only journal of account, nick, channel, access list and metadata
+ * changes.  Every change is appended to services.db.journal.<n> as it
+ * happens; at startup the journals newer than the snapshot are replayed on
+ * top of it, so nothing between two database saves is lost in a crash.
+ * Each save starts a new journal and, once the snapshot is in place,
+ * removes the ones it covers.
+ *
+ * Passwords, SET flags, holds, verification and mlocks are journaled by
+ * their commands.  Other fields written directly (lastlogin and channel
+ * used timestamps, runtime-only flags) are not, so for those the snapshot
+ * interval still bounds what a crash can lose.
+ */
+
+#include "atheme.h"
+#include <dirent.h>
+
+DECLARE_MODULE_V1
+(
+	"backend/journal", true, _modinit, NULL,
+	PACKAGE_STRING,
+	VENDOR_STRING
+);
+
+#define JOURNAL_PREFIX		"services.db.journal."
+#define JOURNAL_RECORDLEN	8192
+
+static int journal_fd = -1;
+static unsigned int journal_seq = 0;		/* journal being appended to */
+static unsigned int journal_snapshot_seq = 0;	/* first journal the loaded snapshot lacks */
+static bool journal_active = false;
+
+static void (*journal_next_load)(const char *filename);
+static void (*journal_next_save)(void *arg, db_save_strategy_t strategy);
+
+/***************************************************************************************************/
+
+static void journal_path(char *buf, size_t len, unsigned int seq)
+{
+	snprintf(buf, len, "%s/%s%u", datadir, JOURNAL_PREFIX, seq);
+}
+
+static void journal_open(unsigned int seq)
+{
+	char path[BUFSIZE];
+
+	if (journal_fd >= 0)
+		close(journal_fd);
+
+	journal_seq = seq;
+	journal_path(path, sizeof path, seq);
+
+	journal_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+	if (journal_fd < 0)
+	{
+		slog(LG_ERROR, "journal: cannot open '%s' for writing: %s", path, strerror(errno));
+		wallops(_("\2DATABASE ERROR\2: journal: cannot open '%s' for writing: %s"), path, strerror(errno));
+		return;
+	}
+
+#ifdef FD_CLOEXEC
+	fcntl(journal_fd, F_SETFD, FD_CLOEXEC);
+#endif
+}
+
+/* J <length of the rest> <op> <args...>; the length catches a torn last line */
+static void PRINTFLIKE(1, 2) journal_write(const char *fmt, ...)
+{
+	char body[JOURNAL_RECORDLEN], line[JOURNAL_RECORDLEN + 32];
+	va_list va;
+	int len, l;
+
+	if (journal_fd < 0)
+		return;
+
+	va_start(va, fmt);
+	len = vsnprintf(body, sizeof body, fmt, va);
+	va_end(va);
+
+	if (len < 0 || (size_t) len >= sizeof body)
+	{
+		slog(LG_ERROR, "journal: record too long, left for the next snapshot");
+		return;
+	}
+
+	l = snprintf(line, sizeof line, "J %d %s\n", len, body);
+	if (write(journal_fd, line, l) != l)
+		slog(LG_ERROR, "journal: write to %s%u failed: %s", JOURNAL_PREFIX, journal_seq, strerror(errno));
+}
+
+static const char *journal_chanacs_target(chanacs_t *ca)
+{
+	return ca->entity != NULL ? ca->entity->name : ca->host;
+}
+
+static void journal_write_myuser(myuser_t *mu)
+{
+	unsigned int flags = MOWGLI_LIST_LENGTH(&mu->logins) ? mu->flags & ~MU_NOBURSTLOGIN : mu->flags;
+
+	journal_write("MU %s %s %s %s %lu %lu %s %s", entity(mu)->id, entity(mu)->name,
+			*mu->pass != '\0' ? mu->pass : "*", mu->email,
+			(unsigned long) mu->registered, (unsigned long) mu->lastlogin,
+			gflags_tostr(mu_flags, flags), language_get_name(mu->language));
+}
+
+static void journal_write_mychan(mychan_t *mc)
+{
+	journal_write("MC %s %lu %lu %s %u %u %u %s", mc->name,
+			(unsigned long) mc->registered, (unsigned long) mc->used,
+			gflags_tostr(mc_flags, mc->flags), mc->mlock_on, mc->mlock_off,
+			mc->mlock_limit, mc->mlock_key != NULL ? mc->mlock_key : "");
+}
+
+static void journal_write_chanacs(chanacs_t *ca)
+{
+	myentity_t *setter = NULL;
+
+	if (*ca->setter_uid != '\0')
+		setter = myentity_find_uid(ca->setter_uid);
+
+	journal_write("CA %s %s %s %lu %s", ca->mychan->name, journal_chanacs_target(ca),
+			bitmask_to_flags(ca->level), (unsigned long) ca->tmodified,
+			setter != NULL ? setter->name : "*");
+}
+
+static void journal_write_metadata(void *object, const char *key, bool drop)
+{
+	metadata_t *md = NULL;
+	char owner[BUFSIZE];
+	const char *kind;
+
+	switch (db_object_type(object))
+	{
+		case DB_OBJECT_MYUSER:
+			kind = "U";
+			mowgli_strlcpy(owner, entity(object)->name, sizeof owner);
+			break;
+		case DB_OBJECT_MYCHAN:
+			kind = "C";
+			mowgli_strlcpy(owner, ((mychan_t *) object)->name, sizeof owner);
+			break;
+		case DB_OBJECT_CHANACS:
+			kind = "A";
+			snprintf(owner, sizeof owner, "%s %s", ((chanacs_t *) object)->mychan->name,
+					journal_chanacs_target(object));
+			break;
+		default:
+			return;
+	}
+
+	if (drop)
+	{
+		journal_write("MDD %s %s %s", kind, owner, key);
+		return;
+	}
+
+	if ((md = metadata_find(object, key)) != NULL)
+		journal_write("MD %s %s %s %s", kind, owner, key, md->value);
+}
+
+static void journal_record(db_journal_op_t op, void *object, const char *arg)
+{
+	if (!journal_active)
+		return;
+
+	switch (op)
+	{
+		case DB_JOURNAL_MYUSER:
+			journal_write_myuser(object);
+			break;
+		case DB_JOURNAL_MYUSER_DROP:
+			journal_write("MUD %s", entity(object)->name);
+			break;
+		case DB_JOURNAL_MYUSER_RENAME:
+			journal_write("MUR %s %s", arg, entity(object)->name);
+			break;
+		case DB_JOURNAL_MYNICK:
+			journal_write("MN %s %s %lu %lu", entity(((mynick_t *) object)->owner)->name,
+					((mynick_t *) object)->nick,
+					(unsigned long) ((mynick_t *) object)->registered,
+					(unsigned long) ((mynick_t *) object)->lastseen);
+			break;
+		case DB_JOURNAL_MYNICK_DROP:
+			journal_write("MND %s", ((mynick_t *) object)->nick);
+			break;
+		case DB_JOURNAL_MYCHAN:
+			journal_write_mychan(object);
+			break;
+		case DB_JOURNAL_MYCHAN_DROP:
+			journal_write("MCD %s", ((mychan_t *) object)->name);
+			break;
+		case DB_JOURNAL_CHANACS:
+			journal_write_chanacs(object);
+			break;
+		case DB_JOURNAL_CHANACS_DROP:
+			journal_write("CAD %s %s", ((chanacs_t *) object)->mychan->name,
+					journal_chanacs_target(object));
+			break;
+		case DB_JOURNAL_METADATA:
+			journal_write_metadata(object, arg, false);
+			break;
+		case DB_JOURNAL_METADATA_DROP:
+			journal_write_metadata(object, arg, true);
+			break;
+	}
+}
+
+/***************************************************************************************************/
+
+static char *journal_word(char **p)
+{
+	char *w = *p;
+
+	if (w == NULL || *w == '\0')
+		return NULL;
+
+	if ((*p = strchr(w, ' ')) != NULL)
+		*(*p)++ = '\0';
+
+	return w;
+}
+
+static void *journal_find_metadata_owner(const char *kind, char **p)
+{
+	const char *name = journal_word(p);
+	mychan_t *mc;
+	myentity_t *mt;
+	const char *target;
+
+	if (name == NULL)
+		return NULL;
+
+	if (!strcmp(kind, "U"))
+		return myuser_find(name);
+	if (!strcmp(kind, "C"))
+		return mychan_find(name);
+	if (!strcmp(kind, "A"))
+	{
+		if ((target = journal_word(p)) == NULL || (mc = mychan_find(name)) == NULL)
+			return NULL;
+		if ((mt = myentity_find(target)) != NULL)
+			return chanacs_find_literal(mc, mt, 0);
+		return chanacs_find_host_literal(mc, target, 0);
+	}
+
+	return NULL;
+}
+
+static void journal_replay_myuser(char *p)
+{
+	const char *id, *name, *pass, *email, *sflags, *language;
+	const char *reg, *login;
+	unsigned int flags = 0;
+	myuser_t *mu;
+
+	id = journal_word(&p);
+	name = journal_word(&p);
+	pass = journal_word(&p);
+	email = journal_word(&p);
+	reg = journal_word(&p);
+	login = journal_word(&p);
+	sflags = journal_word(&p);
+	language = journal_word(&p);
+
+	if (language == NULL)
+		return;
+
+	gflags_fromstr(mu_flags, sflags, &flags);
+	if (!strcmp(pass, "*"))
+		pass = "";
+
+	if ((mu = myuser_find_uid(id)) == NULL && (mu = myuser_find(name)) == NULL)
+		mu = myuser_add_id(id, name, pass, email, flags);
+	else
+	{
+		mowgli_strlcpy(mu->pass, pass, PASSLEN);
+		mu->flags = flags;
+		if (strcmp(mu->email, email))
+			myuser_set_email(mu, email);
+	}
+
+	mu->registered = strtoul(reg, NULL, 10);
+	mu->lastlogin = strtoul(login, NULL, 10);
+	mu->language = language_add(language);
+}
+
+static void journal_replay_mychan(char *p)
+{
+	char buf[BUFSIZE];
+	const char *name, *reg, *used, *sflags, *on, *off, *limit, *key;
+	unsigned int flags = 0;
+	mychan_t *mc;
+
+	name = journal_word(&p);
+	reg = journal_word(&p);
+	used = journal_word(&p);
+	sflags = journal_word(&p);
+	on = journal_word(&p);
+	off = journal_word(&p);
+	limit = journal_word(&p);
+	key = journal_word(&p);
+
+	if (limit == NULL)
+		return;
+
+	mowgli_strlcpy(buf, name, sizeof buf);
+	if ((mc = mychan_find(buf)) == NULL)
+		mc = mychan_add(buf);
+
+	gflags_fromstr(mc_flags, sflags, &flags);
+	mc->registered = strtoul(reg, NULL, 10);
+	mc->used = strtoul(used, NULL, 10);
+	mc->flags = flags;
+	mc->mlock_on = strtoul(on, NULL, 10);
+	mc->mlock_off = strtoul(off, NULL, 10);
+	mc->mlock_limit = strtoul(limit, NULL, 10);
+
+	free(mc->mlock_key);
+	mc->mlock_key = key != NULL && *key != '\0' ? sstrdup(key) : NULL;
+}
+
+static void journal_replay_chanacs(char *p)
+{
+	const char *chan, *target, *sflags, *tmod, *setname;
+	mychan_t *mc;
+	myentity_t *mt, *setter;
+	chanacs_t *ca;
+	unsigned int level;
+
+	chan = journal_word(&p);
+	target = journal_word(&p);
+	sflags = journal_word(&p);
+	tmod = journal_word(&p);
+	setname = journal_word(&p);
+
+	if (setname == NULL || (mc = mychan_find(chan)) == NULL)
+		return;
+
+	level = flags_to_bitmask(sflags, 0);
+	mt = myentity_find(target);
+	setter = myentity_find(setname);
+
+	if (mt != NULL)
+		ca = chanacs_find_literal(mc, mt, 0);
+	else if (validhostmask(target))
+		ca = chanacs_find_host_literal(mc, target, 0);
+	else
+		return;
+
+	if (ca == NULL)
+	{
+		if (mt != NULL)
+			chanacs_add(mc, mt, level, strtoul(tmod, NULL, 10), setter);
+		else
+			chanacs_add_host(mc, target, level, strtoul(tmod, NULL, 10), setter);
+		return;
+	}
+
+	ca->level = level & ca_all;
+	ca->tmodified = strtoul(tmod, NULL, 10);
+	if (setter != NULL)
+		mowgli_strlcpy(ca->setter_uid, setter->id, IDLEN);
+	else
+		ca->setter_uid[0] = '\0';
+	chanacs_invalidate(mc);
+}
+
+static void journal_replay(char *p)
+{
+	const char *op = journal_word(&p);
+	const char *name, *target, *kind, *key;
+	myuser_t *mu;
+	mynick_t *mn;
+	mychan_t *mc;
+	myentity_t *mt;
+	chanacs_t *ca;
+	void *obj;
+
+	if (op == NULL)
+		return;
+
+	if (!strcmp(op, "MU"))
+		journal_replay_myuser(p);
+	else if (!strcmp(op, "MUD"))
+	{
+		if ((name = journal_word(&p)) != NULL && (mu = myuser_find(name)) != NULL)
+			object_dispose(mu);
+	}
+	else if (!strcmp(op, "MUR"))
+	{
+		name = journal_word(&p);
+		target = journal_word(&p);
+		if (target != NULL && (mu = myuser_find(name)) != NULL && myuser_find(target) == NULL)
+			myuser_rename(mu, target);
+	}
+	else if (!strcmp(op, "MN"))
+	{
+		name = journal_word(&p);
+		target = journal_word(&p);
+		if (target == NULL || (mu = myuser_find(name)) == NULL)
+			return;
+		if ((mn = mynick_find(target)) != NULL && mn->owner != mu)
+			object_unref(mn);
+		if ((mn = mynick_find(target)) == NULL)
+			mn = mynick_add(mu, target);
+		if ((key = journal_word(&p)) != NULL)
+			mn->registered = strtoul(key, NULL, 10);
+		if ((key = journal_word(&p)) != NULL)
+			mn->lastseen = strtoul(key, NULL, 10);
+	}
+	else if (!strcmp(op, "MND"))
+	{
+		if ((name = journal_word(&p)) != NULL && (mn = mynick_find(name)) != NULL)
+			object_unref(mn);
+	}
+	else if (!strcmp(op, "MC"))
+		journal_replay_mychan(p);
+	else if (!strcmp(op, "MCD"))
+	{
+		if ((name = journal_word(&p)) != NULL && (mc = mychan_find(name)) != NULL)
+			object_unref(mc);
+	}
+	else if (!strcmp(op, "CA"))
+		journal_replay_chanacs(p);
+	else if (!strcmp(op, "CAD"))
+	{
+		name = journal_word(&p);
+		target = journal_word(&p);
+		if (target == NULL || (mc = mychan_find(name)) == NULL)
+			return;
+		if ((mt = myentity_find(target)) != NULL)
+			ca = chanacs_find_literal(mc, mt, 0);
+		else
+			ca = chanacs_find_host_literal(mc, target, 0);
+		if (ca != NULL)
+			object_unref(ca);
+	}
+	else if (!strcmp(op, "MD") || !strcmp(op, "MDD"))
+	{
+		if ((kind = journal_word(&p)) == NULL || (obj = journal_find_metadata_owner(kind, &p)) == NULL)
+			return;
+		if ((key = journal_word(&p)) == NULL)
+			return;
+		if (!strcmp(op, "MDD"))
+			metadata_delete(obj, key);
+		else if (p != NULL)
+			metadata_add(obj, key, p);
+	}
+	else
+		slog(LG_INFO, "journal: unknown record type %s ignored", op);
+}
+
+/* journals are always text, whichever backend holds the snapshot */
+static void journal_replay_file(unsigned int seq)
+{
+	char path[BUFSIZE], line[JOURNAL_RECORDLEN + 32];
+	unsigned int lineno = 0;
+	unsigned long len;
+	char *rest, *nl;
+	FILE *f;
+
+	journal_path(path, sizeof path, seq);
+	slog(LG_INFO, "journal: replaying %s", path);
+
+	if ((f = fopen(path, "r")) == NULL)
+	{
+		slog(LG_ERROR, "journal: cannot open '%s' for reading: %s", path, strerror(errno));
+		return;
+	}
+
+	while (fgets(line, sizeof line, f) != NULL)
+	{
+		lineno++;
+
+		if ((nl = strchr(line, '\n')) != NULL)
+			*nl = '\0';
+
+		if (strncmp(line, "J ", 2) || (len = strtoul(line + 2, &rest, 10), *rest != ' ')
+				|| strlen(rest + 1) != len || nl == NULL)
+		{
+			slog(LG_ERROR, "journal: %s:%u: incomplete record ignored", path, lineno);
+			continue;
+		}
+
+		journal_replay(rest + 1);
+	}
+
+	fclose(f);
+}
+
+static void journal_h_jseq(database_handle_t *db, const char *type)
+{
+	journal_snapshot_seq = db_sread_uint(db);
+}
+
+static void journal_db_write(database_handle_t *db)
+{
+	db_start_row(db, "JSEQ");
+	db_write_uint(db, journal_seq);
+	db_commit_row(db);
+}
+
+/***************************************************************************************************/
+
+static int journal_seq_cmp(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* numbers of the journals on disk, in ascending order */
+static unsigned int *journal_list(size_t *count)
+{
+	DIR *dir;
+	struct dirent *de;
+	unsigned int *seqs = NULL;
+	size_t n = 0, size = 0;
+	char *end;
+	unsigned long seq;
+
+	*count = 0;
+
+	if ((dir = opendir(datadir)) == NULL)
+		return NULL;
+
+	while ((de = readdir(dir)) != NULL)
+	{
+		if (strncmp(de->d_name, JOURNAL_PREFIX, strlen(JOURNAL_PREFIX)))
+			continue;
+
+		seq = strtoul(de->d_name + strlen(JOURNAL_PREFIX), &end, 10);
+		if (*end != '\0')
+			continue;
+
+		if (n == size)
+		{
+			size = size ? size * 2 : 16;
+			seqs = srealloc(seqs, size * sizeof *seqs);
+		}
+		seqs[n++] = seq;
+	}
+	closedir(dir);
+
+	if (n > 1)
+		qsort(seqs, n, sizeof *seqs, journal_seq_cmp);
+
+	*count = n;
+	return seqs;
+}
+
+/* drops journals a snapshot on disk already covers */
+static void journal_prune(unsigned int below)
+{
+	unsigned int *seqs;
+	size_t i, n;
+	char path[BUFSIZE];
+
+	seqs = journal_list(&n);
+	for (i = 0; i < n && seqs[i] < below; i++)
+	{
+		journal_path(path, sizeof path, seqs[i]);
+		if (unlink(path) < 0)
+			slog(LG_ERROR, "journal: cannot remove '%s': %s", path, strerror(errno));
+	}
+	free(seqs);
+}
+
+static void journal_db_saved(void *unused)
+{
+	/* corestorage only calls this once the new snapshot is on disk, and
+	 * in the parent for background saves, so it covers everything
+	 * before the current journal */
+	journal_prune(journal_seq);
+}
+
+static void journal_db_load(const char *filename)
+{
+	unsigned int *seqs;
+	size_t i, n;
+	unsigned int next;
+
+	journal_snapshot_seq = 0;
+	journal_next_load(filename);
+
+	journal_prune(journal_snapshot_seq);
+
+	next = journal_snapshot_seq;
+	seqs = journal_list(&n);
+	for (i = 0; i < n; i++)
+	{
+		journal_replay_file(seqs[i]);
+		next = seqs[i] + 1;
+	}
+	free(seqs);
+
+	if (readonly)
+		return;
+
+	journal_open(next);
+	journal_active = true;
+}
+
+static void journal_db_save(void *arg, db_save_strategy_t strategy)
+{
+	/* the snapshot about to be taken covers everything journaled so far */
+	if (journal_active)
+		journal_open(journal_seq + 1);
+
+	journal_next_save(arg, strategy);
+}
+
+void _modinit(module_t *m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "backend/corestorage");
+
+	m->mflags = MODTYPE_CORE;
+
+	if (db_load == NULL || db_save == NULL)
+	{
+		slog(LG_ERROR, "journal: no storage backend loaded");
+		m->mflags = MODTYPE_FAIL;
+		return;
+	}
+
+	journal_next_load = db_load;
+	journal_next_save = db_save;
+	db_load = &journal_db_load;
+	db_save = &journal_db_save;
+	db_journal = &journal_record;
+
+	/* corestorage skips JSEQ rows when the journal is not loaded */
+	db_unregister_type_handler("JSEQ");
+	db_register_type_handler("JSEQ", journal_h_jseq);
+
+	hook_add_db_write(journal_db_write);
+	hook_add_db_saved(journal_db_saved);
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -14,6 +14,10 @@
 # include <unistd.h>
 # include <sys/file.h>
 #endif
+#ifndef MOWGLI_OS_WIN
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
 
 DECLARE_MODULE_V1
 (
@@ -23,11 +27,17 @@ DECLARE_MODULE_V1
 );
 
 typedef struct opensex_ {
-	/* Lexing state */
+	/* Lexing state: the whole file is mapped or read into buf, and rows
+	 * and tokens are split in place by overwriting separators with NULs */
 	char *buf;
-	unsigned int bufsize;
+	size_t bufsize;
+	bool mapped;
+	char *pos;
 	char *token;
+
+	/* Writing state */
 	FILE *f;
+	bool failed;
 
 	/* Interpreting state */
 	unsigned int grver;
@@ -62,31 +72,20 @@ static void opensex_h_grver(database_handle_t *db, const char *type)
 
 static bool opensex_read_next_row(database_handle_t *hdl)
 {
-	int c = 0;
-	unsigned int n = 0;
 	opensex_t *rs = (opensex_t *)hdl->priv;
+	char *end = rs->buf + rs->bufsize;
+	char *nl;
 
-	while ((c = getc(rs->f)) != EOF && c != '\n')
-	{
-		rs->buf[n++] = c;
-		if (n == rs->bufsize)
-		{
-			rs->bufsize *= 2;
-			rs->buf = srealloc(rs->buf, rs->bufsize);
-		}
-	}
-	rs->buf[n] = '\0';
-	rs->token = rs->buf;
+	if (rs->pos >= end)
+		return false;
 
-	if (c == EOF && ferror(rs->f))
-	{
-		slog(LG_ERROR, "opensex-read-next-row: error at %s line %d: %s", hdl->file, hdl->line, strerror(errno));
-		slog(LG_ERROR, "opensex-read-next-row: exiting to avoid data loss");
-		exit(EXIT_FAILURE);
-	}
+	/* the buffer always ends in a newline, see opensex_load_file() */
+	nl = memchr(rs->pos, '\n', end - rs->pos);
+	soft_assert(nl != NULL);
+	*nl = '\0';
 
-	if (c == EOF && n == 0)
-		return false;
+	rs->token = rs->pos;
+	rs->pos = nl + 1;
 
 	hdl->line++;
 	hdl->token = 0;
@@ -170,7 +169,8 @@ static bool opensex_start_row(database_handle_t *db, const char *type)
 	return_val_if_fail(type != NULL, false);
 	rs = (opensex_t *)db->priv;
 
-	fprintf(rs->f, "%s ", type);
+	if (fprintf(rs->f, "%s ", type) < 0)
+		rs->failed = true;
 
 	return true;
 }
@@ -184,7 +184,8 @@ static bool opensex_write_cell(database_handle_t *db, const char *data, bool mul
 	return_val_if_fail(db != NULL, false);
 	rs = (opensex_t *)db->priv;
 
-	fprintf(rs->f, "%s%s", data != NULL ? data : "*", !multiword ? " " : "");
+	if (fprintf(rs->f, "%s%s", data != NULL ? data : "*", !multiword ? " " : "") < 0)
+		rs->failed = true;
 
 	return true;
 }
@@ -227,7 +228,8 @@ static bool opensex_commit_row(database_handle_t *db)
 	return_val_if_fail(db != NULL, false);
 	rs = (opensex_t *)db->priv;
 
-	fprintf(rs->f, "\n");
+	if (fputc('\n', rs->f) == EOF)
+		rs->failed = true;
 
 	return true;
 }
@@ -252,17 +254,80 @@ static database_vtable_t opensex_vt = {
 	.commit_row = opensex_commit_row
 };
 
+/*
+ * Brings the whole database into memory in one go: mmap(2) where the file
+ * already ends in a newline, otherwise a single large read(2) into a
+ * buffer that gets one appended.  Either way the rows can then be split
+ * in place without copying.
+ */
+static bool opensex_load_file(opensex_t *rs, int fd, const char *path)
+{
+	struct stat sb;
+	size_t done = 0;
+	ssize_t l;
+
+	if (fstat(fd, &sb) < 0)
+		return false;
+
+	rs->bufsize = sb.st_size;
+
+#ifndef MOWGLI_OS_WIN
+	if (rs->bufsize > 0)
+	{
+		char last;
+
+		if (pread(fd, &last, 1, sb.st_size - 1) == 1 && last == '\n')
+		{
+			/* private writable mapping: our NULs never reach the file */
+			rs->buf = mmap(NULL, rs->bufsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+			if (rs->buf != MAP_FAILED)
+			{
+				(void) madvise(rs->buf, rs->bufsize, MADV_SEQUENTIAL);
+				rs->mapped = true;
+				rs->pos = rs->buf;
+				return true;
+			}
+
+			slog(LG_DEBUG, "db-open-read: mmap of '%s' failed (%s), reading it instead", path, strerror(errno));
+		}
+	}
+#endif
+
+	rs->buf = smalloc(rs->bufsize + 1);
+	while (done < rs->bufsize)
+	{
+		l = read(fd, rs->buf + done, rs->bufsize - done);
+		if (l < 0 && errno == EINTR)
+			continue;
+		if (l <= 0)
+			break;
+		done += l;
+	}
+	if (done != rs->bufsize)
+	{
+		free(rs->buf);
+		rs->buf = NULL;
+		return false;
+	}
+
+	if (rs->bufsize > 0 && rs->buf[rs->bufsize - 1] != '\n')
+		rs->buf[rs->bufsize++] = '\n';
+
+	rs->pos = rs->buf;
+	return true;
+}
+
 static database_handle_t *opensex_db_open_read(const char *filename)
 {
 	database_handle_t *db;
 	opensex_t *rs;
-	FILE *f;
+	int fd;
 	int errno1;
 	char path[BUFSIZE];
 
 	snprintf(path, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
-	f = fopen(path, "r");
-	if (!f)
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
 	{
 		errno1 = errno;
 
@@ -280,10 +345,16 @@ static database_handle_t *opensex_db_open_read(const char *filename)
 
 	rs = scalloc(sizeof(opensex_t), 1);
 	rs->grver = 1;
-	rs->buf = scalloc(512, 1);
-	rs->bufsize = 512;
 	rs->token = NULL;
-	rs->f = f;
+
+	if (!opensex_load_file(rs, fd, path))
+	{
+		errno1 = errno;
+		slog(LG_ERROR, "db-open-read: cannot read '%s': %s", path, strerror(errno1));
+		slog(LG_ERROR, "db-open-read: exiting to avoid data loss");
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
 
 	db = scalloc(sizeof(database_handle_t), 1);
 	db->priv = rs;
@@ -360,13 +431,59 @@ static database_handle_t *opensex_db_open(const char *filename, database_transac
 	return opensex_db_open_read(filename);
 }
 
-static void opensex_db_close(database_handle_t *db)
+/* segments are written to a temporary file and copied over when appended */
+static database_handle_t *opensex_db_open_segment(database_handle_t *parent)
 {
+	database_handle_t *db;
 	opensex_t *rs;
+	FILE *f;
+
+	if ((f = tmpfile()) == NULL)
+	{
+		slog(LG_DEBUG, "db-open-segment: tmpfile() failed: %s", strerror(errno));
+		return NULL;
+	}
+
+	rs = scalloc(sizeof(opensex_t), 1);
+	rs->f = f;
+	rs->grver = 1;
+
+	db = scalloc(sizeof(database_handle_t), 1);
+	db->priv = rs;
+	db->vt = &opensex_vt;
+	db->txn = DB_WRITE;
+	db->file = sstrdup(parent->file);
+
+	return db;
+}
+
+static void opensex_db_append_segment(database_handle_t *parent, database_handle_t *segment)
+{
+	opensex_t *prs = parent->priv, *rs = segment->priv;
+	char buf[BUFSIZE * 64];
+	size_t l;
+
+	rewind(rs->f);
+	while ((l = fread(buf, 1, sizeof buf, rs->f)) > 0)
+		if (fwrite(buf, 1, l, prs->f) != l)
+			prs->failed = true;
+	if (ferror(rs->f) || rs->failed)
+		prs->failed = true;
+
+	fclose(rs->f);
+	free(rs);
+	free(segment->file);
+	free(segment);
+}
+
+static bool opensex_db_close(database_handle_t *db)
+{
+	opensex_t *rs;
+	bool committed = true;
 	int errno1;
 	char oldpath[BUFSIZE], newpath[BUFSIZE];
 
-	return_if_fail(db != NULL);
+	return_val_if_fail(db != NULL, false);
 	rs = db->priv;
 
 	mowgli_strlcpy(oldpath, db->file, sizeof oldpath);
@@ -374,34 +491,53 @@ static void opensex_db_close(database_handle_t *db)
 
 	mowgli_strlcpy(newpath, db->file, sizeof newpath);
 
-	fclose(rs->f);
-
 	if (db->txn == DB_WRITE)
 	{
+		if (ferror(rs->f))
+			rs->failed = true;
+		if (fclose(rs->f) != 0)
+			rs->failed = true;
+
+		/* never replace a good database with a short one */
+		if (rs->failed)
+		{
+			errno1 = errno;
+			slog(LG_ERROR, "db_save(): cannot write %s: %s", oldpath, strerror(errno1));
+			wallops(_("\2DATABASE ERROR\2: db_save(): cannot write %s: %s"), oldpath, strerror(errno1));
+			committed = false;
+		}
 		/* now, replace the old database with the new one, using an atomic rename */
-		if (srename(oldpath, newpath) < 0)
+		else if (srename(oldpath, newpath) < 0)
 		{
 			errno1 = errno;
 			slog(LG_ERROR, "db_save(): cannot rename services.db.new to services.db: %s", strerror(errno1));
 			wallops(_("\2DATABASE ERROR\2: db_save(): cannot rename services.db.new to services.db: %s"), strerror(errno1));
+			committed = false;
 		}
-
-		hook_call_db_saved();
 #ifdef HAVE_FLOCK
 		close(lockfd);
 #endif
 	}
 
-	free(rs->buf);
+#ifndef MOWGLI_OS_WIN
+	if (rs->mapped)
+		munmap(rs->buf, rs->bufsize);
+	else
+#endif
+		free(rs->buf);
 	free(rs);
 	free(db->file);
 	free(db);
+
+	return committed;
 }
 
 static database_module_t opensex_mod = {
 	.db_open = opensex_db_open,
 	.db_close = opensex_db_close,
 	.db_parse = opensex_db_parse,
+	.db_open_segment = opensex_db_open_segment,
+	.db_append_segment = opensex_db_append_segment,
 };
 
 void _modinit(module_t *m)
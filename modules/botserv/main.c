@@ -45,6 +45,9 @@ E mowgli_list_t mychan;
 
 mowgli_list_t bs_bots;
 
+/* looked up for every message to and from a bot */
+static metadata_key_t md_bot_assigned, md_bot_handle_fantasy, md_disable_fantasy, md_prefix;
+
 command_t bs_bot = { "BOT", "Maintains network bot list.", PRIV_USER_ADMIN, 6, bs_cmd_bot, { .path = "botserv/bot" } };
 command_t bs_assign = { "ASSIGN", "Assigns a bot to a channel.", AC_NONE, 2, bs_cmd_assign, { .path = "botserv/assign" } };
 command_t bs_unassign = { "UNASSIGN", "Unassigns a bot from a channel.", AC_NONE, 1, bs_cmd_unassign, { .path = "botserv/unassign" } };
@@ -57,7 +60,7 @@ static botserv_bot_t *bs_mychan_find_bot(mychan_t *mc)
 	metadata_t *md;
 	botserv_bot_t *bot;
 
-	md = metadata_find(mc, "private:botserv:bot-assigned");
+	md = metadata_find_key(mc, md_bot_assigned);
 	bot = md != NULL ? botserv_bot_find(md->value) : NULL;
 	if (bot != NULL && !user_find_named(bot->nick))
 		bot = NULL;
@@ -174,7 +177,7 @@ bs_modestack_mode_simple(const char *source, channel_t *channel, int dir, int fl
 	if (source != NULL && chansvs.nick != NULL &&
 			!strcmp(source, chansvs.nick) &&
 			(mc = mychan_from(channel)) != NULL &&
-			(bs = metadata_find(mc, "private:botserv:bot-assigned")) != NULL)
+			(bs = metadata_find_key(mc, md_bot_assigned)) != NULL)
 		bot = user_find_named(bs->value);
 
 	modestack_mode_simple_real(bot ? bot->nick : source, channel, dir, flags);
@@ -193,7 +196,7 @@ bs_modestack_mode_limit(const char *source, channel_t *channel, int dir, unsigne
 	if (source != NULL && chansvs.nick != NULL &&
 			!strcmp(source, chansvs.nick) &&
 			(mc = mychan_from(channel)) != NULL &&
-			(bs = metadata_find(mc, "private:botserv:bot-assigned")) != NULL)
+			(bs = metadata_find_key(mc, md_bot_assigned)) != NULL)
 		bot = user_find_named(bs->value);
 
 	modestack_mode_limit_real(bot ? bot->nick : source, channel, dir, limit);
@@ -212,7 +215,7 @@ bs_modestack_mode_ext(const char *source, channel_t *channel, int dir, unsigned
 	if (source != NULL && chansvs.nick != NULL &&
 			!strcmp(source, chansvs.nick) &&
 			(mc = mychan_from(channel)) != NULL &&
-			(bs = metadata_find(mc, "private:botserv:bot-assigned")) != NULL)
+			(bs = metadata_find_key(mc, md_bot_assigned)) != NULL)
 		bot = user_find_named(bs->value);
 
 	modestack_mode_ext_real(bot ? bot->nick : source, channel, dir, i, value);
@@ -231,7 +234,7 @@ bs_modestack_mode_param(const char *source, channel_t *channel, int dir, char ty
 	if (source != NULL && chansvs.nick != NULL &&
 			!strcmp(source, chansvs.nick) &&
 			(mc = mychan_from(channel)) != NULL &&
-			(bs = metadata_find(mc, "private:botserv:bot-assigned")) != NULL)
+			(bs = metadata_find_key(mc, md_bot_assigned)) != NULL)
 		bot = user_find_named(bs->value);
 
 	modestack_mode_param_real(bot ? bot->nick : source, channel, dir, type, value);
@@ -250,7 +253,7 @@ bs_try_kick(user_t *source, channel_t *chan, user_t *target, const char *reason)
 	if (source != chansvs.me->me)
 		return try_kick_real(source, chan, target, reason);
 
-	if ((mc = mychan_from(chan)) != NULL && (bs = metadata_find(mc, "private:botserv:bot-assigned")) != NULL)
+	if ((mc = mychan_from(chan)) != NULL && (bs = metadata_find_key(mc, md_bot_assigned)) != NULL)
 		bot = user_find_named(bs->value);
 
 	try_kick_real(bot ? bot : source, chan, target, reason);
@@ -271,7 +274,7 @@ bs_join_registered(bool all)
 
 	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
 	{
-		if ((md = metadata_find(mc, "private:botserv:bot-assigned")) == NULL)
+		if ((md = metadata_find_key(mc, md_bot_assigned)) == NULL)
 			continue;
 
 		if (all)
@@ -341,14 +344,14 @@ botserv_channel_handler(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	md = metadata_find(mc, "disable_fantasy");
+	md = metadata_find_key(mc, md_disable_fantasy);
 	if (md)
 	{
 		/* fantasy disabled on this channel. don't message them, just bail. */
 		return;
 	}
 
-	md = metadata_find(mc, "private:botserv:bot-assigned");
+	md = metadata_find_key(mc, md_bot_assigned);
 	if (md == NULL)
 	{
 		/* we received this, but have no record of a bot assigned. WTF */
@@ -356,7 +359,7 @@ botserv_channel_handler(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	md = metadata_find(mc, "private:botserv:bot-handle-fantasy");
+	md = metadata_find_key(mc, md_bot_handle_fantasy);
 	if (md == NULL || irccasecmp(si->service->me->nick, md->value))
 		return;
 
@@ -375,7 +378,7 @@ botserv_channel_handler(sourceinfo_t *si, int parc, char *parv[])
 	}
 
 	/* take the command through the hash table, handling both !prefix and Bot, ... styles */
-	metadata_t *mdp = metadata_find(mc, "private:prefix");
+	metadata_t *mdp = metadata_find_key(mc, md_prefix);
 	const char *prefix = (mdp ? mdp->value : chansvs.trigger);
 
 	if ((sptr = service_find("chanserv")) == NULL)
@@ -669,7 +672,7 @@ static void bs_cmd_change(sourceinfo_t *si, int parc, char *parv[])
 	/* join it back and also update the metadata */
 	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
 	{
-		if ((md = metadata_find(mc, "private:botserv:bot-assigned")) == NULL)
+		if ((md = metadata_find_key(mc, md_bot_assigned)) == NULL)
 			continue;
 
 		if (!irccasecmp(md->value, parv[0]))
@@ -780,7 +783,7 @@ static void bs_cmd_delete(sourceinfo_t *si, int parc, char *parv[])
 
 	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
 	{
-		if ((md = metadata_find(mc, "private:botserv:bot-assigned")) == NULL)
+		if ((md = metadata_find_key(mc, md_bot_assigned)) == NULL)
 			continue;
 
 		if (!irccasecmp(md->value, bot->nick))
@@ -891,7 +894,7 @@ static void bs_cmd_assign(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	md = metadata_find(mc, "private:botserv:bot-assigned");
+	md = metadata_find_key(mc, md_bot_assigned);
 
 	bot = botserv_bot_find(parv[1]);
 	if (bot == NULL)
@@ -962,7 +965,7 @@ static void bs_cmd_unassign(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	if ((md = metadata_find(mc, "private:botserv:bot-assigned")) == NULL)
+	if ((md = metadata_find_key(mc, md_bot_assigned)) == NULL)
 	{
 		command_fail(si, fault_nosuch_key, _("\2%s\2 does not have a bot assigned."), mc->name);
 		return;
@@ -990,6 +993,11 @@ void _modinit(module_t *m)
 		return;
 	}
 
+	md_bot_assigned = metadata_key_intern("private:botserv:bot-assigned");
+	md_bot_handle_fantasy = metadata_key_intern("private:botserv:bot-handle-fantasy");
+	md_disable_fantasy = metadata_key_intern("disable_fantasy");
+	md_prefix = metadata_key_intern("private:prefix");
+
 	hook_add_event("config_ready");
 	hook_add_config_ready(botserv_config_ready);
 
@@ -1116,7 +1124,7 @@ static void bs_join(hook_channel_joinpart_t *hdata)
 		return;
 
 	/* chanserv's function handles those */
-	if (metadata_find(mc, "private:botserv:bot-assigned") == NULL)
+	if (metadata_find_key(mc, md_bot_assigned) == NULL)
 		return;
 
 	bot = bs_mychan_find_bot(mc);
@@ -1157,7 +1165,7 @@ bs_part(hook_channel_joinpart_t *hdata)
 		return;
 
 	/* chanserv's function handles those */
-	if (metadata_find(mc, "private:botserv:bot-assigned") == NULL)
+	if (metadata_find_key(mc, md_bot_assigned) == NULL)
 		return;
 
 	bot = bs_mychan_find_bot(mc);
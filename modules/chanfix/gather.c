@@ -307,10 +307,10 @@ static void write_chanfixdb(database_handle_t *db)
 
 		if (object(chan)->metadata != NULL)
 		{
-			mowgli_patricia_iteration_state_t state2;
+			object_map_iteration_state_t state2;
 			metadata_t *md;
 
-			MOWGLI_PATRICIA_FOREACH(md, &state2, object(chan)->metadata)
+			METADATA_FOREACH(md, &state2, chan)
 			{
 				db_start_row(db, "CFMD");
 				db_write_word(db, chan->name);
@@ -28,8 +28,10 @@ DECLARE_MODULE_V1
 	VENDOR_STRING
 );
 
+#define ANTIFLOOD_MSG_COUNT	10
+
 static time_t antiflood_msg_time = 60;
-static size_t antiflood_msg_count = 10;
+static size_t antiflood_msg_count = ANTIFLOOD_MSG_COUNT;
 
 #define METADATA_KEY_ENFORCE_METHOD	"private:antiflood:enforce-method"
 
@@ -48,30 +50,43 @@ typedef enum {
 	MQ_ENFORCE_LINE,
 } mqueue_enforce_strategy_t;
 
+/*
+ * Each channel keeps the last ANTIFLOOD_MSG_COUNT + 1 messages in a ring.
+ * Messages are only remembered by a hash of their case-folded text, so
+ * recording one does not allocate and comparing two is an integer compare.
+ */
+typedef struct {
+	stringref source;
+	uint64_t fingerprint;
+	time_t time;
+} msg_t;
+
 typedef struct {
 	char *name;
 	size_t max;
 	time_t last_used;
-	mowgli_list_t entries;
+	size_t head;
+	size_t count;
+	msg_t entries[ANTIFLOOD_MSG_COUNT + 1];
 } mqueue_t;
 
-typedef struct {
-	stringref source;
-	char *message;
-	time_t time;
-	mowgli_node_t node;
-} msg_t;
-
-static mowgli_heap_t *msg_heap = NULL;
+#define MQUEUE_SLOTS(mq)	(sizeof (mq)->entries / sizeof (mq)->entries[0])
+#define MQUEUE_ENTRY(mq, i)	(&(mq)->entries[((mq)->head + (i)) % MQUEUE_SLOTS(mq)])
 
-static void
-msg_destroy(msg_t *msg, mqueue_t *mq)
+/* FNV-1a over the message with ASCII case folded, as strcasecmp() did */
+static uint64_t
+msg_fingerprint(const char *message)
 {
-	free(msg->message);
-	strshare_unref(msg->source);
-	mowgli_node_delete(&msg->node, &mq->entries);
+	const unsigned char *p;
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (p = (const unsigned char *) message; *p != '\0'; p++)
+	{
+		hash ^= (uint64_t) tolower(*p);
+		hash *= 1099511628211ULL;
+	}
 
-	mowgli_heap_free(msg_heap, msg);
+	return hash;
 }
 
 static msg_t *
@@ -79,18 +94,22 @@ msg_create(mqueue_t *mq, user_t *u, const char *message)
 {
 	msg_t *msg;
 
-	msg = mowgli_heap_alloc(msg_heap);
-	msg->message = sstrdup(message);
-	msg->time = CURRTIME;
-	msg->source = u->uid != NULL ? strshare_ref(u->uid) : strshare_ref(u->nick);
-
-	if (MOWGLI_LIST_LENGTH(&mq->entries) > mq->max)
+	if (mq->count == MQUEUE_SLOTS(mq))
 	{
-		msg_t *head_msg = mq->entries.head->data;
-		msg_destroy(head_msg, mq);
+		msg = MQUEUE_ENTRY(mq, 0);
+		strshare_unref(msg->source);
+
+		mq->head = (mq->head + 1) % MQUEUE_SLOTS(mq);
+		mq->count--;
 	}
 
-	mowgli_node_add(msg, &msg->node, &mq->entries);
+	msg = MQUEUE_ENTRY(mq, mq->count);
+	mq->count++;
+
+	msg->fingerprint = msg_fingerprint(message);
+	msg->time = CURRTIME;
+	msg->source = u->uid != NULL ? strshare_ref(u->uid) : strshare_ref(u->nick);
+
 	mq->last_used = CURRTIME;
 
 	return msg;
@@ -118,14 +137,10 @@ mqueue_create(const char *name)
 static void
 mqueue_free(mqueue_t *mq)
 {
-	mowgli_node_t *n, *tn;
+	size_t i;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, mq->entries.head)
-	{
-		msg_t *msg = n->data;
-
-		msg_destroy(msg, mq);
-	}
+	for (i = 0; i < mq->count; i++)
+		strshare_unref(MQUEUE_ENTRY(mq, i)->source);
 
 	free(mq->name);
 	mowgli_heap_free(mqueue_heap, mq);
@@ -178,28 +193,24 @@ mqueue_should_enforce(mqueue_t *mq)
 	msg_t *oldest, *newest;
 	time_t age_delta;
 
-	if (MOWGLI_LIST_LENGTH(&mq->entries) < mq->max)
+	if (mq->count < mq->max || mq->count < 2)
 		return MQ_ENFORCE_NONE;
 
-	oldest = mq->entries.head->data;
-	newest = mq->entries.tail->data;
-
-	if (oldest == NULL || newest == NULL || oldest == newest)
-		return MQ_ENFORCE_NONE;
+	oldest = MQUEUE_ENTRY(mq, 0);
+	newest = MQUEUE_ENTRY(mq, mq->count - 1);
 
 	age_delta = newest->time - oldest->time;
 
 	if (age_delta <= antiflood_msg_time)
 	{
-		mowgli_node_t *n;
-		size_t msg_matches = 0, usr_matches = 0;
+		size_t i, msg_matches = 0, usr_matches = 0;
 		time_t usr_first_seen = 0;
 
-		MOWGLI_ITER_FOREACH(n, mq->entries.head)
+		for (i = 0; i < mq->count; i++)
 		{
-			msg_t *msg = n->data;
+			msg_t *msg = MQUEUE_ENTRY(mq, i);
 
-			if (!strcasecmp(msg->message, newest->message))
+			if (msg->fingerprint == newest->fingerprint)
 				msg_matches++;
 
 			if (msg->source == newest->source)
@@ -351,7 +362,6 @@ on_channel_message(hook_cmessage_data_t *data)
 	chanuser_t *cu;
 	mychan_t *mc;
 	mqueue_t *mq;
-	msg_t *msg;
 
 	return_if_fail(data != NULL);
 	return_if_fail(data->msg != NULL);
@@ -366,19 +376,19 @@ on_channel_message(hook_cmessage_data_t *data)
 	if (mc == NULL)
 		return;
 
+	/* do not track or enforce unless enforcement is specifically enabled */
+	if (!(mc->flags & MC_ANTIFLOOD))
+		return;
+
 	mq = mqueue_get(mc);
 	return_if_fail(mq != NULL);
 
-	msg = msg_create(mq, data->u, data->msg);
+	msg_create(mq, data->u, data->msg);
 
 	/* never enforce against any user who has special CSTATUS flags. */
 	if (cu->modes)
 		return;
 
-	/* do not enforce unless enforcement is specifically enabled */
-	if (!(mc->flags & MC_ANTIFLOOD))
-		return;
-
 	if (mqueue_should_enforce(mq) != MQ_ENFORCE_NONE)
 	{
 		antiflood_enforce_method_impl_t *enf = antiflood_enforce_method_impl_get(mc);
@@ -395,8 +405,10 @@ on_channel_drop(mychan_t *mc)
 {
 	mqueue_t *mq;
 
-	mq = mqueue_get(mc);
-	return_if_fail(mq != NULL);
+	/* channels without antiflood never had a queue */
+	mq = mowgli_patricia_retrieve(mqueue_trie, mc->name);
+	if (mq == NULL)
+		return;
 
 	mqueue_destroy(mq);
 }
@@ -435,6 +447,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 	if (!strcasecmp(parv[1], "OFF"))
 	{
 		mc->flags &= ~MC_ANTIFLOOD;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 		metadata_delete(mc, METADATA_KEY_ENFORCE_METHOD);
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD:NONE: \2%s\2",  mc->name);
@@ -449,6 +462,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 			return;
 		}
 		mc->flags |= MC_ANTIFLOOD;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 		metadata_delete(mc, METADATA_KEY_ENFORCE_METHOD);
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "DEFAULT");
@@ -458,6 +472,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 	else if (!strcasecmp(parv[1], "QUIET"))
 	{
 		mc->flags |= MC_ANTIFLOOD;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 		metadata_add(mc, METADATA_KEY_ENFORCE_METHOD, "QUIET");
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "QUIET");
@@ -467,6 +482,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 	else if (!strcasecmp(parv[1], "KICKBAN"))
 	{
 		mc->flags |= MC_ANTIFLOOD;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 		metadata_add(mc, METADATA_KEY_ENFORCE_METHOD, "KICKBAN");
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "KICKBAN");
@@ -478,6 +494,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 		if (has_priv(si, PRIV_AKILL))
 		{
 			mc->flags |= MC_ANTIFLOOD;
+			db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 			metadata_add(mc, METADATA_KEY_ENFORCE_METHOD, "AKILL");
 
 			logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "AKILL");
@@ -538,8 +555,6 @@ _modinit(module_t *m)
 	hook_add_event("channel_drop");
 	hook_add_channel_drop(on_channel_drop);
 
-	msg_heap = sharedheap_get(sizeof(msg_t));
-
 	mqueue_heap = sharedheap_get(sizeof(mqueue_t));
 	mqueue_trie = mowgli_patricia_create(irccasecanon);
 	mqueue_gc_timer = mowgli_timer_add(base_eventloop, "mqueue_gc", mqueue_gc, NULL, 300);
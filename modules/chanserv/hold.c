@@ -65,6 +65,7 @@ static void cs_cmd_hold(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		mc->flags |= MC_HOLD;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		metadata_add(mc, "private:held:holder", get_oper_name(si));
 		metadata_add(mc, "private:held:timestamp", number_to_string(CURRTIME));
@@ -82,6 +83,7 @@ static void cs_cmd_hold(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		mc->flags &= ~MC_HOLD;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		metadata_delete(mc, "private:held:holder");
 		metadata_delete(mc, "private:held:timestamp");
@@ -33,6 +33,9 @@ static void on_shutdown(void *unused);
 
 static mowgli_eventloop_timer_t *cs_leave_empty_timer = NULL;
 
+/* looked up for every fantasy command */
+static metadata_key_t md_disable_fantasy, md_prefix;
+
 static void join_registered(bool all)
 {
 	mychan_t *mc;
@@ -92,7 +95,7 @@ static void chanserv(sourceinfo_t *si, int parc, char *parv[])
 			return;
 		}
 
-		md = metadata_find(mc, "disable_fantasy");
+		md = metadata_find_key(mc, md_disable_fantasy);
 		if (md)
 		{
 			/* fantasy disabled on this channel. don't message them, just bail. */
@@ -119,7 +122,7 @@ static void chanserv(sourceinfo_t *si, int parc, char *parv[])
 		command_exec_split(si->service, si, cmd, strtok(NULL, ""), si->service->commands);
 	else
 	{
-		metadata_t *md = metadata_find(mc, "private:prefix");
+		metadata_t *md = metadata_find_key(mc, md_prefix);
 		const char *prefix = (md ? md->value : chansvs.trigger);
 
 		if (strlen(cmd) >= 2 && strchr(prefix, cmd[0]) && isalpha((unsigned char)*++cmd))
@@ -267,6 +270,9 @@ static int c_ci_templates(mowgli_config_file_entry_t *ce)
 
 void _modinit(module_t *m)
 {
+	md_disable_fantasy = metadata_key_intern("disable_fantasy");
+	md_prefix = metadata_key_intern("private:prefix");
+
 	hook_add_event("config_ready");
 	hook_add_config_ready(chanserv_config_ready);
 
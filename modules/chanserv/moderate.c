@@ -246,6 +246,7 @@ static void cs_cmd_activate(sourceinfo_t *si, int parc, char *parv[])
 	if (c != NULL && c->key == NULL)
 		mc->mlock_off |= CMODE_KEY;
 	mc->flags |= config_options.defcflags;
+	db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 	slog(LG_DEBUG, "cs_cmd_activate(): defcflags = %d, mc->flags = %d, guard? %s", config_options.defcflags, mc->flags, (mc->flags & MC_GUARD) ? "YES" : "NO");
 
 	chanacs_add(mc, cs->mt, custom_founder_check(), CURRTIME, entity(si->smu));
@@ -148,6 +148,7 @@ static void cs_cmd_register(sourceinfo_t *si, int parc, char *parv[])
 	if (c->key == NULL)
 		mc->mlock_off |= CMODE_KEY;
 	mc->flags |= config_options.defcflags;
+	db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 	chanacs_add(mc, entity(si->smu), custom_founder_check(), CURRTIME, entity(si->smu));
 
@@ -102,6 +102,7 @@ static void cs_cmd_set_guard(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 enabled the GUARD flag"), get_source_name(si));
 
 		mc->flags |= MC_GUARD;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		if (!(mc->flags & MC_INHABIT))
 			join(mc->name, chansvs.nick);
@@ -121,6 +122,7 @@ static void cs_cmd_set_guard(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 disabled the GUARD flag"), get_source_name(si));
 
 		mc->flags &= ~MC_GUARD;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		if (mc->chan != NULL && !(mc->flags & MC_INHABIT) && !(mc->chan->flags & CHAN_LOG))
 			part(mc->name, chansvs.nick);
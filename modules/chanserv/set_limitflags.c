@@ -85,6 +85,7 @@ static void cs_cmd_set_limitflags(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 enabled the LIMITFLAGS flag"), get_source_name(si));
 
 		mc->flags |= MC_LIMITFLAGS;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for \2%s\2."), "LIMITFLAGS", mc->name);
 
@@ -103,6 +104,7 @@ static void cs_cmd_set_limitflags(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 disabled the LIMITFLAGS flag"), get_source_name(si));
 
 		mc->flags &= ~MC_LIMITFLAGS;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for \2%s\2."), "LIMITFLAGS", mc->name);
 
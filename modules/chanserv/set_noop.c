@@ -78,6 +78,7 @@ static void cs_cmd_set_noop(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 enabled the NOOP flag - all Operator functions must be done through Services."), get_source_name(si));
 
 		mc->flags |= MC_NOOP;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for channel \2%s\2."), "NOOP", mc->name);
 		return;
@@ -94,6 +95,7 @@ static void cs_cmd_set_noop(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 disabled the NOOP flag"), get_source_name(si));
 
 		mc->flags &= ~MC_NOOP;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for channel \2%s\2."), "NOOP", mc->name);
 		return;
@@ -85,6 +85,7 @@ static void cs_cmd_set_private(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 enabled the PRIVATE flag"), get_source_name(si));
 
 		mc->flags |= MC_PRIVATE;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for \2%s\2."), "PRIVATE", mc->name);
 
@@ -103,6 +104,7 @@ static void cs_cmd_set_private(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 disabled the PRIVATE flag"), get_source_name(si));
 
 		mc->flags &= ~MC_PRIVATE;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for \2%s\2."), "PRIVATE", mc->name);
 
@@ -41,7 +41,7 @@ static void cs_cmd_set_property(sourceinfo_t *si, int parc, char *parv[])
 	char *property = strtok(parv[1], " ");
 	char *value = strtok(NULL, "");
 	unsigned int count;
-	mowgli_patricia_iteration_state_t state;
+	object_map_iteration_state_t state;
 	metadata_t *md;
 
 	if (!property)
@@ -98,7 +98,7 @@ static void cs_cmd_set_property(sourceinfo_t *si, int parc, char *parv[])
 	count = 0;
 	if (object(mc)->metadata)
 	{
-		MOWGLI_PATRICIA_FOREACH(md, &state, object(mc)->metadata)
+		METADATA_FOREACH(md, &state, mc)
 		{
 			if (strncmp(md->name, "private:", 8))
 				count++;
@@ -80,6 +80,7 @@ static void cs_cmd_set_pubacl(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 enabled the PUBACL flag"), get_source_name(si));
 
  		mc->flags |= MC_PUBACL;
+ 		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for channel \2%s\2."), "PUBACL", mc->name);
 		return;
@@ -96,6 +97,7 @@ static void cs_cmd_set_pubacl(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 disabled the PUBACL flag"), get_source_name(si));
 
 		mc->flags &= ~MC_PUBACL;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for channel \2%s\2."), "PUBACL", mc->name);
 		return;
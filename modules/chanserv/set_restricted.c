@@ -81,6 +81,7 @@ static void cs_cmd_set_restricted(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 enabled the RESTRICTED flag"), get_source_name(si));
 
 		mc->flags |= MC_RESTRICTED;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for channel \2%s\2."), "RESTRICTED", mc->name);
 		return;
@@ -97,6 +98,7 @@ static void cs_cmd_set_restricted(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 disabled the RESTRICTED flag"), get_source_name(si));
 
 		mc->flags &= ~MC_RESTRICTED;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for channel \2%s\2."), "RESTRICTED", mc->name);
 		return;
@@ -81,6 +81,7 @@ static void cs_cmd_set_topiclock(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 enabled the TOPICLOCK flag"), get_source_name(si));
 
 		mc->flags |= MC_KEEPTOPIC | MC_TOPICLOCK;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 		topiclock_sts(mc->chan);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for channel \2%s\2."), "TOPICLOCK", mc->name);
@@ -99,6 +100,7 @@ static void cs_cmd_set_topiclock(sourceinfo_t *si, int parc, char *parv[])
 		verbose(mc, _("\2%s\2 disabled the TOPICLOCK flag"), get_source_name(si));
 
 		mc->flags &= ~MC_TOPICLOCK;
+		db_journal_record(DB_JOURNAL_MYCHAN, mc, NULL);
 		topiclock_sts(mc->chan);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for channel \2%s\2."), "TOPICLOCK", mc->name);
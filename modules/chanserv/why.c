@@ -164,7 +164,7 @@ static void cs_cmd_why(sourceinfo_t *si, int parc, char *parv[])
 			}
 		}
 	}
-	for (n = next_matching_host_chanacs(mc, u, mc->chanacs.head); n != NULL; n = next_matching_host_chanacs(mc, u, n->next))
+	for (n = next_matching_host_chanacs(mc, u, mc->chanacs_hosts.head); n != NULL; n = next_matching_host_chanacs(mc, u, n->next))
 	{
 		ca = n->data;
 		fl |= ca->level;
@@ -388,6 +388,7 @@ static void cs_xop_do_del(sourceinfo_t *si, mychan_t *mc, myentity_t *mt, char *
 		req.oldlevel = ca->level;
 
 		ca->level = 0;
+		chanacs_invalidate(mc);
 
 		req.newlevel = ca->level;
 
@@ -410,6 +411,7 @@ static void cs_xop_do_del(sourceinfo_t *si, mychan_t *mc, myentity_t *mt, char *
 	req.oldlevel = ca->level;
 
 	ca->level = 0;
+	chanacs_invalidate(mc);
 
 	req.newlevel = ca->level;
 
@@ -113,6 +113,7 @@ struct argon2d_context
 	uint32_t                lane_len;
 	uint32_t                seg_len;
 	uint32_t                index;
+	struct argon2d_block   *mempool;
 };
 
 enum BLAKE2B_SZCHK_STATIC_ASSERT
@@ -151,7 +152,8 @@ static const uint64_t blake2b_sigma[0x0C][0x10] = {
 /*
  * This is reallocated on-demand to save allocating and freeing every time we
  * digest a password. The mempoolsz variable tracks how large (in blocks) the
- * currently-allocated memory pool is.
+ * currently-allocated memory pool is. It belongs to the main thread; password
+ * verification threads allocate a pool of their own for each digest.
  */
 static struct argon2d_block *argon2d_mempool = NULL;
 static uint32_t argon2d_mempoolsz = 0;
@@ -602,12 +604,12 @@ argon2d_segment_fill(struct argon2d_context *const restrict ctx, const uint32_t
 
 		ctx->index = i;
 
-		const uint64_t rand_p = argon2d_mempool[prv_off].v[0x00];
+		const uint64_t rand_p = ctx->mempool[prv_off].v[0x00];
 		const uint32_t ref_idx = argon2d_idx(ctx, pass, slice, rand_p);
 
-		const struct argon2d_block *const prv = &argon2d_mempool[prv_off];
-		const struct argon2d_block *const ref = &argon2d_mempool[ref_idx];
-		struct argon2d_block *const cur = &argon2d_mempool[cur_off];
+		const struct argon2d_block *const prv = &ctx->mempool[prv_off];
+		const struct argon2d_block *const ref = &ctx->mempool[ref_idx];
+		struct argon2d_block *const cur = &ctx->mempool[cur_off];
 
 		(void) argon2d_fill_block(prv, ref, cur, pass);
 	}
@@ -622,8 +624,18 @@ argon2d_hash_raw(struct argon2d_context *const restrict ctx)
 
 	ctx->lane_len = mem_blocks;
 
-	if (!atheme_argon2d_mempool_realloc(mem_blocks))
-		return false;
+	if (crypt_in_worker())
+	{
+		if (!(ctx->mempool = malloc(mem_blocks * sizeof(struct argon2d_block))))
+			return false;
+	}
+	else
+	{
+		if (!atheme_argon2d_mempool_realloc(mem_blocks))
+			return false;
+
+		ctx->mempool = argon2d_mempool;
+	}
 
 	uint8_t bhash_init[ARGON2_PRESEED_LEN];
 	(void) argon2d_hash_init(ctx, bhash_init);
@@ -632,10 +644,10 @@ argon2d_hash_raw(struct argon2d_context *const restrict ctx)
 
 	uint8_t bhash_bytes[ARGON2_BLKSZ];
 	(void) blake2b_long(bhash_init, ARGON2_PRESEED_LEN, bhash_bytes, ARGON2_BLKSZ);
-	(void) argon2d_load_block(&argon2d_mempool[0x00], bhash_bytes);
+	(void) argon2d_load_block(&ctx->mempool[0x00], bhash_bytes);
 	(void) blake2b_store32(bhash_init + ARGON2_PREHASH_LEN, 0x01);
 	(void) blake2b_long(bhash_init, ARGON2_PRESEED_LEN, bhash_bytes, ARGON2_BLKSZ);
-	(void) argon2d_load_block(&argon2d_mempool[0x01], bhash_bytes);
+	(void) argon2d_load_block(&ctx->mempool[0x01], bhash_bytes);
 
 	for (uint32_t pass = 0x00; pass < ctx->t_cost; pass++)
 	{
@@ -647,9 +659,13 @@ argon2d_hash_raw(struct argon2d_context *const restrict ctx)
 	}
 
 	struct argon2d_block bhash_final;
-	(void) argon2d_copy_block(&bhash_final, &argon2d_mempool[ctx->lane_len - 0x01]);
+	(void) argon2d_copy_block(&bhash_final, &ctx->mempool[ctx->lane_len - 0x01]);
 	(void) argon2d_store_block(bhash_bytes, &bhash_final);
 	(void) blake2b_long(bhash_bytes, ARGON2_BLKSZ, ctx->hash, ATHEME_ARGON2D_HASHLEN);
+
+	if (crypt_in_worker())
+		(void) free(ctx->mempool);
+
 	return true;
 }
 
@@ -866,6 +882,7 @@ static crypt_impl_t crypto_argon2d_impl = {
 	.crypt      = &atheme_argon2d_crypt,
 	.verify     = &atheme_argon2d_verify,
 	.recrypt    = &atheme_argon2d_recrypt,
+	.threadsafe = true,
 };
 
 static mowgli_list_t atheme_argon2d_conf_table;
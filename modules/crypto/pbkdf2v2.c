@@ -474,6 +474,7 @@ static crypt_impl_t crypto_pbkdf2v2_impl = {
 	.crypt      = &atheme_pbkdf2v2_crypt,
 	.verify     = &atheme_pbkdf2v2_verify,
 	.recrypt    = &atheme_pbkdf2v2_recrypt,
+	.threadsafe = true,
 };
 
 static mowgli_list_t pbkdf2v2_conf_table;
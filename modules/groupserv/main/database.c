@@ -13,7 +13,7 @@ static void write_groupdb(database_handle_t *db)
 {
 	myentity_t *mt;
 	myentity_iteration_state_t state;
-	mowgli_patricia_iteration_state_t state2;
+	object_map_iteration_state_t state2;
 	metadata_t *md;
 
 	db_start_row(db, "GDBV");
@@ -55,7 +55,7 @@ static void write_groupdb(database_handle_t *db)
 
 		if (object(mg)->metadata)
 		{
-			MOWGLI_PATRICIA_FOREACH(md, &state2, object(mg)->metadata)
+			METADATA_FOREACH(md, &state2, mg)
 			{
 				db_start_row(db, "MDG");
 				db_write_word(db, entity(mg)->name);
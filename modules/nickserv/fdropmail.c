@@ -87,6 +87,7 @@ static void ns_cmd_fdropmail(sourceinfo_t *si, int parc, char *parv[])
 	char *email = parv[0];
 	struct fdropmail_state state;
 	myuser_t *mu;
+	mowgli_node_t *n, *tn;
 
 	if (!email)
 	{
@@ -99,7 +100,19 @@ static void ns_cmd_fdropmail(sourceinfo_t *si, int parc, char *parv[])
 	state.pattern = email;
 	state.email_canonical = canonicalize_email(email);
 	state.origin = si;
-	myentity_foreach_t(ENT_USER, fdropmail_foreach_cb, &state);
+
+	/* without wildcards only accounts sharing the canonical address can match */
+	if (strpbrk(email, "*?") == NULL)
+	{
+		mowgli_list_t *l = myuser_find_by_email(state.email_canonical);
+
+		/* dropping an account takes it off the list, and the last one frees it */
+		if (l != NULL)
+			MOWGLI_ITER_FOREACH_SAFE(n, tn, l->head)
+				fdropmail_foreach_cb(entity(n->data), &state);
+	}
+	else
+		myentity_foreach_t(ENT_USER, fdropmail_foreach_cb, &state);
 	strshare_unref(state.email_canonical);
 
 	logcommand(si, CMDLOG_ADMIN, "FDROPMAIL: \2%s\2 (\2%d\2 matches)", email, state.matches);
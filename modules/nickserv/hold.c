@@ -80,6 +80,7 @@ static void ns_cmd_hold(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		mu->flags |= MU_HOLD;
+		db_journal_record(DB_JOURNAL_MYUSER, mu, NULL);
 
 		metadata_add(mu, "private:held:holder", get_oper_name(si));
 		metadata_add(mu, "private:held:timestamp", number_to_string(CURRTIME));
@@ -97,6 +98,7 @@ static void ns_cmd_hold(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		mu->flags &= ~MU_HOLD;
+		db_journal_record(DB_JOURNAL_MYUSER, mu, NULL);
 
 		metadata_delete(mu, "private:held:holder");
 		metadata_delete(mu, "private:held:timestamp");
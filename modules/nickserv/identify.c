@@ -25,6 +25,18 @@ DECLARE_MODULE_V1
 );
 
 static void ns_cmd_login(sourceinfo_t *si, int parc, char *parv[]);
+static void ns_login_verified(myuser_t *mu, bool verified, void *priv);
+static void ns_login_finish(sourceinfo_t *si, myuser_t *mu, bool verified);
+static void ns_login_user_delete(user_t *u);
+
+/* a login waiting for its password to be checked */
+typedef struct {
+	sourceinfo_t *si;
+	verify_password_req_t *req;
+	mowgli_node_t node;
+} login_req_t;
+
+static mowgli_list_t login_reqs;
 
 #ifdef NICKSERV_LOGIN
 command_t ns_login = { "LOGIN", N_("Authenticates to a services account."), AC_NONE, 2, ns_cmd_login, { .path = "nickserv/login" } };
@@ -41,10 +53,26 @@ void _modinit(module_t *m)
 #endif
 
 	hook_add_event("user_can_login");
+	hook_add_event("user_delete");
+	hook_add_user_delete(ns_login_user_delete);
 }
 
 void _moddeinit(module_unload_intent_t intent)
 {
+	mowgli_node_t *n, *tn;
+
+	hook_del_user_delete(ns_login_user_delete);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, login_reqs.head)
+	{
+		login_req_t *l = n->data;
+
+		verify_password_cancel(l->req);
+		mowgli_node_delete(&l->node, &login_reqs);
+		object_unref(l->si);
+		free(l);
+	}
+
 #ifdef NICKSERV_LOGIN
 	service_named_unbind_command("nickserv", &ns_login);
 #else
@@ -52,15 +80,49 @@ void _moddeinit(module_unload_intent_t intent)
 #endif
 }
 
+/* hook vetoes, freezes and NOPASSWORD, checked before and after the password */
+static bool ns_login_allowed(sourceinfo_t *si, myuser_t *mu)
+{
+	hook_user_login_check_t req;
+
+	req.si = si;
+	req.mu = mu;
+	req.allowed = true;
+	hook_call_user_can_login(&req);
+	if (!req.allowed)
+	{
+		command_fail(si, fault_authfail, nicksvs.no_nick_ownership ? "You cannot log in as \2%s\2 because the server configuration disallows it."
+									   : "You cannot identify to \2%s\2 because the server configuration disallows it.", entity(mu)->name);
+		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (denied by hook)", entity(mu)->name);
+		return false;
+	}
+
+	if (metadata_find(mu, "private:freeze:freezer"))
+	{
+		command_fail(si, fault_authfail, nicksvs.no_nick_ownership ? "You cannot log in as \2%s\2 because the account has been frozen."
+									   : "You cannot identify to \2%s\2 because the nickname has been frozen.", entity(mu)->name);
+		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (frozen)", entity(mu)->name);
+		return false;
+	}
+
+	if (mu->flags & MU_NOPASSWORD)
+	{
+		command_fail(si, fault_authfail, _("Password authentication is disabled for this account."));
+		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (password authentication disabled)", entity(mu)->name);
+		return false;
+	}
+
+	return true;
+}
+
 static void ns_cmd_login(sourceinfo_t *si, int parc, char *parv[])
 {
 	user_t *u = si->su;
 	myuser_t *mu;
-	mowgli_node_t *n, *tn;
+	mowgli_node_t *n;
 	const char *target = parv[0];
 	const char *password = parv[1];
-	char lau[BUFSIZE];
-	hook_user_login_check_t req;
+	login_req_t *l;
 
 	if (si->su == NULL)
 	{
@@ -90,47 +152,75 @@ static void ns_cmd_login(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	req.si = si;
-	req.mu = mu;
-	req.allowed = true;
-	hook_call_user_can_login(&req);
-	if (!req.allowed)
+	if (!ns_login_allowed(si, mu))
+		return;
+
+	if (u->myuser == mu)
 	{
-		command_fail(si, fault_authfail, nicksvs.no_nick_ownership ? "You cannot log in as \2%s\2 because the server configuration disallows it."
-									   : "You cannot identify to \2%s\2 because the server configuration disallows it.", entity(mu)->name);
-		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (denied by hook)", entity(mu)->name);
+		command_fail(si, fault_nochange, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
+		if (mu->flags & MU_WAITAUTH)
+			command_fail(si, fault_nochange, _("Please check your email for instructions to complete your registration."));
 		return;
 	}
-
-	if (metadata_find(mu, "private:freeze:freezer"))
+	else if (u->myuser != NULL && !command_find(si->service->commands, "LOGOUT"))
 	{
-		command_fail(si, fault_authfail, nicksvs.no_nick_ownership ? "You cannot log in as \2%s\2 because the account has been frozen."
-									   : "You cannot identify to \2%s\2 because the nickname has been frozen.", entity(mu)->name);
-		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (frozen)", entity(mu)->name);
+		command_fail(si, fault_alreadyexists, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
 		return;
 	}
 
-	if (mu->flags & MU_NOPASSWORD)
+	MOWGLI_ITER_FOREACH(n, login_reqs.head)
 	{
-		command_fail(si, fault_authfail, _("Password authentication is disabled for this account."));
-		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (password authentication disabled)", entity(mu)->name);
+		login_req_t *l = n->data;
+
+		if (l->si->su == u)
+		{
+			command_fail(si, fault_toomany, _("Your previous %s request is still being processed."), COMMAND_UC);
+			return;
+		}
+	}
+
+	/* the password check may take a while; ns_login_verified() takes over */
+	l = smalloc(sizeof *l);
+	l->si = object_ref(si);
+	mowgli_node_add(l, &l->node, &login_reqs);
+	l->req = verify_password_async(mu, password, ns_login_verified, l);
+}
+
+static void ns_login_verified(myuser_t *mu, bool verified, void *priv)
+{
+	login_req_t *l = priv;
+	sourceinfo_t *si = l->si;
+
+	mowgli_node_delete(&l->node, &login_reqs);
+	free(l);
+
+	ns_login_finish(si, mu, verified);
+	object_unref(si);
+}
+
+static void ns_login_finish(sourceinfo_t *si, myuser_t *mu, bool verified)
+{
+	user_t *u = si->su;
+	mowgli_node_t *n, *tn;
+	char lau[BUFSIZE];
+
+	if (mu == NULL)
+	{
+		command_fail(si, fault_nosuch_target, _("The account you tried to identify to no longer exists."));
 		return;
 	}
 
+	/* things may have changed while the password was being checked */
 	if (u->myuser == mu)
 	{
 		command_fail(si, fault_nochange, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
-		if (mu->flags & MU_WAITAUTH)
-			command_fail(si, fault_nochange, _("Please check your email for instructions to complete your registration."));
 		return;
 	}
-	else if (u->myuser != NULL && !command_find(si->service->commands, "LOGOUT"))
-	{
-		command_fail(si, fault_alreadyexists, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
+
+	if (!ns_login_allowed(si, mu))
 		return;
-	}
 
-	if (verify_password(mu, password))
+	if (verified)
 	{
 		if (MOWGLI_LIST_LENGTH(&mu->logins) >= me.maxlogins)
 		{
@@ -182,6 +272,25 @@ static void ns_cmd_login(sourceinfo_t *si, int parc, char *parv[])
 	bad_password(si, mu);
 }
 
+/* the user quit or was killed before their password was checked */
+static void ns_login_user_delete(user_t *u)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, login_reqs.head)
+	{
+		login_req_t *l = n->data;
+
+		if (l->si->su != u)
+			continue;
+
+		verify_password_cancel(l->req);
+		mowgli_node_delete(&l->node, &login_reqs);
+		object_unref(l->si);
+		free(l);
+	}
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
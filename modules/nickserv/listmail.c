@@ -59,6 +59,7 @@ static void ns_cmd_listmail(sourceinfo_t *si, int parc, char *parv[])
 {
 	char *email = parv[0];
 	struct listmail_state state;
+	mowgli_node_t *n;
 
 	if (!email)
 	{
@@ -71,7 +72,18 @@ static void ns_cmd_listmail(sourceinfo_t *si, int parc, char *parv[])
 	state.pattern = email;
 	state.email_canonical = canonicalize_email(email);
 	state.origin = si;
-	myentity_foreach_t(ENT_USER, listmail_foreach_cb, &state);
+
+	/* without wildcards only accounts sharing the canonical address can match */
+	if (strpbrk(email, "*?") == NULL)
+	{
+		mowgli_list_t *l = myuser_find_by_email(state.email_canonical);
+
+		if (l != NULL)
+			MOWGLI_ITER_FOREACH(n, l->head)
+				listmail_foreach_cb(entity(n->data), &state);
+	}
+	else
+		myentity_foreach_t(ENT_USER, listmail_foreach_cb, &state);
 	strshare_unref(state.email_canonical);
 
 	logcommand(si, CMDLOG_ADMIN, "LISTMAIL: \2%s\2 (\2%d\2 matches)", email, state.matches);
@@ -185,6 +185,7 @@ static void ns_cmd_register(sourceinfo_t *si, int parc, char *parv[])
 	{
 		char *key = random_string(12);
 		mu->flags |= MU_WAITAUTH;
+		db_journal_record(DB_JOURNAL_MYUSER, mu, NULL);
 
 		metadata_add(mu, "private:verify:register:key", key);
 		metadata_add(mu, "private:verify:register:timestamp", number_to_string(time(NULL)));
@@ -76,6 +76,7 @@ static void ns_cmd_set_nevergroup(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NEVERGROUP:ON");
 
 		si->smu->flags |= MU_NEVERGROUP;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for account \2%s\2."), "NEVERGROUP", entity(si->smu)->name);
 
@@ -93,6 +94,7 @@ static void ns_cmd_set_nevergroup(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NEVERGROUP:OFF");
 
 		si->smu->flags &= ~MU_NEVERGROUP;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for account \2%s\2."), "NEVERGROUP", entity(si->smu)->name);
 
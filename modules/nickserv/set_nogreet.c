@@ -75,6 +75,7 @@ static void ns_cmd_set_nogreet(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NOGREET:ON");
 
 		si->smu->flags |= MU_NOGREET;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for account \2%s\2."), "NOGREET" ,entity(si->smu)->name);
 
@@ -91,6 +92,7 @@ static void ns_cmd_set_nogreet(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NOGREET:OFF");
 
 		si->smu->flags &= ~MU_NOGREET;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for account \2%s\2."), "NOGREET", entity(si->smu)->name);
 
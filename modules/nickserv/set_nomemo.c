@@ -74,6 +74,7 @@ static void ns_cmd_set_nomemo(sourceinfo_t *si, int parc, char *parv[])
 
 		logcommand(si, CMDLOG_SET, "SET:NOMEMO:ON");
 		si->smu->flags |= MU_NOMEMO;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 		command_success_nodata(si, _("The \2%s\2 flag has been set for account \2%s\2."), "NOMEMO", entity(si->smu)->name);
 		return;
 	}
@@ -88,6 +89,7 @@ static void ns_cmd_set_nomemo(sourceinfo_t *si, int parc, char *parv[])
 
 		logcommand(si, CMDLOG_SET, "SET:NOMEMO:OFF");
 		si->smu->flags &= ~MU_NOMEMO;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for account \2%s\2."), "NOMEMO", entity(si->smu)->name);
 		return;
 	}
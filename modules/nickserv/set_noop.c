@@ -78,6 +78,7 @@ static void ns_cmd_set_noop(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NOOP:ON");
 
 		si->smu->flags |= MU_NOOP;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for account \2%s\2."), "NOOP", entity(si->smu)->name);
 
@@ -94,6 +95,7 @@ static void ns_cmd_set_noop(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NOOP:OFF");
 
 		si->smu->flags &= ~MU_NOOP;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for account \2%s\2."), "NOOP", entity(si->smu)->name);
 
@@ -83,6 +83,7 @@ static void ns_cmd_set_nopassword(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NOPASSWORD:ON");
 
 		si->smu->flags |= MU_NOPASSWORD;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for account \2%s\2."), "NOPASSWORD" ,entity(si->smu)->name);
 
@@ -99,6 +100,7 @@ static void ns_cmd_set_nopassword(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NOPASSWORD:OFF");
 
 		si->smu->flags &= ~MU_NOPASSWORD;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for account \2%s\2."), "NOPASSWORD", entity(si->smu)->name);
 
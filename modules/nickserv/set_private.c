@@ -41,6 +41,7 @@ static void ns_cmd_set_private(sourceinfo_t *si, int parc, char *parv[])
 
 		si->smu->flags |= MU_PRIVATE;
 		si->smu->flags |= MU_HIDEMAIL;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for \2%s\2."), "PRIVATE" ,entity(si->smu)->name);
 
@@ -57,6 +58,7 @@ static void ns_cmd_set_private(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:PRIVATE:OFF");
 
 		si->smu->flags &= ~MU_PRIVATE;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for \2%s\2."), "PRIVATE", entity(si->smu)->name);
 
@@ -40,6 +40,7 @@ static void ns_cmd_set_privmsg(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:PRIVMSG:ON");
 
 		si->smu->flags |= MU_USE_PRIVMSG;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for \2%s\2."), "PRIVMSG" ,entity(si->smu)->name);
 
@@ -56,6 +57,7 @@ static void ns_cmd_set_privmsg(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:PRIVMSG:OFF");
 
 		si->smu->flags &= ~MU_USE_PRIVMSG;
+		db_journal_record(DB_JOURNAL_MYUSER, si->smu, NULL);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for \2%s\2."), "PRIVMSG", entity(si->smu)->name);
 
@@ -106,6 +106,7 @@ static void ns_cmd_setpass(sourceinfo_t *si, int parc, char *parv[])
 	if (mu->flags & MU_NOPASSWORD)
 	{
 		mu->flags &= ~MU_NOPASSWORD;
+		db_journal_record(DB_JOURNAL_MYUSER, mu, NULL);
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for account \2%s\2."), "NOPASSWORD", entity(mu)->name);
 	}
 }
@@ -33,7 +33,7 @@ static void ns_cmd_taxonomy(sourceinfo_t *si, int parc, char *parv[])
 {
 	const char *target = parv[0];
 	myuser_t *mu;
-	mowgli_patricia_iteration_state_t state;
+	object_map_iteration_state_t state;
 	bool isoper;
 	metadata_t *md;
 
@@ -60,7 +60,7 @@ static void ns_cmd_taxonomy(sourceinfo_t *si, int parc, char *parv[])
 
 	command_success_nodata(si, _("Taxonomy for \2%s\2:"), entity(mu)->name);
 
-	MOWGLI_PATRICIA_FOREACH(md, &state, object(mu)->metadata)
+	METADATA_FOREACH(md, &state, mu)
 	{
 		if (!strncmp(md->name, "private:", 8) && !isoper)
 			continue;
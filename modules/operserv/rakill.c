@@ -38,6 +38,7 @@ static void os_cmd_rakill(sourceinfo_t *si, int parc, char *parv[])
 {
 	atheme_regex_t *regex;
 	char usermask[512];
+	int len;
 	unsigned int matches = 0;
 	mowgli_patricia_iteration_state_t state;
 	user_t *u;
@@ -104,9 +105,9 @@ static void os_cmd_rakill(sourceinfo_t *si, int parc, char *parv[])
 
 	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
 	{
-		sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
+		len = sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
 
-		if (regex_match(regex, usermask))
+		if (regex_match_len(regex, usermask, len))
 		{
 			/* match */
 			command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s - akilling"), u->nick, u->user, u->host, u->gecos);
@@ -40,6 +40,7 @@ static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[])
 {
 	atheme_regex_t *regex;
 	char usermask[512];
+	int len;
 	unsigned int matches = 0, maxmatches;
 	mowgli_patricia_iteration_state_t state;
 	user_t *u;
@@ -86,9 +87,9 @@ static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[])
 
 	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
 	{
-		sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
+		len = sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
 
-		if (regex_match(regex, usermask))
+		if (regex_match_len(regex, usermask, len))
 		{
 			matches++;
 			if (matches <= maxmatches)
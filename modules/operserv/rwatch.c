@@ -46,8 +46,21 @@ struct rwatch_
 	char *reason;
 	int actions; /* RWACT_* */
 	atheme_regex_t *re;
+	char *literal; /* substring every match must contain, lowercased for AREGEX_ICASE */
 };
 
+/*
+ * The rwatch set is compiled into a flat array of usable entries, each
+ * with the longest literal its regex requires. Only entries whose literal
+ * appears in the user mask (or that have none) get the full regex run.
+ * The set is recompiled lazily after ADD, DEL, SET and database loads.
+ */
+static rwatch_t **rwatch_set = NULL;
+static rwatch_t **rwatch_hits = NULL;
+static size_t rwatch_set_count = 0;
+static bool rwatch_set_icase = false;
+static bool rwatch_set_dirty = true;
+
 command_t os_rwatch = { "RWATCH", N_("Performs actions on connecting clients matching regexes."), PRIV_USER_AUSPEX, 2, os_cmd_rwatch, { .path = "oservice/rwatch" } };
 
 command_t os_rwatch_add = { "ADD", N_("Adds an entry to the regex watch list."), AC_NONE, 1, os_cmd_rwatch_add, { .path = "" } };
@@ -103,12 +116,19 @@ void _moddeinit(module_unload_intent_t intent)
 		free(rw->reason);
 		if (rw->re != NULL)
 			regex_destroy(rw->re);
+		free(rw->literal);
 		free(rw);
 
 		mowgli_node_delete(n, &rwatch_list);
 		mowgli_node_free(n);
 	}
 
+	free(rwatch_set);
+	free(rwatch_hits);
+	rwatch_set = rwatch_hits = NULL;
+	rwatch_set_count = 0;
+	rwatch_set_dirty = true;
+
 	service_named_unbind_command("operserv", &os_rwatch);
 
 	command_delete(&os_rwatch_add, os_rwatch_cmds);
@@ -190,6 +210,7 @@ static void load_rwatchdb(char *path)
 				rw->actions = atoi(actionstr);
 				rw->reason = sstrdup(reason);
 				mowgli_node_add(rw, mowgli_node_create(), &rwatch_list);
+				rwatch_set_dirty = true;
 				rw = NULL;
 			}
 		}
@@ -236,6 +257,7 @@ static void db_h_rr(database_handle_t *db, const char *type)
 	rwread->actions = actions;
 	rwread->reason = sstrdup(reason);
 	mowgli_node_add(rwread, mowgli_node_create(), &rwatch_list);
+	rwatch_set_dirty = true;
 	rwread = NULL;
 }
 
@@ -324,6 +346,7 @@ static void os_cmd_rwatch_add(sourceinfo_t *si, int parc, char *parv[])
 	rw->re = regex;
 
 	mowgli_node_add(rw, mowgli_node_create(), &rwatch_list);
+	rwatch_set_dirty = true;
 	command_success_nodata(si, _("Added \2%s\2 to regex watch list."), pattern);
 	logcommand(si, CMDLOG_ADMIN, "RWATCH:ADD: \2%s\2 (reason: \2%s\2)", pattern, reason);
 }
@@ -378,9 +401,11 @@ static void os_cmd_rwatch_del(sourceinfo_t *si, int parc, char *parv[])
 			free(rw->reason);
 			if (rw->re != NULL)
 				regex_destroy(rw->re);
+			free(rw->literal);
 			free(rw);
 			mowgli_node_delete(n, &rwatch_list);
 			mowgli_node_free(n);
+			rwatch_set_dirty = true;
 			command_success_nodata(si, _("Removed \2%s\2 from regex watch list."), pattern);
 			logcommand(si, CMDLOG_ADMIN, "RWATCH:DEL: \2%s\2", pattern);
 			return;
@@ -494,6 +519,7 @@ static void os_cmd_rwatch_set(sourceinfo_t *si, int parc, char *parv[])
 			}
 			rw->actions |= addflags;
 			rw->actions &= ~removeflags;
+			rwatch_set_dirty = true;
 			command_success_nodata(si, _("Set options \2%s\2 on \2%s\2."), opts, pattern);
 
 			if (addflags & RWACT_KLINE)
@@ -514,11 +540,265 @@ static void os_cmd_rwatch_set(sourceinfo_t *si, int parc, char *parv[])
 	command_fail(si, fault_nosuch_target, _("\2%s\2 not found in regex watch list."), pattern);
 }
 
+static const char *rwatch_skip_class(const char *p, bool pcre)
+{
+	/* p points at the opening '[' */
+	p++;
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+
+	for (; *p != '\0'; p++)
+	{
+		if (*p == ']')
+			return p;
+
+		if (pcre && *p == '\\')
+		{
+			if (*++p == '\0')
+				return NULL;
+		}
+		else if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '='))
+		{
+			const char term = p[1];
+
+			for (p += 2; *p != '\0' && !(p[0] == term && p[1] == ']'); p++)
+				;
+			if (*p == '\0')
+				return NULL;
+			p++;
+		}
+	}
+
+	return NULL;
+}
+
+static void rwatch_literal_flush(char *run, size_t *runlen, char *best, size_t *bestlen)
+{
+	if (*runlen > *bestlen)
+	{
+		memcpy(best, run, *runlen);
+		*bestlen = *runlen;
+	}
+	*runlen = 0;
+}
+
+/*
+ * rwatch_literal(const char *pattern, int reflags)
+ *
+ * Finds the longest run of literal characters that any string matching
+ * the pattern must contain. This is deliberately conservative: runs are
+ * only taken from the top level of the pattern, a character followed by
+ * a quantifier that allows zero repetitions is dropped, and patterns with
+ * top-level alternation, backreferences or PCRE inline options yield none.
+ *
+ * Inputs:
+ *      - regex pattern and AREGEX_* flags
+ *
+ * Outputs:
+ *      - newly allocated literal, lowercased for AREGEX_ICASE, or NULL
+ *
+ * Side Effects:
+ *      - none
+ */
+static char *rwatch_literal(const char *pattern, int reflags)
+{
+	char run[BUFSIZE], best[BUFSIZE];
+	size_t runlen = 0, bestlen = 0;
+	unsigned int depth = 0;
+	bool lastchar = false;
+	bool pcre = (reflags & AREGEX_PCRE) != 0;
+	bool icase = (reflags & AREGEX_ICASE) != 0;
+	const char *p;
+	char c, q;
+
+	if (strlen(pattern) >= BUFSIZE)
+		return NULL;
+
+	for (p = pattern; *p != '\0'; p++)
+	{
+		c = *p;
+
+		switch (c)
+		{
+		case '\\':
+			c = *++p;
+			if (c == '\0')
+				return NULL;
+			if (isalnum((unsigned char)c))
+			{
+				/* character types and assertions; anything else may take arguments */
+				if (strchr("dDwWsSbBhHvVRAzZGntrfea", c) == NULL)
+					return NULL;
+				rwatch_literal_flush(run, &runlen, best, &bestlen);
+				lastchar = false;
+				continue;
+			}
+			break;
+		case '[':
+			p = rwatch_skip_class(p, pcre);
+			if (p == NULL)
+				return NULL;
+			rwatch_literal_flush(run, &runlen, best, &bestlen);
+			lastchar = false;
+			continue;
+		case '(':
+			if (pcre && p[1] == '?')
+				return NULL;
+			depth++;
+			rwatch_literal_flush(run, &runlen, best, &bestlen);
+			lastchar = false;
+			continue;
+		case ')':
+			if (depth == 0)
+				return NULL;
+			depth--;
+			rwatch_literal_flush(run, &runlen, best, &bestlen);
+			lastchar = false;
+			continue;
+		case '|':
+			if (depth == 0)
+				return NULL;
+			continue;
+		case '*':
+		case '?':
+		case '+':
+		case '{':
+			q = c;
+			if (q == '{')
+			{
+				/* only {n}, {n,} and {n,m} are intervals; PCRE takes other braces literally */
+				if (!isdigit((unsigned char)p[1]))
+					return NULL;
+				for (p++; isdigit((unsigned char)*p) || *p == ','; p++)
+					;
+				if (*p != '}')
+					return NULL;
+			}
+			/* the quantified character may occur zero times */
+			if (lastchar && q != '+')
+				runlen--;
+			rwatch_literal_flush(run, &runlen, best, &bestlen);
+			lastchar = false;
+			continue;
+		case '.':
+		case '^':
+		case '$':
+			rwatch_literal_flush(run, &runlen, best, &bestlen);
+			lastchar = false;
+			continue;
+		}
+
+		if (depth > 0 || (icase && (unsigned char)c >= 0x80))
+		{
+			rwatch_literal_flush(run, &runlen, best, &bestlen);
+			lastchar = false;
+			continue;
+		}
+
+		run[runlen++] = icase ? tolower((unsigned char)c) : c;
+		lastchar = true;
+	}
+
+	rwatch_literal_flush(run, &runlen, best, &bestlen);
+	if (bestlen == 0)
+		return NULL;
+
+	best[bestlen] = '\0';
+	return sstrdup(best);
+}
+
+static void rwatch_compile(void)
+{
+	mowgli_node_t *n;
+	size_t withliteral = 0;
+
+	free(rwatch_set);
+	free(rwatch_hits);
+	rwatch_set = smalloc(sizeof(rwatch_t *) * (MOWGLI_LIST_LENGTH(&rwatch_list) + 1));
+	rwatch_hits = smalloc(sizeof(rwatch_t *) * (MOWGLI_LIST_LENGTH(&rwatch_list) + 1));
+	rwatch_set_count = 0;
+	rwatch_set_icase = false;
+
+	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
+	{
+		rwatch_t *rw = n->data;
+
+		if (rw->re == NULL)
+			continue;
+
+		free(rw->literal);
+		rw->literal = rwatch_literal(rw->regex, rw->reflags);
+		if (rw->literal != NULL)
+		{
+			withliteral++;
+			if (rw->reflags & AREGEX_ICASE)
+				rwatch_set_icase = true;
+		}
+
+		rwatch_set[rwatch_set_count++] = rw;
+	}
+
+	rwatch_set_dirty = false;
+	slog(LG_DEBUG, "rwatch_compile(): %zu entries, %zu with a required literal", rwatch_set_count, withliteral);
+}
+
+/*
+ * rwatch_match(const char *usermask, size_t len)
+ *
+ * Runs the compiled rwatch set against a user mask, skipping the regex
+ * of any entry whose required literal is absent.
+ *
+ * Inputs:
+ *      - nick!user@host gecos mask and its length
+ *
+ * Outputs:
+ *      - number of matching entries, which are stored in rwatch_hits
+ *        in list order
+ *
+ * Side Effects:
+ *      - recompiles the set if it has changed
+ */
+static size_t rwatch_match(const char *usermask, size_t len)
+{
+	char lowered[NICKLEN+USERLEN+HOSTLEN+GECOSLEN];
+	size_t i, hits = 0;
+
+	if (rwatch_set_dirty)
+		rwatch_compile();
+
+	if (rwatch_set_icase)
+	{
+		if (len >= sizeof lowered)
+			len = sizeof lowered - 1;
+		for (i = 0; i < len; i++)
+			lowered[i] = tolower((unsigned char)usermask[i]);
+		lowered[len] = '\0';
+	}
+
+	for (i = 0; i < rwatch_set_count; i++)
+	{
+		rwatch_t *rw = rwatch_set[i];
+
+		if (rw->literal != NULL && strstr(rw->reflags & AREGEX_ICASE ? lowered : usermask, rw->literal) == NULL)
+			continue;
+
+		if (regex_match_len(rw->re, usermask, len))
+		{
+			rwatch_hits[hits++] = rw;
+			slog(LG_DEBUG, "rwatch_match(): \2%s\2 matches entry %zu \2%s\2", usermask, i + 1, rw->regex);
+		}
+	}
+
+	return hits;
+}
+
 static void rwatch_newuser(hook_user_nick_t *data)
 {
 	user_t *u = data->u;
 	char usermask[NICKLEN+USERLEN+HOSTLEN+GECOSLEN];
-	mowgli_node_t *n;
+	size_t len, hits, i;
 	rwatch_t *rw;
 	kline_t *k;
 
@@ -529,51 +809,49 @@ static void rwatch_newuser(hook_user_nick_t *data)
 	if (is_internal_client(u))
 		return;
 
-	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
+	len = snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
+	if (len >= sizeof usermask)
+		len = sizeof usermask - 1;
 
-	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
+	hits = rwatch_match(usermask, len);
+	for (i = 0; i < hits; i++)
 	{
-		rw = n->data;
-		if (!rw->re)
-			continue;
-		if (regex_match(rw->re, usermask))
+		rw = rwatch_hits[i];
+		if (rw->actions & RWACT_SNOOP)
 		{
-			if (rw->actions & RWACT_SNOOP)
-			{
-				slog(LG_INFO, "RWATCH:MATCH:%s \2%s\2 matches \2%s\2 (reason: \2%s\2)",
-						rw->actions & RWACT_KLINE ? "AKILL:" : "",
-						usermask, rw->regex, rw->reason);
-			}
-			if (rw->actions & RWACT_KLINE)
+			slog(LG_INFO, "RWATCH:MATCH:%s \2%s\2 matches \2%s\2 (reason: \2%s\2)",
+					rw->actions & RWACT_KLINE ? "AKILL:" : "",
+					usermask, rw->regex, rw->reason);
+		}
+		if (rw->actions & RWACT_KLINE)
+		{
+			if (is_autokline_exempt(u))
+				slog(LG_INFO, "RWATCH:MATCH:EXEMPT - Not AKILLing *@%s (user %s!%s@%s is AKILL Exempt but matches %s %s)",
+						u->host, u->nick, u->user, u->host,
+						rw->regex, rw->reason);
+			else
 			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "RWATCH:MATCH:EXEMPT - Not AKILLing *@%s (user %s!%s@%s is AKILL Exempt but matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "RWATCH:MATCH: AKILLing *@%s (user %s!%s@%s matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					if (! (u->flags & UF_KLINESENT)) {
-						k = kline_add("*", u->ip, rw->reason, 86400, "RWATCH");
-						u->flags |= UF_KLINESENT;
-					}
+				slog(LG_VERBOSE, "RWATCH:MATCH: AKILLing *@%s (user %s!%s@%s matches %s %s)",
+						u->host, u->nick, u->user, u->host,
+						rw->regex, rw->reason);
+				if (! (u->flags & UF_KLINESENT)) {
+					k = kline_add("*", u->ip, rw->reason, 86400, "RWATCH");
+					u->flags |= UF_KLINESENT;
 				}
 			}
-			else if (rw->actions & RWACT_QUARANTINE)
+		}
+		else if (rw->actions & RWACT_QUARANTINE)
+		{
+			if (is_autokline_exempt(u))
+				slog(LG_INFO, "RWATCH:MATCH:EXEMPT - Not qurantining *@%s (user %s!%s@%s is AKILL Exempt but matches %s %s)",
+						u->host, u->nick, u->user, u->host,
+						rw->regex, rw->reason);
+			else
 			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "RWATCH:MATCH:EXEMPT - Not qurantining *@%s (user %s!%s@%s is AKILL Exempt but matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "RWATCH:MATCH: Quaranting *@%s (user %s!%s@%s matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					quarantine_sts(service_find("operserv")->me, u, 86400, rw->reason);
-				}
+				slog(LG_VERBOSE, "RWATCH:MATCH: Quaranting *@%s (user %s!%s@%s matches %s %s)",
+						u->host, u->nick, u->user, u->host,
+						rw->regex, rw->reason);
+				quarantine_sts(service_find("operserv")->me, u, 86400, rw->reason);
 			}
 		}
 	}
@@ -584,7 +862,7 @@ static void rwatch_nickchange(hook_user_nick_t *data)
 	user_t *u = data->u;
 	char usermask[NICKLEN+USERLEN+HOSTLEN+GECOSLEN];
 	char oldusermask[NICKLEN+USERLEN+HOSTLEN+GECOSLEN];
-	mowgli_node_t *n;
+	size_t len, oldlen, hits, i;
 	rwatch_t *rw;
 
 	/* If the user has been killed, don't do anything. */
@@ -594,55 +872,55 @@ static void rwatch_nickchange(hook_user_nick_t *data)
 	if (is_internal_client(u))
 		return;
 
-	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
-	snprintf(oldusermask, sizeof oldusermask, "%s!%s@%s %s", data->oldnick, u->user, u->host, u->gecos);
+	len = snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
+	if (len >= sizeof usermask)
+		len = sizeof usermask - 1;
+	oldlen = snprintf(oldusermask, sizeof oldusermask, "%s!%s@%s %s", data->oldnick, u->user, u->host, u->gecos);
+	if (oldlen >= sizeof oldusermask)
+		oldlen = sizeof oldusermask - 1;
 
-	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
+	hits = rwatch_match(usermask, len);
+	for (i = 0; i < hits; i++)
 	{
-		rw = n->data;
-		if (!rw->re)
+		rw = rwatch_hits[i];
+		/* Only process if they did not match before. */
+		if (regex_match_len(rw->re, oldusermask, oldlen))
 			continue;
-		if (regex_match(rw->re, usermask))
+		if (rw->actions & RWACT_SNOOP)
 		{
-			/* Only process if they did not match before. */
-			if (regex_match(rw->re, oldusermask))
-				continue;
-			if (rw->actions & RWACT_SNOOP)
-			{
-				slog(LG_INFO, "RWATCH:MATCH:NICKCHANGE:%s \2%s\2 -> \2%s\2 matches \2%s\2 (reason: \2%s\2)",
-						rw->actions & RWACT_KLINE ? "AKILL:" : "",
-						data->oldnick, usermask, rw->regex, rw->reason);
-			}
-			if (rw->actions & RWACT_KLINE)
+			slog(LG_INFO, "RWATCH:MATCH:NICKCHANGE:%s \2%s\2 -> \2%s\2 matches \2%s\2 (reason: \2%s\2)",
+					rw->actions & RWACT_KLINE ? "AKILL:" : "",
+					data->oldnick, usermask, rw->regex, rw->reason);
+		}
+		if (rw->actions & RWACT_KLINE)
+		{
+			if (is_autokline_exempt(u))
+				slog(LG_INFO, "RWATCH:MATCH:NICKCHANGE:EXEMPT - Not AKILLing *@%s (user %s -> %s!%s@%s is AKILL Exempt but matches %s %s)",
+						u->host, data->oldnick, u->nick, u->user, u->host,
+						rw->regex, rw->reason);
+			else
 			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "RWATCH:MATCH:NICKCHANGE:EXEMPT - Not AKILLing *@%s (user %s -> %s!%s@%s is AKILL Exempt but matches %s %s)",
-							u->host, data->oldnick, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "RWATCH:MATCH:NICKCHANGE: AKILLing *@%s (user %s -> %s!%s@%s matches %s %s)",
-							u->host, data->oldnick, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					if (! (u->flags & UF_KLINESENT)) {
-						kline_sts("*", "*", u->host, 86400, rw->reason);
-						u->flags |= UF_KLINESENT;
-					}
+				slog(LG_VERBOSE, "RWATCH:MATCH:NICKCHANGE: AKILLing *@%s (user %s -> %s!%s@%s matches %s %s)",
+						u->host, data->oldnick, u->nick, u->user, u->host,
+						rw->regex, rw->reason);
+				if (! (u->flags & UF_KLINESENT)) {
+					kline_sts("*", "*", u->host, 86400, rw->reason);
+					u->flags |= UF_KLINESENT;
 				}
 			}
-			else if (rw->actions & RWACT_QUARANTINE)
+		}
+		else if (rw->actions & RWACT_QUARANTINE)
+		{
+			if (is_autokline_exempt(u))
+				slog(LG_INFO, "RWATCH:MATCH:EXEMPT - Not qurantining *@%s (user %s!%s@%s is AKILL Exempt but matches %s %s)",
+						u->host, u->nick, u->user, u->host,
+						rw->regex, rw->reason);
+			else
 			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "RWATCH:MATCH:EXEMPT - Not qurantining *@%s (user %s!%s@%s is AKILL Exempt but matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "RWATCH:MATCH: Quaranting *@%s (user %s!%s@%s matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					quarantine_sts(service_find("operserv")->me, u, 86400, rw->reason);
-				}
+				slog(LG_VERBOSE, "RWATCH:MATCH: Quaranting *@%s (user %s!%s@%s matches %s %s)",
+						u->host, u->nick, u->user, u->host,
+						rw->regex, rw->reason);
+				quarantine_sts(service_find("operserv")->me, u, 86400, rw->reason);
 			}
 		}
 	}
@@ -177,6 +177,7 @@ static void m_nick(sourceinfo_t *si, int parc, char *parv[])
 				{
 					strshare_unref(u->vhost);
 					u->vhost = strshare_get(parv[5 + i]);
+					user_mask_changed(u);
 				}
 				else
 				{
@@ -192,6 +193,7 @@ static void m_nick(sourceinfo_t *si, int parc, char *parv[])
 
 					strshare_unref(u->user);
 					u->user = strshare_get(userbuf);
+					user_mask_changed(u);
 				}
 				i++;
 			}
@@ -262,6 +264,7 @@ static void m_mode(sourceinfo_t *si, int parc, char *parv[])
 				{
 					strshare_unref(u->vhost);
 					u->vhost = strshare_get(parv[2]);
+					user_mask_changed(u);
 				}
 				else
 				{
@@ -278,6 +281,7 @@ static void m_mode(sourceinfo_t *si, int parc, char *parv[])
 
 					strshare_unref(u->user);
 					u->user = strshare_get(userbuf);
+					user_mask_changed(u);
 				}
 				slog(LG_DEBUG, "m_mode(): user %s setting vhost %s@%s", u->nick, u->user, u->vhost);
 			}
@@ -289,6 +293,7 @@ static void m_mode(sourceinfo_t *si, int parc, char *parv[])
 
 				strshare_unref(u->vhost);
 				u->vhost = strshare_get(u->host);
+				user_mask_changed(u);
 
 				/* revert to +x vhost if applicable */
 				check_hidehost(u);
@@ -325,6 +330,7 @@ static void check_hidehost(user_t *u)
 
 	strshare_unref(u->vhost);
 	u->vhost = strshare_get(buf);
+	user_mask_changed(u);
 
 	slog(LG_DEBUG, "check_hidehost(): %s -> %s", u->nick, u->vhost);
 }
@@ -184,19 +184,19 @@ static mowgli_node_t *chatircd_next_matching_ban(channel_t *c, user_t *u, int ty
 {
 	chanban_t *cb;
 	mowgli_node_t *n;
-	char hostbuf[NICKLEN+USERLEN+HOSTLEN];
-	char realbuf[NICKLEN+USERLEN+HOSTLEN];
-	char ipbuf[NICKLEN+USERLEN+HOSTLEN];
+	const char *hostbuf;
+	const char *realbuf;
+	const char *ipbuf;
 	char strippedmask[NICKLEN+USERLEN+HOSTLEN+CHANNELLEN+2];
 	char *p;
 	bool negate, matched;
 	int exttype;
 	channel_t *target_c;
 
-	snprintf(hostbuf, sizeof hostbuf, "%s!%s@%s", u->nick, u->user, u->vhost);
-	snprintf(realbuf, sizeof realbuf, "%s!%s@%s", u->nick, u->user, u->host);
+	hostbuf = user_get_mask(u, USER_MASK_VHOST);
+	realbuf = user_get_mask(u, USER_MASK_HOST);
 	/* will be nick!user@ if ip unknown, doesn't matter */
-	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
+	ipbuf = user_get_mask(u, USER_MASK_IP);
 
 	MOWGLI_ITER_FOREACH(n, first)
 	{
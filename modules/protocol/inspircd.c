@@ -122,15 +122,15 @@ static mowgli_node_t *inspircd_next_matching_ban(channel_t *c, user_t *u, int ty
 {
 	chanban_t *cb;
 	mowgli_node_t *n;
-	char hostbuf[NICKLEN+USERLEN+HOSTLEN];
-	char realbuf[NICKLEN+USERLEN+HOSTLEN];
-	char ipbuf[NICKLEN+USERLEN+HOSTLEN];
+	const char *hostbuf;
+	const char *realbuf;
+	const char *ipbuf;
 	char *p;
 
-	snprintf(hostbuf, sizeof hostbuf, "%s!%s@%s", u->nick, u->user, u->vhost);
-	snprintf(realbuf, sizeof realbuf, "%s!%s@%s", u->nick, u->user, u->host);
+	hostbuf = user_get_mask(u, USER_MASK_VHOST);
+	realbuf = user_get_mask(u, USER_MASK_HOST);
 	/* will be nick!user@ if ip unknown, doesn't matter */
-	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
+	ipbuf = user_get_mask(u, USER_MASK_IP);
 
 	MOWGLI_ITER_FOREACH(n, first)
 	{
@@ -1110,6 +1110,7 @@ static void inspircd_user_mode(user_t *u, const char *modes)
 					{
 						strshare_unref(u->chost);
 						u->chost = strshare_get(u->vhost);
+						user_mask_changed(u);
 					}
 				}
 				break;
@@ -1331,12 +1332,14 @@ static void m_fident(sourceinfo_t *si, int parc, char *parv[])
 {
 	strshare_unref(si->su->user);
 	si->su->user = strshare_get(parv[0]);
+	user_mask_changed(si->su);
 }
 
 static void m_fhost(sourceinfo_t *si, int parc, char *parv[])
 {
 	strshare_unref(si->su->vhost);
 	si->su->vhost = strshare_get(parv[0]);
+	user_mask_changed(si->su);
 }
 
 static void m_encap(sourceinfo_t *si, int parc, char *parv[])
@@ -176,6 +176,7 @@ static bool nefarious_on_logout(user_t *u, const char *account)
 
 		strshare_unref(u->vhost);
 		u->vhost = strshare_get(u->host);
+		user_mask_changed(u);
 	}
 
 	return false;
@@ -395,6 +396,7 @@ static void m_nick(sourceinfo_t *si, int parc, char *parv[])
 				{
 					strshare_unref(u->vhost);
 					u->vhost = strshare_get(parv[5 + i]);
+					user_mask_changed(u);
 				}
 				else
 				{
@@ -411,6 +413,7 @@ static void m_nick(sourceinfo_t *si, int parc, char *parv[])
 
 					strshare_unref(u->user);
 					u->user = strshare_get(userbuf);
+					user_mask_changed(u);
 				}
 				i++;
 			}
@@ -418,6 +421,7 @@ static void m_nick(sourceinfo_t *si, int parc, char *parv[])
 			{
 				strshare_unref(u->vhost);
 				u->vhost = strshare_get(parv[5 + i]);
+				user_mask_changed(u);
 
 				i++;
 			}
@@ -488,6 +492,7 @@ static void m_mode(sourceinfo_t *si, int parc, char *parv[])
 				{
 					strshare_unref(u->vhost);
 					u->vhost = strshare_get(parv[2]);
+					user_mask_changed(u);
 				}
 				else
 				{
@@ -503,6 +508,7 @@ static void m_mode(sourceinfo_t *si, int parc, char *parv[])
 
 					strshare_unref(u->user);
 					u->user = strshare_get(userbuf);
+					user_mask_changed(u);
 				}
 				slog(LG_DEBUG, "m_mode(): user %s setting vhost %s@%s", u->nick, u->user, u->vhost);
 			}
@@ -514,6 +520,7 @@ static void m_mode(sourceinfo_t *si, int parc, char *parv[])
 
 				strshare_unref(u->vhost);
 				u->vhost = strshare_get(u->host);
+				user_mask_changed(u);
 
 				/* revert to +x vhost if applicable */
 				check_hidehost(u);
@@ -693,6 +700,7 @@ static void check_hidehost(user_t *u)
 
 	strshare_unref(u->vhost);
 	u->vhost = strshare_get(buf);
+	user_mask_changed(u);
 
 	slog(LG_DEBUG, "check_hidehost(): %s -> %s", u->nick, u->vhost);
 }
@@ -1276,6 +1276,7 @@ static void m_encap(sourceinfo_t *si, int parc, char *parv[])
 
 		strshare_unref(u->host);
 		u->host = strshare_get(parv[2]);
+		user_mask_changed(u);
 	}
 	else if (!irccasecmp(parv[1], "CHGHOST"))
 	{
@@ -1287,6 +1288,7 @@ static void m_encap(sourceinfo_t *si, int parc, char *parv[])
 
 		strshare_unref(u->vhost);
 		u->vhost = strshare_get(parv[3]);
+		user_mask_changed(u);
 
 		slog(LG_DEBUG, "m_encap(): chghost %s -> %s", u->nick,
 				u->vhost);
@@ -1364,6 +1366,7 @@ static void m_signon(sourceinfo_t *si, int parc, char *parv[])
 	/* HOST */
 	strshare_unref(u->vhost);
 	u->vhost = strshare_get(parv[2]);
+	user_mask_changed(u);
 
 	/* LOGIN */
 	if(*parv[4] == '*') /* explicitly unchanged */
@@ -1428,6 +1431,7 @@ static void m_chghost(sourceinfo_t *si, int parc, char *parv[])
 
 	strshare_unref(u->vhost);
 	u->vhost = strshare_get(parv[1]);
+	user_mask_changed(u);
 }
 
 static void m_motd(sourceinfo_t *si, int parc, char *parv[])
@@ -252,18 +252,18 @@ static mowgli_node_t *unreal_next_matching_ban(channel_t *c, user_t *u, int type
 {
 	chanban_t *cb;
 	mowgli_node_t *n;
-	char hostbuf[NICKLEN+USERLEN+HOSTLEN];
-	char realbuf[NICKLEN+USERLEN+HOSTLEN];
-	char ipbuf[NICKLEN+USERLEN+HOSTLEN];
+	const char *hostbuf;
+	const char *realbuf;
+	const char *ipbuf;
 	char *p;
 	bool matched;
 	int exttype;
 	channel_t *target_c;
 
-	snprintf(hostbuf, sizeof hostbuf, "%s!%s@%s", u->nick, u->user, u->vhost);
-	snprintf(realbuf, sizeof realbuf, "%s!%s@%s", u->nick, u->user, u->host);
+	hostbuf = user_get_mask(u, USER_MASK_VHOST);
+	realbuf = user_get_mask(u, USER_MASK_HOST);
 	/* will be nick!user@ if ip unknown, doesn't matter */
-	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
+	ipbuf = user_get_mask(u, USER_MASK_IP);
 
 	MOWGLI_ITER_FOREACH(n, first)
 	{
@@ -1244,12 +1244,14 @@ static void unreal_user_mode(user_t *u, const char *changes)
 					{
 						strshare_unref(u->chost);
 						u->chost = strshare_get(u->vhost);
+						user_mask_changed(u);
 					}
 				}
 				else if (dir == MTYPE_DEL)
 				{
 					strshare_unref(u->vhost);
 					u->vhost = strshare_get(u->host);
+					user_mask_changed(u);
 				}
 				break;
 		}
@@ -1462,6 +1464,7 @@ static void m_sethost(sourceinfo_t *si, int parc, char *parv[])
 {
 	strshare_unref(si->su->vhost);
 	si->su->vhost = strshare_get(parv[0]);
+	user_mask_changed(si->su);
 }
 
 static void m_chghost(sourceinfo_t *si, int parc, char *parv[])
@@ -1473,6 +1476,7 @@ static void m_chghost(sourceinfo_t *si, int parc, char *parv[])
 
 	strshare_unref(u->vhost);
 	u->vhost = strshare_get(parv[1]);
+	user_mask_changed(u);
 }
 
 static void m_motd(sourceinfo_t *si, int parc, char *parv[])
@@ -16,7 +16,23 @@ DECLARE_MODULE_V1
 	VENDOR_STRING
 );
 
+/* sessions expire this long after they last made progress */
+#define SASL_SESSION_TIMEOUT	45
+#define SASL_EXPIRE_INTERVAL	15
+
+/* a registered mechanism, with its share of the sessions */
+typedef struct {
+	sasl_mechanism_t *mech;
+	unsigned int in_flight;
+	unsigned int started;
+	mowgli_node_t node;
+} sasl_mech_entry_t;
+
 mowgli_list_t sessions;
+static mowgli_patricia_t *sessions_by_uid;
+static sasl_session_t **expiry_heap;	/* min-heap on expires */
+static size_t expiry_len, expiry_size;
+static unsigned int sessions_peak, sessions_expired;
 static mowgli_list_t sasl_mechanisms;
 static char mechlist_string[400];
 static bool hide_server_names;
@@ -27,6 +43,8 @@ void destroy_session(sasl_session_t *p);
 static sourceinfo_t *sasl_sourceinfo_create(sasl_session_t *p);
 static void sasl_input(sasl_message_t *smsg);
 static void sasl_packet(sasl_session_t *p, char *buf, int len);
+static void sasl_packet_result(sasl_session_t *p, int rc, char *out, size_t out_len);
+static void sasl_mech_step_done(sasl_session_t *p, int rc);
 static void sasl_write(char *target, char *data, int length);
 static bool may_impersonate(myuser_t *source_mu, myuser_t *target_mu);
 static myuser_t *login_user(sasl_session_t *p);
@@ -39,8 +57,9 @@ static void mechlist_build_string(char *ptr, size_t buflen);
 static void mechlist_do_rebuild();
 static const char *sasl_format_sourceinfo(sourceinfo_t *si, bool full);
 static const char *sasl_get_source_name(sourceinfo_t *si);
+static void osinfo_hook(sourceinfo_t *si);
 
-sasl_mech_register_func_t sasl_mech_register_funcs = { &sasl_mech_register, &sasl_mech_unregister };
+sasl_mech_register_func_t sasl_mech_register_funcs = { &sasl_mech_register, &sasl_mech_unregister, &sasl_mech_step_done };
 
 /* main services client routine */
 static void saslserv(sourceinfo_t *si, int parc, char *parv[])
@@ -79,14 +98,30 @@ static void saslserv(sourceinfo_t *si, int parc, char *parv[])
 service_t *saslsvs = NULL;
 mowgli_eventloop_timer_t *delete_stale_timer = NULL;
 
+static sasl_mech_entry_t *find_mech_entry(sasl_mechanism_t *mech)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, sasl_mechanisms.head)
+	{
+		sasl_mech_entry_t *entry = n->data;
+
+		if (entry->mech == mech)
+			return entry;
+	}
+
+	return NULL;
+}
+
 static void sasl_mech_register(sasl_mechanism_t *mech)
 {
-	mowgli_node_t *node;
+	sasl_mech_entry_t *entry;
 
 	slog(LG_DEBUG, "sasl_mech_register(): registering %s", mech->name);
 
-	node = mowgli_node_create();
-	mowgli_node_add(mech, node, &sasl_mechanisms);
+	entry = scalloc(sizeof(sasl_mech_entry_t), 1);
+	entry->mech = mech;
+	mowgli_node_add(entry, &entry->node, &sasl_mechanisms);
 
 	mechlist_do_rebuild();
 }
@@ -110,10 +145,12 @@ static void sasl_mech_unregister(sasl_mechanism_t *mech)
 
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, sasl_mechanisms.head)
 	{
-		if (n->data == mech)
+		sasl_mech_entry_t *entry = n->data;
+
+		if (entry->mech == mech)
 		{
-			mowgli_node_delete(n, &sasl_mechanisms);
-			mowgli_node_free(n);
+			mowgli_node_delete(&entry->node, &sasl_mechanisms);
+			free(entry);
 
 			mechlist_do_rebuild();
 			break;
@@ -131,8 +168,12 @@ void _modinit(module_t *m)
 	hook_add_server_eob(sasl_server_eob);
 	hook_add_event("sasl_may_impersonate");
 	hook_add_event("user_can_login");
+	hook_add_event("operserv_info");
+	hook_add_operserv_info(osinfo_hook);
+
+	sessions_by_uid = mowgli_patricia_create(noopcanon);
 
-	delete_stale_timer = mowgli_timer_add(base_eventloop, "sasl_delete_stale", delete_stale, NULL, 30);
+	delete_stale_timer = mowgli_timer_add(base_eventloop, "sasl_delete_stale", delete_stale, NULL, SASL_EXPIRE_INTERVAL);
 
 	saslsvs = service_add("saslserv", saslserv);
 	add_bool_conf_item("HIDE_SERVER_NAMES", &saslsvs->conf_table, 0, &hide_server_names, false);
@@ -146,6 +187,7 @@ void _moddeinit(module_unload_intent_t intent)
 	hook_del_sasl_input(sasl_input);
 	hook_del_user_add(sasl_newuser);
 	hook_del_server_eob(sasl_server_eob);
+	hook_del_operserv_info(osinfo_hook);
 
 	mowgli_timer_destroy(base_eventloop, delete_stale_timer);
 
@@ -163,36 +205,106 @@ void _moddeinit(module_unload_intent_t intent)
 	{
 		destroy_session(n->data);
 	}
+
+	mowgli_patricia_destroy(sessions_by_uid, NULL, NULL);
+	free(expiry_heap);
+	expiry_heap = NULL;
+	expiry_len = expiry_size = 0;
 }
 
 /*
  * Begin SASL-specific code
  */
 
-/* find an existing session by uid */
-sasl_session_t *find_session(const char *uid)
+/*
+ * Sessions expire from a min-heap on their deadline, so the timer only
+ * ever looks at the ones that are actually due.
+ */
+static void expiry_set(size_t i, sasl_session_t *p)
 {
-	sasl_session_t *p;
-	mowgli_node_t *n;
+	expiry_heap[i] = p;
+	p->expiry_index = i;
+}
 
-	if (uid == NULL)
-		return NULL;
+static void expiry_sift_up(size_t i)
+{
+	sasl_session_t *p = expiry_heap[i];
 
-	MOWGLI_ITER_FOREACH(n, sessions.head)
+	while (i > 0 && expiry_heap[(i - 1) / 2]->expires > p->expires)
 	{
-		p = n->data;
-		if(p->uid != NULL && !strcmp(p->uid, uid))
-			return p;
+		expiry_set(i, expiry_heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
 	}
 
-	return NULL;
+	expiry_set(i, p);
+}
+
+static void expiry_sift_down(size_t i)
+{
+	sasl_session_t *p = expiry_heap[i];
+	size_t c;
+
+	while ((c = 2 * i + 1) < expiry_len)
+	{
+		if (c + 1 < expiry_len && expiry_heap[c + 1]->expires < expiry_heap[c]->expires)
+			c++;
+		if (expiry_heap[c]->expires >= p->expires)
+			break;
+
+		expiry_set(i, expiry_heap[c]);
+		i = c;
+	}
+
+	expiry_set(i, p);
+}
+
+static void expiry_add(sasl_session_t *p)
+{
+	if (expiry_len == expiry_size)
+	{
+		expiry_size = expiry_size ? expiry_size * 2 : 64;
+		expiry_heap = srealloc(expiry_heap, expiry_size * sizeof *expiry_heap);
+	}
+
+	p->expires = CURRTIME + SASL_SESSION_TIMEOUT;
+	expiry_set(expiry_len++, p);
+	expiry_sift_up(expiry_len - 1);
+}
+
+static void expiry_delete(sasl_session_t *p)
+{
+	size_t i = p->expiry_index;
+
+	return_if_fail(i < expiry_len && expiry_heap[i] == p);
+
+	if (i != --expiry_len)
+	{
+		expiry_set(i, expiry_heap[expiry_len]);
+		expiry_sift_up(i);
+		expiry_sift_down(expiry_heap[i]->expiry_index);
+	}
+}
+
+/* some progress has been made, push the deadline back */
+static void session_touch(sasl_session_t *p)
+{
+	p->expires = CURRTIME + SASL_SESSION_TIMEOUT;
+	expiry_sift_down(p->expiry_index);
+}
+
+/* find an existing session by uid */
+sasl_session_t *find_session(const char *uid)
+{
+	if (uid == NULL)
+		return NULL;
+
+	return mowgli_patricia_retrieve(sessions_by_uid, uid);
 }
 
 /* create a new session if it does not already exist */
 sasl_session_t *make_session(const char *uid, server_t *server)
 {
 	sasl_session_t *p = find_session(uid);
-	mowgli_node_t *n;
 
 	if(p)
 		return p;
@@ -201,8 +313,12 @@ sasl_session_t *make_session(const char *uid, server_t *server)
 	memset(p, 0, sizeof(sasl_session_t));
 	p->uid = sstrdup(uid);
 	p->server = server;
-	n = mowgli_node_create();
-	mowgli_node_add(p, n, &sessions);
+	mowgli_node_add(p, &p->node, &sessions);
+	mowgli_patricia_add(sessions_by_uid, p->uid, p);
+	expiry_add(p);
+
+	if (MOWGLI_LIST_LENGTH(&sessions) > sessions_peak)
+		sessions_peak = MOWGLI_LIST_LENGTH(&sessions);
 
 	return p;
 }
@@ -210,7 +326,7 @@ sasl_session_t *make_session(const char *uid, server_t *server)
 /* free a session and all its contents */
 void destroy_session(sasl_session_t *p)
 {
-	mowgli_node_t *n, *tn;
+	sasl_mech_entry_t *entry;
 	myuser_t *mu;
 
 	if (p->flags & ASASL_NEED_LOG && p->username != NULL)
@@ -224,14 +340,12 @@ void destroy_session(sasl_session_t *p)
 		}
 	}
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, sessions.head)
-	{
-		if(n->data == p)
-		{
-			mowgli_node_delete(n, &sessions);
-			mowgli_node_free(n);
-		}
-	}
+	mowgli_node_delete(&p->node, &sessions);
+	mowgli_patricia_delete(sessions_by_uid, p->uid);
+	expiry_delete(p);
+
+	if (p->mechptr != NULL && (entry = find_mech_entry(p->mechptr)) != NULL)
+		entry->in_flight--;
 
 	free(p->uid);
 	free(p->buf);
@@ -369,7 +483,7 @@ static sasl_mechanism_t *find_mechanism(char *name)
 
 	MOWGLI_ITER_FOREACH(n, sasl_mechanisms.head)
 	{
-		mptr = n->data;
+		mptr = ((sasl_mech_entry_t *) n->data)->mech;
 		if(!strcmp(mptr->name, name))
 			return mptr;
 	}
@@ -401,7 +515,7 @@ static void mechlist_build_string(char *ptr, size_t buflen)
 
 	MOWGLI_ITER_FOREACH(n, sasl_mechanisms.head)
 	{
-		sasl_mechanism_t *mptr = n->data;
+		sasl_mechanism_t *mptr = ((sasl_mech_entry_t *) n->data)->mech;
 		if(l + strlen(mptr->name) > buflen)
 			break;
 		strcpy(ptr, mptr->name);
@@ -422,11 +536,22 @@ static void sasl_packet(sasl_session_t *p, char *buf, int len)
 {
 	int rc;
 	size_t tlen = 0;
-	char *cloak, *out = NULL;
+	char *out = NULL;
 	char temp[BUFSIZE];
 	char mech[61];
 	size_t out_len = 0;
-	metadata_t *md;
+	sasl_mech_entry_t *entry;
+
+	/* The mechanism is still busy with the previous message (e.g.
+	 * verifying a password off the event loop); the client should
+	 * not be sending anything now.
+	 */
+	if(p->flags & ASASL_WAITING)
+	{
+		sasl_sts(p->uid, 'D', "F");
+		destroy_session(p);
+		return;
+	}
 
 	/* First piece of data in a session is the name of
 	 * the SASL mechanism that will be used.
@@ -452,6 +577,12 @@ static void sasl_packet(sasl_session_t *p, char *buf, int len)
 			return;
 		}
 
+		if ((entry = find_mech_entry(p->mechptr)) != NULL)
+		{
+			entry->in_flight++;
+			entry->started++;
+		}
+
 		rc = p->mechptr->mech_start(p, &out, &out_len);
 	}else{
 		if(len == 1 && *buf == '+')
@@ -465,7 +596,37 @@ static void sasl_packet(sasl_session_t *p, char *buf, int len)
 	}
 
 	/* Some progress has been made, reset timeout. */
-	p->flags &= ~ASASL_MARKED_FOR_DELETION;
+	session_touch(p);
+
+	if(rc == ASASL_WAIT)
+	{
+		p->flags |= ASASL_WAITING;
+		free(out);
+		return;
+	}
+
+	sasl_packet_result(p, rc, out, out_len);
+}
+
+/* called by a mechanism which returned ASASL_WAIT once it has a result */
+static void sasl_mech_step_done(sasl_session_t *p, int rc)
+{
+	return_if_fail(p != NULL);
+	return_if_fail(p->flags & ASASL_WAITING);
+	return_if_fail(rc != ASASL_WAIT);
+
+	p->flags &= ~ASASL_WAITING;
+	session_touch(p);
+
+	sasl_packet_result(p, rc, NULL, 0);
+}
+
+/* feed the result of a mechanism step back to the client */
+static void sasl_packet_result(sasl_session_t *p, int rc, char *out, size_t out_len)
+{
+	char *cloak;
+	char temp[BUFSIZE];
+	metadata_t *md;
 
 	if(rc == ASASL_DONE)
 	{
@@ -738,26 +899,35 @@ static void sasl_newuser(hook_user_nick_t *data)
 	logcommand_user(saslsvs, u, CMDLOG_LOGIN, "LOGIN (%s)", mptr->name);
 }
 
-/* This function is run approximately once every 30 seconds.
- * It looks for flagged sessions, and deletes them, while
- * flagging all the others. This way stale sessions are deleted
- * after no more than 60 seconds.
+/* This function is run every SASL_EXPIRE_INTERVAL seconds.
+ * It deletes the sessions which have made no progress for
+ * SASL_SESSION_TIMEOUT seconds, which sit at the top of the
+ * expiry heap.
  */
 static void delete_stale(void *vptr)
 {
-	sasl_session_t *p;
-	mowgli_node_t *n, *tn;
+	while (expiry_len > 0 && expiry_heap[0]->expires <= CURRTIME)
+	{
+		destroy_session(expiry_heap[0]);
+		sessions_expired++;
+	}
+}
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, sessions.head)
+static void osinfo_hook(sourceinfo_t *si)
+{
+	mowgli_node_t *n;
+
+	return_if_fail(si != NULL);
+
+	command_success_nodata(si, "SASL sessions in progress: %zu (peak %u, %u timed out)",
+			MOWGLI_LIST_LENGTH(&sessions), sessions_peak, sessions_expired);
+
+	MOWGLI_ITER_FOREACH(n, sasl_mechanisms.head)
 	{
-		p = n->data;
-		if(p->flags & ASASL_MARKED_FOR_DELETION)
-		{
-			mowgli_node_delete(n, &sessions);
-			destroy_session(p);
-			mowgli_node_free(n);
-		} else
-			p->flags |= ASASL_MARKED_FOR_DELETION;
+		sasl_mech_entry_t *entry = n->data;
+
+		command_success_nodata(si, "SASL %s exchanges in progress: %u (%u started)",
+				entry->mech->name, entry->in_flight, entry->started);
 	}
 }
 
@@ -19,6 +19,7 @@ sasl_mech_register_func_t *regfuncs;
 static int mech_start(sasl_session_t *p, char **out, size_t *out_len);
 static int mech_step(sasl_session_t *p, char *message, size_t len, char **out, size_t *out_len);
 static void mech_finish(sasl_session_t *p);
+static void mech_verify_done(myuser_t *mu, bool verified, void *priv);
 sasl_mechanism_t mech = {"PLAIN", &mech_start, &mech_step, &mech_finish};
 
 void _modinit(module_t *m)
@@ -89,11 +90,40 @@ static int mech_step(sasl_session_t *p, char *message, size_t len, char **out, s
 
 	p->username = sstrdup(authc);
 	p->authzid = sstrdup(authz);
-	return verify_password(mu, pass) ? ASASL_DONE : ASASL_FAIL;
+
+	/* Password hashing can be slow; let saslserv/main know later. */
+	p->mechdata = verify_password_async(mu, pass, mech_verify_done, p);
+
+	return p->mechdata != NULL ? ASASL_WAIT : ASASL_FAIL;
+}
+
+static void mech_verify_done(myuser_t *mu, bool verified, void *priv)
+{
+	sasl_session_t *p = priv;
+
+	p->mechdata = NULL;
+
+	/* SET NOPASSWORD may have happened while the password was being
+	   checked; as in mech_step(), fail without triggering bad_password().
+	   login_user() rechecks freezes and user_can_login itself. */
+	if (mu != NULL && (mu->flags & MU_NOPASSWORD))
+	{
+		free(p->username);
+		p->username = NULL;
+		regfuncs->mech_step_done(p, ASASL_FAIL);
+		return;
+	}
+
+	regfuncs->mech_step_done(p, verified ? ASASL_DONE : ASASL_FAIL);
 }
 
 static void mech_finish(sasl_session_t *p)
 {
+	/* session is going away while the password is being checked */
+	if (p->mechdata != NULL)
+		verify_password_cancel(p->mechdata);
+
+	p->mechdata = NULL;
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2014-2018 Xtheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Times loading an opensex database, to catch startup regressions as
+ * databases grow.  A database of a given size can be generated first;
+ * it is written by corestorage itself, so the rows are the real ones.
+ *
+ * usage: dbbench generate <accounts> <file>
+ *        dbbench load <file>
+ *
+ * Files are relative to DATADIR unless they contain a '/'.
+ */
+
+#include "atheme.h"
+#include "libathemecore.h"
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* db_open() wants a name relative to datadir */
+static const char *set_datadir(char *path)
+{
+	char *slash = strrchr(path, '/');
+
+	if (slash == NULL)
+		return path;
+
+	/* "/file" leaves an empty datadir, which still gives "/file" back */
+	*slash = '\0';
+	datadir = path;
+
+	return slash + 1;
+}
+
+static void generate(unsigned int accounts, const char *filename)
+{
+	myuser_t **mus;
+	mychan_t *mc;
+	char name[NICKLEN], buf[BUFSIZE];
+	unsigned int i, j, channels;
+	double start;
+
+	mus = smalloc(accounts * sizeof *mus);
+	channels = accounts / 10 > 0 ? accounts / 10 : 1;
+
+	srand(1);
+	start = now();
+
+	for (i = 0; i < accounts; i++)
+	{
+		snprintf(name, sizeof name, "bench%u", i);
+		snprintf(buf, sizeof buf, "bench%u@example%u.net", i, i % 97);
+
+		mus[i] = myuser_add(name, "$pbkdf2v2$*$N2I4MGE5OTE1NmI0$TmlPgxyqQCW7eDVnEEtcFeJzSGhAcMKe", buf, MU_CRYPTPASS);
+		mus[i]->registered = CURRTIME - rand() % (86400 * 365 * 5);
+		mus[i]->lastlogin = mus[i]->registered + rand() % 86400;
+
+		snprintf(buf, sizeof buf, "~bench%u@%u.%u.%u.%u", i, rand() % 256, rand() % 256, rand() % 256, rand() % 256);
+		metadata_add(mus[i], "private:host:actual", buf);
+		metadata_add(mus[i], "private:host:vhost", buf);
+
+		if (i % 2 == 0)
+		{
+			snprintf(name, sizeof name, "bench%u|away", i);
+			mynick_add(mus[i], name);
+		}
+	}
+
+	for (i = 0; i < channels; i++)
+	{
+		snprintf(name, sizeof name, "#bench%u", i);
+		mc = mychan_add(name);
+		mc->registered = CURRTIME - rand() % (86400 * 365 * 5);
+		mc->used = mc->registered + rand() % 86400;
+
+		chanacs_add(mc, entity(mus[i % accounts]), CA_FOUNDER_0, mc->registered, NULL);
+		for (j = 1; j <= 8; j++)
+			chanacs_add(mc, entity(mus[(i * 8 + j) % accounts]), j % 2 ? CA_AOP_DEF : CA_VOP_DEF, mc->registered, NULL);
+
+		metadata_add(mc, "private:topic:text", "Welcome to the benchmark channel");
+		metadata_add(mc, "private:topic:setter", entity(mus[i % accounts])->name);
+	}
+
+	printf("generated %u accounts, %u nicks, %u channels, %u access entries in %.3f s\n",
+			cnt.myuser, cnt.mynick, cnt.mychan, cnt.chanacs, now() - start);
+
+	start = now();
+	db_save((void *) filename, DB_SAVE_BLOCKING);
+	printf("wrote %s/%s in %.3f s\n", datadir, filename, now() - start);
+
+	free(mus);
+}
+
+static int load(const char *filename)
+{
+	database_handle_t *db;
+	double start, opened, parsed;
+	unsigned int rows;
+
+	start = now();
+
+	if ((db = db_open(filename, DB_READ)) == NULL)
+		return EXIT_FAILURE;
+
+	opened = now();
+
+	runflags &= ~RF_LIVE;
+	db_parse(db);
+	runflags |= RF_LIVE;
+
+	parsed = now();
+	rows = db->line;
+	db_close(db);
+
+	printf("%u rows: %u accounts, %u nicks, %u channels, %u access entries\n\n",
+			rows, cnt.myuser, cnt.mynick, cnt.mychan, cnt.chanacs);
+	printf("%-12s %8.3f s\n", "db_open", opened - start);
+	printf("%-12s %8.3f s %10.0f rows/s\n", "db_parse", parsed - opened,
+			parsed > opened ? rows / (parsed - opened) : 0);
+	printf("%-12s %8.3f s\n", "total", parsed - start);
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filename;
+	unsigned int accounts = 0;
+	bool gen;
+
+	gen = argc == 4 && !strcmp(argv[1], "generate");
+	if (gen)
+		accounts = strtoul(argv[2], NULL, 10);
+
+	if ((gen && accounts == 0) || (!gen && (argc != 3 || strcmp(argv[1], "load"))))
+	{
+		fprintf(stderr, "usage: %s generate <accounts> <file>\n", argv[0]);
+		fprintf(stderr, "       %s load <file>\n", argv[0]);
+		fprintf(stderr, "Files are relative to %s unless they contain a '/'.\n", DATADIR);
+		return EXIT_FAILURE;
+	}
+
+	atheme_bootstrap();
+	atheme_init(argv[0], LOGDIR "/dbbench.log");
+	atheme_setup();
+
+	runflags = RF_LIVE;
+	datadir = DATADIR;
+	strict_mode = false;
+	offline_mode = true;
+
+	filename = set_datadir(argv[argc - 1]);
+
+	if (module_load("backend/opensex") == NULL)
+		return EXIT_FAILURE;
+
+	if (gen)
+	{
+		generate(accounts, filename);
+		return EXIT_SUCCESS;
+	}
+
+	return load(filename);
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2014-2018 Xtheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Converts a database between the opensex and binary backends.  The
+ * format of the input is detected; the output is the other one.  Rows
+ * are copied as they are, so no other modules need to be loaded.
+ */
+
+#include "atheme.h"
+#include "libathemecore.h"
+
+/* see modules/backend/binary.c */
+#define BDB_MAGIC	"XTBDB\r\n\032"
+#define BDB_MAGICLEN	8
+
+static bool is_binary(const char *filename)
+{
+	char path[BUFSIZE], magic[BDB_MAGICLEN];
+	FILE *f;
+	bool res;
+
+	snprintf(path, sizeof path, "%s/%s", datadir, filename);
+	if ((f = fopen(path, "rb")) == NULL)
+	{
+		fprintf(stderr, "dbconvert: cannot open %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	res = fread(magic, sizeof magic, 1, f) == 1 && !memcmp(magic, BDB_MAGIC, BDB_MAGICLEN);
+	fclose(f);
+
+	return res;
+}
+
+/* numbers go into the binary format as numbers only where printing them gives back the same text */
+static void write_cell(database_handle_t *out, const char *cell)
+{
+	char buf[32], *end;
+	long long v;
+
+	if (*cell != '\0' && strlen(cell) < 12)
+	{
+		v = strtoll(cell, &end, 10);
+		snprintf(buf, sizeof buf, "%lld", v);
+
+		if (*end == '\0' && !strcmp(buf, cell))
+		{
+			if (v >= 0 && v <= UINT_MAX)
+			{
+				db_write_uint(out, v);
+				return;
+			}
+			if (v < 0 && v >= INT_MIN)
+			{
+				db_write_int(out, v);
+				return;
+			}
+		}
+	}
+
+	db_write_word(out, cell);
+}
+
+static unsigned int convert_rows(database_handle_t *in, database_handle_t *out, bool to_binary)
+{
+	const char *type, *cell, *next;
+	unsigned int rows = 0;
+
+	while (db_read_next_row(in))
+	{
+		type = db_read_word(in);
+		if (type == NULL || *type == '\0' || strchr("#\n\t \r", *type))
+			continue;
+
+		/* both backends write their own header */
+		if (!strcmp(type, "GRVER"))
+			continue;
+
+		db_start_row(out, type);
+
+		for (cell = db_read_word(in); cell != NULL; cell = next)
+		{
+			next = db_read_word(in);
+
+			if (to_binary)
+				write_cell(out, cell);
+			else if (next == NULL)
+				db_write_str(out, cell);
+			else
+				db_write_word(out, cell);
+		}
+
+		db_commit_row(out);
+		rows++;
+	}
+
+	return rows;
+}
+
+int main(int argc, char *argv[])
+{
+	database_module_t *opensex, *binary;
+	database_handle_t *in, *out;
+	bool to_binary;
+	unsigned int rows;
+
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: %s <input> <output>\n", argv[0]);
+		fprintf(stderr, "Converts between opensex and binary databases; both names are relative to %s.\n", DATADIR);
+		return EXIT_FAILURE;
+	}
+
+	atheme_bootstrap();
+	atheme_init(argv[0], LOGDIR "/dbconvert.log");
+	atheme_setup();
+
+	runflags = RF_LIVE;
+	datadir = DATADIR;
+	strict_mode = false;
+	offline_mode = true;
+
+	if (module_load("backend/opensex") == NULL)
+		return EXIT_FAILURE;
+	opensex = db_mod;
+
+	if (module_load("backend/binary") == NULL)
+		return EXIT_FAILURE;
+	binary = db_mod;
+
+	to_binary = !is_binary(argv[1]);
+
+	slog(LG_INFO, "dbconvert: converting %s (%s) to %s (%s)", argv[1], to_binary ? "opensex" : "binary",
+			argv[2], to_binary ? "binary" : "opensex");
+
+	db_mod = to_binary ? opensex : binary;
+	if ((in = db_open(argv[1], DB_READ)) == NULL)
+		return EXIT_FAILURE;
+
+	db_mod = to_binary ? binary : opensex;
+	if ((out = db_open(argv[2], DB_WRITE)) == NULL)
+		return EXIT_FAILURE;
+
+	rows = convert_rows(in, out, to_binary);
+
+	if (!db_close(out))
+		return EXIT_FAILURE;
+	db_mod = to_binary ? opensex : binary;
+	db_close(in);
+
+	slog(LG_INFO, "dbconvert: wrote %u rows", rows);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2014-2018 Xtheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Times the matchers used by RMATCH, RAKILL and RWATCH against a
+ * synthetic userlist of "nick!user@host gecos" masks.
+ *
+ * usage: regexbench [users] [regex]
+ */
+
+#include "atheme.h"
+#ifdef HAVE_PCRE
+#include <pcre.h>
+#endif
+
+#define DEFAULT_USERS	500000
+#define DEFAULT_REGEX	"^guest[0-9]+!.*@.*\\.dsl\\.example[0-9]\\.net "
+#define DEFAULT_GLOB	"guest*!*@*.dsl.example?.net *"
+
+static const char *const domains[] = {
+	"dsl.example1.net", "dsl.example2.net", "cable.example.com",
+	"users.irc4fun.net", "res.provider.org", "mobile.carrier.net",
+};
+
+static char **masks;
+static size_t *lens;
+static unsigned int nmasks;
+
+static void make_userlist(unsigned int count)
+{
+	char buf[512];
+	unsigned int i, r;
+
+	masks = smalloc(count * sizeof *masks);
+	lens = smalloc(count * sizeof *lens);
+
+	srand(1);
+
+	for (i = 0; i < count; i++)
+	{
+		r = rand();
+
+		lens[i] = snprintf(buf, sizeof buf, "%s%u!%s%u@%u-%u-%u.%s %s %u",
+				r % 7 == 0 ? "guest" : "nick", i,
+				r % 3 == 0 ? "~" : "", r % 100000,
+				r % 256, (r >> 8) % 256, (r >> 16) % 256,
+				domains[(r >> 4) % (sizeof domains / sizeof domains[0])],
+				r % 5 == 0 ? "Real Name" : "xtheme user", r % 1000);
+		masks[i] = sstrdup(buf);
+	}
+
+	nmasks = count;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void report(const char *name, double start, unsigned int matches)
+{
+	double elapsed = now() - start;
+
+	printf("%-28s %8.3f s %10.0f users/s %8u matches\n", name, elapsed,
+			elapsed > 0 ? nmasks / elapsed : 0, matches);
+}
+
+static void bench_glob(const char *glob)
+{
+	unsigned int i, matches = 0;
+	double start = now();
+
+	for (i = 0; i < nmasks; i++)
+		if (!match(glob, masks[i]))
+			matches++;
+
+	report("match() glob", start, matches);
+}
+
+static void bench_regex(const char *name, char *pattern, int flags, bool use_len)
+{
+	atheme_regex_t *re;
+	unsigned int i, matches = 0;
+	double start;
+
+	if ((re = regex_create(pattern, flags)) == NULL)
+	{
+		printf("%-28s failed to compile\n", name);
+		return;
+	}
+
+	start = now();
+
+	for (i = 0; i < nmasks; i++)
+		if (use_len ? regex_match_len(re, masks[i], lens[i]) : regex_match(re, masks[i]))
+			matches++;
+
+	report(name, start, matches);
+	regex_destroy(re);
+}
+
+#ifdef HAVE_PCRE
+/* what regex_match() did before patterns were studied */
+static void bench_pcre_plain(const char *pattern)
+{
+	const char *errptr;
+	int erroffset;
+	pcre *re;
+	unsigned int i, matches = 0;
+	double start;
+
+	if ((re = pcre_compile(pattern, PCRE_NO_AUTO_CAPTURE, &errptr, &erroffset, NULL)) == NULL)
+	{
+		printf("%-28s failed to compile: %s\n", "pcre (not studied)", errptr);
+		return;
+	}
+
+	start = now();
+
+	for (i = 0; i < nmasks; i++)
+		if (pcre_exec(re, NULL, masks[i], strlen(masks[i]), 0, 0, NULL, 0) >= 0)
+			matches++;
+
+	report("pcre (not studied)", start, matches);
+	pcre_free(re);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	unsigned int users = DEFAULT_USERS;
+	char *pattern = DEFAULT_REGEX;
+
+	if (argc > 1)
+		users = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		pattern = argv[2];
+
+	if (users == 0)
+	{
+		fprintf(stderr, "usage: %s [users] [regex]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	make_userlist(users);
+
+	printf("%u users, regex: %s\n\n", nmasks, pattern);
+
+	if (argc <= 2)
+		bench_glob(DEFAULT_GLOB);
+	bench_regex("posix", pattern, 0, false);
+#ifdef HAVE_PCRE
+	bench_pcre_plain(pattern);
+	bench_regex("pcre (studied, strlen)", pattern, AREGEX_PCRE, false);
+	bench_regex("pcre (studied, length)", pattern, AREGEX_PCRE, true);
+#else
+	printf("PCRE support is not compiled in.\n");
+#endif
+
+	return EXIT_SUCCESS;
+}